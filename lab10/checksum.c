@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+
+#include <nmmintrin.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "checksum.h"
+
+static const char *csum_names[] = { "none", "crc32c", "xxh64" };
+
+int csum_parse(const char *name, csum_kind *kind)
+{
+  int i;
+
+  for (i = 0; i < (int) (sizeof(csum_names) / sizeof(csum_names[0])); i++) {
+    if (strcmp(name, csum_names[i]) == 0) {
+      *kind = (csum_kind) i;
+      return 0;
+    }
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+const char *csum_name(csum_kind kind)
+{
+  return csum_names[kind];
+}
+
+int csum_width(csum_kind kind)
+{
+  return kind == CSUM_XXH64 ? 16 : 8;
+}
+
+/*
+ * CRC32C (Castagnoli), reflected polynomial 0x82F63B78.
+ */
+static uint32_t crc_table[256];
+
+static void crc32c_table_init(void)
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (k = 0; k < 8; k++)
+      c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+    crc_table[i] = c;
+  }
+}
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *p, size_t n)
+{
+  while (n--)
+    crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t n)
+{
+  uint64_t c = crc, w;
+
+  for (; n >= 8; n -= 8, p += 8) {
+    memcpy(&w, p, 8);
+    c = _mm_crc32_u64(c, w);
+  }
+  crc = (uint32_t) c;
+  for (; n > 0; n--)
+    crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+
+static uint32_t (*crc32c_fn)(uint32_t, const unsigned char *, size_t);
+
+/*
+ * xxHash64.
+ */
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+#define P3 0x165667B19E3779F9ULL
+#define P4 0x85EBCA77C2B2AE63ULL
+#define P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+  uint64_t v;
+
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t in)
+{
+  acc += in * P2;
+  acc = rotl64(acc, 31);
+  return acc * P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t h, uint64_t v)
+{
+  h ^= xxh_round(0, v);
+  return h * P1 + P4;
+}
+
+static void xxh64_stripes(uint64_t *v, const unsigned char *p, size_t n)
+{
+  uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+
+  for (; n >= 32; n -= 32, p += 32) {
+    v1 = xxh_round(v1, read64(p));
+    v2 = xxh_round(v2, read64(p + 8));
+    v3 = xxh_round(v3, read64(p + 16));
+    v4 = xxh_round(v4, read64(p + 24));
+  }
+  v[0] = v1;
+  v[1] = v2;
+  v[2] = v3;
+  v[3] = v4;
+}
+
+void csum_init(csum *c, csum_kind kind)
+{
+  memset(c, 0, sizeof(*c));
+  c->kind = kind;
+  c->crc = 0xFFFFFFFF;
+  c->v[0] = P1 + P2;
+  c->v[1] = P2;
+  c->v[2] = 0;
+  c->v[3] = -P1;
+
+  if (crc32c_fn == NULL) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+      crc32c_fn = crc32c_sse42;
+    } else {
+      crc32c_table_init();
+      crc32c_fn = crc32c_table;
+    }
+  }
+}
+
+void csum_update(csum *c, const void *data, size_t n)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  size_t take, whole;
+
+  c->total += n;
+  switch (c->kind) {
+  case CSUM_CRC32C:
+    c->crc = crc32c_fn(c->crc, p, n);
+    break;
+  case CSUM_XXH64:
+    /* finish a partial stripe first, then whole ones straight from p */
+    if (c->buflen) {
+      take = 32 - c->buflen < n ? 32 - c->buflen : n;
+      memcpy(c->buf + c->buflen, p, take);
+      c->buflen += take;
+      p += take;
+      n -= take;
+      if (c->buflen < 32)
+        break;
+      xxh64_stripes(c->v, c->buf, 32);
+      c->buflen = 0;
+    }
+    whole = n / 32 * 32;
+    xxh64_stripes(c->v, p, whole);
+    memcpy(c->buf, p + whole, n - whole);
+    c->buflen = n - whole;
+    break;
+  default:
+    break;
+  }
+}
+
+uint64_t csum_final(const csum *c)
+{
+  const unsigned char *p = c->buf, *end = c->buf + c->buflen;
+  uint64_t h;
+
+  switch (c->kind) {
+  case CSUM_CRC32C:
+    return c->crc ^ 0xFFFFFFFF;
+  case CSUM_XXH64:
+    if (c->total >= 32) {
+      h = rotl64(c->v[0], 1) + rotl64(c->v[1], 7) +
+          rotl64(c->v[2], 12) + rotl64(c->v[3], 18);
+      h = xxh_merge(h, c->v[0]);
+      h = xxh_merge(h, c->v[1]);
+      h = xxh_merge(h, c->v[2]);
+      h = xxh_merge(h, c->v[3]);
+    } else {
+      h = P5;
+    }
+    h += c->total;
+
+    for (; p + 8 <= end; p += 8)
+      h = rotl64(h ^ xxh_round(0, read64(p)), 27) * P1 + P4;
+    if (p + 4 <= end) {
+      h = rotl64(h ^ (read32(p) * P1), 23) * P2 + P3;
+      p += 4;
+    }
+    for (; p < end; p++)
+      h = rotl64(h ^ (*p * P5), 11) * P1;
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  default:
+    return 0;
+  }
+}
+
+void csum_zeros(csum *c, size_t n)
+{
+  static const unsigned char zeros[65536];
+  size_t take;
+
+  for (; n > 0; n -= take) {
+    take = n < sizeof(zeros) ? n : sizeof(zeros);
+    csum_update(c, zeros, take);
+  }
+}
+
+int csum_file(int fd, off_t size, csum_kind kind, uint64_t *sum)
+{
+  size_t bufsz = 1 << 20;
+  off_t pos = 0, data, hole;
+  csum c;
+  char *buf;
+  ssize_t n;
+
+  if (fdatasync(fd) == -1)
+    return -1;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  if ((buf = malloc(bufsz)) == NULL)
+    return -1;
+
+  csum_init(&c, kind);
+  while (pos < size) {
+    /* holes read back as zeros; no need to actually read them */
+    hole = size;
+    if ((data = lseek(fd, pos, SEEK_DATA)) == -1)
+      data = (errno == ENXIO) ? size : pos;
+    else if ((hole = lseek(fd, data, SEEK_HOLE)) == -1 || hole > size)
+      hole = size;
+    if (data > size)
+      data = size;
+    csum_zeros(&c, data - pos);
+
+    for (pos = data; pos < hole; pos += n) {
+      n = pread(fd, buf, (size_t)(hole - pos) < bufsz ? (size_t)(hole - pos) : bufsz,
+                pos);
+      if (n < 0 && errno == EINTR) {
+        n = 0;
+        continue;
+      }
+      if (n <= 0) {
+        if (n == 0)
+          errno = EIO;      /* shorter than it should be */
+        free(buf);
+        return -1;
+      }
+      csum_update(&c, buf, n);
+    }
+  }
+
+  free(buf);
+  *sum = csum_final(&c);
+  return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Streaming checksums for the verify mode of read_write and memmap.
+ *
+ * crc32c uses the SSE4.2 crc32 instruction when the CPU has it and a
+ * table otherwise; xxh64 is the 64-bit xxHash. Both are fed the data
+ * in pieces with csum_update() while it is still in cache from the
+ * copy, so verifying costs no extra pass over memory.
+ */
+
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef enum csum_kind {
+  CSUM_NONE = 0,
+  CSUM_CRC32C,
+  CSUM_XXH64
+} csum_kind;
+
+typedef struct csum {
+  csum_kind     kind;
+  uint64_t      total;      /* bytes fed in */
+  uint32_t      crc;
+  uint64_t      v[4];       /* xxh64 accumulators */
+  unsigned char buf[32];    /* xxh64 partial stripe */
+  size_t        buflen;
+} csum;
+
+int         csum_parse (const char *name, csum_kind *kind);
+const char *csum_name  (csum_kind kind);
+int         csum_width (csum_kind kind);   /* hex digits to print */
+
+void     csum_init  (csum *c, csum_kind kind);
+void     csum_update(csum *c, const void *data, size_t n);
+void     csum_zeros (csum *c, size_t n);       /* n zero bytes, e.g. a hole */
+uint64_t csum_final (const csum *c);
+
+/*
+ * Checksum the first size bytes of a file as stored: the file is
+ * synced and dropped from the page cache first, so the data really
+ * comes back from the device. Returns 0, or -1 with errno set.
+ */
+int      csum_file  (int fd, off_t size, csum_kind kind, uint64_t *sum);
+
+#endif /* CHECKSUM_H_ */
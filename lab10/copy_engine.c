@@ -0,0 +1,1136 @@
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/statfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "copy_engine.h"
+#include "copy_uring.h"
+
+#define OFF_MAX INT64_MAX
+
+static const char *backend_names[COPY_NUM_BACKENDS] = {
+  "auto", "copy_file_range", "sendfile", "splice", "read_write",
+  "pread_write", "mmap", "direct", "parallel", "io_uring"
+};
+
+const char *copy_backend_name(copy_backend b)
+{
+  return (b >= 0 && b < COPY_NUM_BACKENDS) ? backend_names[b] : "unknown";
+}
+
+int copy_backend_parse(const char *name, copy_backend *b)
+{
+  int i;
+
+  for (i = 0; i < COPY_NUM_BACKENDS; i++) {
+    if (strcmp(name, backend_names[i]) == 0) {
+      *b = (copy_backend) i;
+      return 0;
+    }
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+/*
+ * Errors that mean "this backend can't copy between these two files",
+ * as opposed to a real I/O error. They send the engine to the next
+ * backend instead of failing the copy.
+ */
+static int unsupported(int err)
+{
+  return err == EXDEV || err == EINVAL || err == ENOSYS ||
+         err == EOPNOTSUPP || err == ESPIPE || err == EBADF;
+}
+
+/*
+ * Pipes and sockets have no file offset; for them every backend reads
+ * or writes at the current position and the range runs until EOF.
+ */
+static int seekable(int fd)
+{
+  return lseek(fd, 0, SEEK_CUR) != -1;
+}
+
+static inline size_t chunk_len(off_t pos, off_t end, size_t chunk)
+{
+  return (size_t)(end - pos) < chunk ? (size_t)(end - pos) : chunk;
+}
+
+/*
+ * Each backend copies [*off, end) and advances *off as it goes, so a
+ * backend that gives up half way leaves *off where the next one should
+ * pick up. They return 0 at the end of the range or at EOF.
+ */
+static int do_copy_file_range(int fdin, int fdout, off_t *off, off_t end,
+                              size_t chunk)
+{
+  loff_t in_off, out_off;
+  off_t start = *off;
+  ssize_t n;
+
+  while (*off < end) {
+    in_off = out_off = *off;
+    n = copy_file_range(fdin, &in_off, fdout, &out_off,
+                        chunk_len(*off, end, chunk), 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0) {
+      /*
+       * Files on procfs, sysfs and the like claim EOF right away
+       * instead of failing; let another backend take a look.
+       */
+      if (*off == start) {
+        errno = EINVAL;
+        return -1;
+      }
+      break;
+    }
+    *off += n;
+  }
+  return 0;
+}
+
+static int do_sendfile(int fdin, int fdout, off_t *off, off_t end, size_t chunk)
+{
+  ssize_t n;
+
+  /* sendfile writes at the output's file position */
+  if (seekable(fdout) && lseek(fdout, *off, SEEK_SET) == -1)
+    return -1;
+
+  while (*off < end) {
+    n = sendfile(fdout, fdin, off, chunk_len(*off, end, chunk));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0)
+      break;
+  }
+  return 0;
+}
+
+/*
+ * Write all n bytes of buf, at off if the file is seekable (use_off)
+ * and at the file position otherwise.
+ */
+static int write_all(int fd, const char *buf, size_t n, off_t off, int use_off)
+{
+  ssize_t m;
+
+  while (n > 0) {
+    m = use_off ? pwrite(fd, buf, n, off) : write(fd, buf, n);
+    if (m < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += m;
+    off += m;
+    n -= m;
+  }
+  return 0;
+}
+
+/*
+ * splice needs a pipe on one side, so unless one of the files is a
+ * pipe already, bounce the pages through one: file -> pipe -> file,
+ * with the data never leaving the kernel.
+ */
+static int splice_all(int from, loff_t *from_off, int to, loff_t *to_off,
+                      size_t *len)
+{
+  ssize_t n;
+
+  while (*len > 0) {
+    n = splice(from, from_off, to, to_off, *len, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0) {
+      errno = EIO;
+      return -1;
+    }
+    *len -= n;
+  }
+  return 0;
+}
+
+/*
+ * Write the len bytes left in a pipe out with read() and write(), at
+ * off if the output is seekable.
+ */
+static int drain_pipe(int from, int to, off_t off, int use_off, size_t len)
+{
+  char buf[65536];
+  ssize_t n;
+
+  while (len > 0) {
+    n = read(from, buf, len < sizeof(buf) ? len : sizeof(buf));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0) {
+      errno = EIO;
+      return -1;
+    }
+    if (write_all(to, buf, n, off, use_off) == -1)
+      return -1;
+    off += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int do_splice(int fdin, int fdout, off_t *off, off_t end, size_t chunk)
+{
+  int pfd[2], ret = 0, saved;
+  int in_seek = seekable(fdin), out_seek = seekable(fdout);
+  loff_t in_off, out_off;
+  size_t left;
+  ssize_t n;
+
+  if (pipe(pfd) == -1)
+    return -1;
+  if (chunk > (1 << 20))
+    chunk = 1 << 20;
+  fcntl(pfd[1], F_SETPIPE_SZ, (int) chunk);
+
+  while (*off < end) {
+    in_off = out_off = *off;
+    n = splice(fdin, in_seek ? &in_off : NULL, pfd[1], NULL,
+               chunk_len(*off, end, chunk), SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      ret = -1;
+      break;
+    }
+    if (n == 0)
+      break;
+
+    /* drain everything that went into the pipe */
+    left = n;
+    if (splice_all(pfd[0], NULL, fdout, out_seek ? &out_off : NULL, &left) == -1) {
+      /*
+       * What is still in the pipe is gone from the input, and a pipe
+       * or socket can't give it back: write it out the slow way, so
+       * the backend we fall back to picks up right after it. If even
+       * that fails, the copy has lost data and must not fall back.
+       */
+      saved = errno;
+      *off += n - left;
+      if (drain_pipe(pfd[0], fdout, *off, out_seek, left) == -1) {
+        if (unsupported(errno))
+          errno = EIO;
+      } else {
+        *off += left;
+        errno = saved;
+      }
+      ret = -1;
+      break;
+    }
+    *off += n;
+  }
+
+  saved = errno;
+  close(pfd[0]);
+  close(pfd[1]);
+  errno = saved;
+  return ret;
+}
+
+/*
+ * An aligned block of zeros that the output can leave as a hole.
+ */
+static int zero_block(const char *buf, size_t i, size_t n, off_t off)
+{
+  return (off + i) % COPY_ZERO_BLOCK == 0 && i + COPY_ZERO_BLOCK <= n &&
+         buf[i] == 0 && memcmp(buf + i, buf + i + 1, COPY_ZERO_BLOCK - 1) == 0;
+}
+
+/*
+ * write_all() that seeks over aligned all-zero blocks instead of
+ * writing them, so they stay holes in the output. The caller extends
+ * the file afterwards in case it ends in skipped blocks.
+ */
+static int write_sparse(int fd, const char *buf, size_t n, off_t off,
+                        int use_off, off_t *skipped)
+{
+  size_t i = 0, j, step;
+
+  while (i < n) {
+    /* a run of data up to the next zero block, then a run of those */
+    for (j = i; j < n && !zero_block(buf, j, n, off); j += step) {
+      step = COPY_ZERO_BLOCK - (off + j) % COPY_ZERO_BLOCK;
+      if (step > n - j)
+        step = n - j;
+    }
+    if (j > i && write_all(fd, buf + i, j - i, off + i, use_off) == -1)
+      return -1;
+
+    for (i = j; i < n && zero_block(buf, i, n, off); i += COPY_ZERO_BLOCK)
+      ;
+    if (i > j) {
+      if (!use_off && lseek(fd, i - j, SEEK_CUR) == -1)
+        return -1;
+      if (skipped)
+        *skipped += i - j;
+    }
+  }
+  return 0;
+}
+
+#define RW_POSITIONAL 1     /* pread()/pwrite() instead of read()/write() */
+#define RW_SKIP_ZERO  2     /* leave all-zero blocks as holes */
+
+/*
+ * read()/write() at the file positions, or pread()/pwrite() at explicit
+ * offsets with RW_POSITIONAL. Either way exactly the bytes read are
+ * written back, even after a short read. System calls and skipped
+ * zero blocks are counted into r when it is not NULL.
+ */
+static int do_read_write(int fdin, int fdout, off_t *off, off_t end,
+                         size_t chunk, int flags, copy_result *r)
+{
+  int in_seek = seekable(fdin), out_seek = seekable(fdout);
+  int positional = flags & RW_POSITIONAL;
+  char *buf;
+  ssize_t n;
+
+  if (positional && (!in_seek || !out_seek)) {
+    errno = ESPIPE;
+    return -1;
+  }
+  if (!positional && ((in_seek && lseek(fdin, *off, SEEK_SET) == -1) ||
+                      (out_seek && lseek(fdout, *off, SEEK_SET) == -1)))
+    return -1;
+  if (!out_seek)
+    flags &= ~RW_SKIP_ZERO;
+
+  if ((buf = malloc(chunk)) == NULL)
+    return -1;
+
+  while (*off < end) {
+    if (positional)
+      n = pread(fdin, buf, chunk_len(*off, end, chunk), *off);
+    else
+      n = read(fdin, buf, chunk_len(*off, end, chunk));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      free(buf);
+      return -1;
+    }
+    if (r)
+      r->ops++;
+    if (n == 0)
+      break;
+
+    if (((flags & RW_SKIP_ZERO) ?
+         write_sparse(fdout, buf, n, *off, positional, r ? &r->skipped : NULL) :
+         write_all(fdout, buf, n, *off, positional)) == -1) {
+      free(buf);
+      return -1;
+    }
+    if (r)
+      r->ops++;
+    *off += n;
+  }
+
+  free(buf);
+  return 0;
+}
+
+/*
+ * Copy through windows of chunk bytes mapped from both files. The
+ * output is grown to cover the range first since stores past EOF of a
+ * mapping fault.
+ */
+static int do_mmap(int fdin, int fdout, off_t *off, off_t end, size_t chunk)
+{
+  size_t pagesz = sysconf(_SC_PAGESIZE), len, skew;
+  struct stat in, out;
+  char *src, *dst;
+  off_t base;
+
+  if (fstat(fdin, &in) == -1 || fstat(fdout, &out) == -1)
+    return -1;
+  if (!S_ISREG(in.st_mode) || !S_ISREG(out.st_mode)) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (end > in.st_size)
+    end = in.st_size;
+  if (out.st_size < end && ftruncate(fdout, end) == -1)
+    return -1;
+
+  chunk = (chunk + pagesz - 1) / pagesz * pagesz;
+
+  while (*off < end) {
+    /* mappings start on a page boundary */
+    base = *off / pagesz * pagesz;
+    skew = *off - base;
+    len = chunk_len(*off, end, chunk - skew);
+
+    src = mmap(NULL, skew + len, PROT_READ, MAP_SHARED, fdin, base);
+    if (src == MAP_FAILED)
+      return -1;
+    dst = mmap(NULL, skew + len, PROT_READ | PROT_WRITE, MAP_SHARED, fdout, base);
+    if (dst == MAP_FAILED) {
+      munmap(src, skew + len);
+      return -1;
+    }
+    madvise(src, skew + len, MADV_SEQUENTIAL);
+
+    memcpy(dst + skew, src + skew, len);
+
+    munmap(src, skew + len);
+    munmap(dst, skew + len);
+    *off += len;
+  }
+  return 0;
+}
+
+static int set_direct(int fd, int on)
+{
+  int fl = fcntl(fd, F_GETFL);
+
+  if (fl == -1)
+    return -1;
+  return fcntl(fd, F_SETFL, on ? (fl | O_DIRECT) : (fl & ~O_DIRECT));
+}
+
+/*
+ * Alignment O_DIRECT wants from buffers (*mem) and from offsets and
+ * lengths (*blk) on fd. statx reports it exactly on kernels that know
+ * STATX_DIOALIGN; otherwise the filesystem block size is the usual
+ * requirement, and COPY_DIRECT_ALIGN when even that is unknown.
+ */
+static void direct_align(int fd, size_t *mem, size_t *blk)
+{
+  struct statfs sfs;
+#ifdef STATX_DIOALIGN
+  struct statx stx;
+
+  if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+      (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align) {
+    *mem = stx.stx_dio_mem_align;
+    *blk = stx.stx_dio_offset_align;
+    return;
+  }
+#endif
+  *mem = *blk = COPY_DIRECT_ALIGN;
+  if (fstatfs(fd, &sfs) == 0 && sfs.f_bsize > 0)
+    *mem = *blk = sfs.f_bsize;
+}
+
+/*
+ * Double buffering for the O_DIRECT copy: the calling thread reads
+ * into one buffer while a writer thread writes out the other. Only
+ * whole blocks are handed to the writer; the tail is left to the
+ * caller.
+ */
+typedef struct direct_buf {
+  char   *data;
+  size_t  len;
+  off_t   off;
+  int     full;
+} direct_buf;
+
+typedef struct direct_ctx {
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  direct_buf      buf[2];
+  int             fdout;
+  int             done;     /* reader has no more buffers to hand over */
+  int             error;    /* errno of a failed write */
+  off_t           written;  /* everything before this is on its way out */
+} direct_ctx;
+
+static void *direct_writer(void *arg)
+{
+  direct_ctx *c = (direct_ctx *) arg;
+  direct_buf *b;
+  int i = 0, err;
+
+  for (;;) {
+    b = &c->buf[i];
+    pthread_mutex_lock(&c->lock);
+    while (!b->full && !c->done)
+      pthread_cond_wait(&c->cond, &c->lock);
+    if (!b->full) {
+      pthread_mutex_unlock(&c->lock);
+      return NULL;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    err = write_all(c->fdout, b->data, b->len, b->off, 1) == -1 ? errno : 0;
+
+    pthread_mutex_lock(&c->lock);
+    b->full = 0;
+    if (err)
+      c->error = err;
+    else
+      c->written = b->off + b->len;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    if (err)
+      return NULL;
+    i ^= 1;
+  }
+}
+
+/*
+ * O_DIRECT copy: both files bypass the page cache, so the buffers, the
+ * offsets and the lengths must all be aligned the way direct_align()
+ * says. Reads and writes overlap through two buffers. A final partial
+ * block is written with O_DIRECT turned back off. Filesystems without
+ * O_DIRECT support fail with EINVAL.
+ */
+static int do_direct(int fdin, int fdout, off_t *off, off_t end, size_t chunk)
+{
+  size_t mem, blk, in_mem, in_blk, whole;
+  direct_ctx c;
+  direct_buf *b;
+  pthread_t writer;
+  int i = 0, ret = -1, saved, started = 0;
+  off_t pos = *off;
+  ssize_t n = 0;
+
+  direct_align(fdin, &in_mem, &in_blk);
+  direct_align(fdout, &mem, &blk);
+  if (in_mem > mem)
+    mem = in_mem;
+  if (in_blk > blk)
+    blk = in_blk;
+  if (mem < sizeof(void *))
+    mem = sizeof(void *);
+  if (*off % blk) {
+    errno = EINVAL;
+    return -1;
+  }
+  chunk = (chunk + blk - 1) / blk * blk;
+
+  memset(&c, 0, sizeof(c));
+  c.fdout = fdout;
+  c.written = *off;
+  for (i = 0; i < 2; i++)
+    if ((errno = posix_memalign((void **) &c.buf[i].data, mem, chunk)) != 0) {
+      c.buf[i].data = NULL;
+      goto out;
+    }
+  if (set_direct(fdin, 1) == -1 || set_direct(fdout, 1) == -1)
+    goto out;
+
+  pthread_mutex_init(&c.lock, NULL);
+  pthread_cond_init(&c.cond, NULL);
+  if ((errno = pthread_create(&writer, NULL, direct_writer, &c)) != 0)
+    goto out;
+  started = 1;
+
+  for (i = 0; pos < end; i ^= 1) {
+    b = &c.buf[i];
+    pthread_mutex_lock(&c.lock);
+    while (b->full && !c.error)
+      pthread_cond_wait(&c.cond, &c.lock);
+    n = c.error ? -1 : 0;
+    pthread_mutex_unlock(&c.lock);
+    if (n < 0)
+      break;
+
+    /* read whole blocks; at EOF the read just comes up short */
+    do {
+      n = pread(fdin, b->data, (chunk_len(pos, end, chunk) + blk - 1) / blk * blk,
+                pos);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+      break;
+    if (n > end - pos)
+      n = end - pos;
+
+    whole = n / blk * blk;
+    if (whole) {
+      pthread_mutex_lock(&c.lock);
+      b->len = whole;
+      b->off = pos;
+      b->full = 1;
+      pthread_cond_broadcast(&c.cond);
+      pthread_mutex_unlock(&c.lock);
+    }
+    pos += whole;
+    if ((size_t) n > whole)
+      break;
+  }
+  saved = errno;
+
+  pthread_mutex_lock(&c.lock);
+  c.done = 1;
+  pthread_cond_broadcast(&c.cond);
+  pthread_mutex_unlock(&c.lock);
+  pthread_join(writer, NULL);
+
+  if (c.error) {
+    errno = c.error;
+    goto out;
+  }
+  *off = c.written;
+  if (n < 0) {
+    errno = saved;
+    goto out;
+  }
+
+  /* the unaligned tail is still in buffer i, after its whole blocks */
+  if (n > 0 && (size_t) n > n / blk * blk) {
+    whole = n / blk * blk;
+    if (set_direct(fdout, 0) == -1 ||
+        write_all(fdout, c.buf[i].data + whole, n - whole, *off, 1) == -1)
+      goto out;
+    *off += n - whole;
+  }
+  ret = 0;
+
+out:
+  saved = errno;
+  if (started) {
+    pthread_mutex_destroy(&c.lock);
+    pthread_cond_destroy(&c.cond);
+  }
+  set_direct(fdin, 0);
+  set_direct(fdout, 0);
+  free(c.buf[0].data);
+  free(c.buf[1].data);
+  errno = saved;
+  return ret;
+}
+
+/*
+ * Spans cut back to the input's size, dropping the ones past it, into
+ * a new array *out. Returns how many are left, or -1.
+ */
+static int clip_spans(const copy_span *x, int n, off_t size, copy_span **out)
+{
+  int i, m = 0;
+
+  if ((*out = (copy_span *) malloc((n ? n : 1) * sizeof(copy_span))) == NULL)
+    return -1;
+  for (i = 0; i < n && x[i].start < size; i++) {
+    (*out)[m].start = x[i].start;
+    (*out)[m].end = x[i].end < size ? x[i].end : size;
+    if ((*out)[m].end > (*out)[m].start)
+      m++;
+  }
+  return m;
+}
+
+/*
+ * Parallel copy of a list of spans, with one pool of workers for all
+ * of them. Every span is cut into chunk-sized pieces, numbered across
+ * the spans, and every worker starts out owning an equal run of
+ * consecutive pieces, which it copies front to back. A worker that
+ * runs dry steals the back half of the largest run left, so a slow
+ * device region or a descheduled thread doesn't leave the others idle
+ * at the end.
+ */
+typedef struct par_queue {
+  pthread_mutex_t lock;
+  size_t          next;     /* first piece not yet taken */
+  size_t          end;      /* one past the last piece owned */
+} __attribute__((aligned(64))) par_queue;
+
+typedef struct par_ctx {
+  int        fdin;
+  int        fdout;
+  copy_span *x;
+  int        nx;
+  size_t    *first;         /* first piece of each span, and the count */
+  size_t     chunk;
+  int        nthreads;
+  par_queue *q;
+  int        flags;         /* RW_* flags for the workers' copies */
+  int        error;         /* first errno hit by any worker */
+  size_t     steals;
+} par_ctx;
+
+typedef struct par_worker {
+  par_ctx   *ctx;
+  int        id;
+  pthread_t  thread;
+} par_worker;
+
+static int par_take(par_ctx *c, int id, size_t *piece)
+{
+  par_queue *q = &c->q[id], *v, *victim;
+  size_t left, most, n;
+  int i;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->next < q->end) {
+    *piece = q->next++;
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  for (;;) {
+    /* pick the fullest queue; the count is a hint, rechecked under lock */
+    victim = NULL;
+    most = 0;
+    for (i = 0; i < c->nthreads; i++) {
+      v = &c->q[i];
+      left = __atomic_load_n(&v->end, __ATOMIC_RELAXED) -
+             __atomic_load_n(&v->next, __ATOMIC_RELAXED);
+      if (i != id && (ssize_t) left > (ssize_t) most) {
+        most = left;
+        victim = v;
+      }
+    }
+    if (victim == NULL)
+      return 0;
+
+    pthread_mutex_lock(&victim->lock);
+    if (victim->next >= victim->end) {
+      pthread_mutex_unlock(&victim->lock);
+      continue;
+    }
+    n = (victim->end - victim->next + 1) / 2;
+    victim->end -= n;
+    left = victim->end;
+    pthread_mutex_unlock(&victim->lock);
+
+    pthread_mutex_lock(&q->lock);
+    q->next = left;
+    q->end = left + n;
+    *piece = q->next++;
+    pthread_mutex_unlock(&q->lock);
+    __atomic_add_fetch(&c->steals, 1, __ATOMIC_RELAXED);
+    return 1;
+  }
+}
+
+static void *par_worker_main(void *arg)
+{
+  par_worker *w = (par_worker *) arg;
+  par_ctx *c = w->ctx;
+  off_t pos, end;
+  size_t piece;
+  int lo, hi, k;
+
+  while (!__atomic_load_n(&c->error, __ATOMIC_RELAXED) &&
+         par_take(c, w->id, &piece)) {
+    /* the span the piece is in: the last one starting at or before it */
+    for (lo = 0, hi = c->nx - 1; lo < hi; ) {
+      k = (lo + hi + 1) / 2;
+      if (c->first[k] <= piece)
+        lo = k;
+      else
+        hi = k - 1;
+    }
+    pos = c->x[lo].start + (off_t) (piece - c->first[lo]) * c->chunk;
+    end = pos + (off_t) c->chunk < c->x[lo].end ? pos + (off_t) c->chunk
+                                                : c->x[lo].end;
+    if (do_read_write(c->fdin, c->fdout, &pos, end, c->chunk, c->flags, NULL) == -1 ||
+        pos != end) {
+      /* a short copy means the input shrank under us */
+      __atomic_store_n(&c->error, pos != end ? EIO : errno, __ATOMIC_RELAXED);
+    }
+  }
+  return NULL;
+}
+
+/*
+ * On success *off is the end of the last span within the input, and
+ * is left alone if none are.
+ */
+static int do_parallel(int fdin, int fdout, const copy_span *x, int nx,
+                       off_t *off, size_t chunk, int nthreads, int flags,
+                       copy_result *r)
+{
+  par_ctx c;
+  par_worker *w = NULL;
+  size_t pieces, per;
+  struct stat st, out;
+  off_t last;
+  int i, ret = -1;
+
+  if (fstat(fdin, &st) == -1 || fstat(fdout, &out) == -1)
+    return -1;
+  if (!S_ISREG(st.st_mode)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(&c, 0, sizeof(c));
+  if ((c.nx = clip_spans(x, nx, st.st_size, &c.x)) <= 0) {
+    free(c.x);
+    return c.nx;
+  }
+  last = c.x[c.nx - 1].end;
+
+  /*
+   * Give the destination its final size up front, so the workers'
+   * pwrites never race to extend it and the filesystem can allocate
+   * it contiguously. Only the spans being copied are allocated, which
+   * leaves holes elsewhere alone; with zero blocks to skip nothing is.
+   * fallocate isn't everywhere; ftruncate is.
+   */
+  for (i = 0; i < c.nx && !(flags & RW_SKIP_ZERO); i++)
+    if (fallocate(fdout, 0, c.x[i].start, c.x[i].end - c.x[i].start) == -1)
+      break;
+  if (((flags & RW_SKIP_ZERO) || i < c.nx) &&
+      out.st_size < last && ftruncate(fdout, last) == -1)
+    goto out;
+
+  if (nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  chunk = (chunk + COPY_DIRECT_ALIGN - 1) / COPY_DIRECT_ALIGN * COPY_DIRECT_ALIGN;
+  if ((c.first = (size_t *) malloc((c.nx + 1) * sizeof(size_t))) == NULL)
+    goto out;
+  c.first[0] = 0;
+  for (i = 0; i < c.nx; i++)
+    c.first[i + 1] = c.first[i] + (c.x[i].end - c.x[i].start + chunk - 1) / chunk;
+  pieces = c.first[c.nx];
+  if ((size_t) nthreads > pieces)
+    nthreads = pieces;
+
+  c.fdin = fdin;
+  c.fdout = fdout;
+  c.chunk = chunk;
+  c.nthreads = nthreads;
+  c.flags = flags | RW_POSITIONAL;
+  c.q = (par_queue *) calloc(nthreads, sizeof(par_queue));
+  w = (par_worker *) calloc(nthreads, sizeof(par_worker));
+  if (c.q == NULL || w == NULL)
+    goto out;
+
+  per = pieces / nthreads;
+  for (i = 0; i < nthreads; i++) {
+    pthread_mutex_init(&c.q[i].lock, NULL);
+    c.q[i].next = i * per;
+    c.q[i].end = (i == nthreads - 1) ? pieces : (i + 1) * per;
+  }
+  for (i = 0; i < nthreads; i++) {
+    w[i].ctx = &c;
+    w[i].id = i;
+    pthread_create(&w[i].thread, NULL, par_worker_main, &w[i]);
+  }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(w[i].thread, NULL);
+  for (i = 0; i < nthreads; i++)
+    pthread_mutex_destroy(&c.q[i].lock);
+
+  if (nthreads > r->threads)
+    r->threads = nthreads;
+  r->steals += c.steals;
+
+  if (c.error) {
+    errno = c.error;
+    goto out;
+  }
+  *off = last;
+  ret = 0;
+
+out:
+  free(c.q);
+  free(w);
+  free(c.first);
+  free(c.x);
+  return ret;
+}
+
+/*
+ * io_uring copy (copy_uring.c) of a list of spans, through one ring
+ * for all of them; *off is left as do_parallel() leaves it. Pipes and
+ * other unsized inputs, and kernels where io_uring is missing or
+ * locked down, take the synchronous pread/pwrite or read/write loop
+ * instead, span by span, which is then reported as the backend used.
+ */
+static int do_uring(int fdin, int fdout, const copy_span *x, int nx,
+                    off_t *off, size_t chunk, int depth, copy_result *r)
+{
+  copy_uring_stats st;
+  copy_span *in_x;
+  struct stat in;
+  int positional, n, i, ret;
+
+  if (fstat(fdin, &in) == -1)
+    return -1;
+  positional = seekable(fdin) && seekable(fdout);
+  if (S_ISREG(in.st_mode) && in.st_size > 0 && positional) {
+    if ((n = clip_spans(x, nx, in.st_size, &in_x)) <= 0) {
+      free(in_x);
+      return n;
+    }
+    ret = copy_uring(fdin, fdout, in_x, n, chunk, depth, &st);
+    if (ret == 0) {
+      *off = in_x[n - 1].end;
+      r->ops += st.ops;
+      r->depth = depth > 0 ? depth : COPY_URING_DEPTH;
+    }
+    free(in_x);
+    if (ret == 0)
+      return 0;
+    if (errno != ENOSYS && errno != EPERM)
+      return -1;
+  }
+
+  r->backend = positional ? COPY_PREAD_WRITE : COPY_READ_WRITE;
+  r->tried |= 1u << r->backend;
+  for (i = 0; i < nx; i++) {
+    *off = x[i].start;
+    if (do_read_write(fdin, fdout, off, x[i].end, chunk,
+                      positional ? RW_POSITIONAL : 0, r) == -1)
+      return -1;
+    if (*off < x[i].end)
+      break;                /* EOF */
+  }
+  return 0;
+}
+
+/*
+ * Best-first order of the backends for a pair of files. Same-filesystem
+ * regular files get copy_file_range first, which can reflink or do a
+ * server-side copy; sockets are what sendfile is built for; pipes only
+ * work with splice. read_write always comes last.
+ */
+static int backend_order(int fdin, int fdout, copy_backend *order)
+{
+  struct stat in, out;
+  int n = 0;
+
+  if (fstat(fdin, &in) == -1 || fstat(fdout, &out) == -1)
+    return -1;
+
+  if (S_ISFIFO(in.st_mode) || S_ISFIFO(out.st_mode)) {
+    order[n++] = COPY_SPLICE;
+  } else if (S_ISSOCK(out.st_mode)) {
+    order[n++] = COPY_SENDFILE;
+    order[n++] = COPY_SPLICE;
+  } else {
+    order[n++] = COPY_FILE_RANGE;
+    order[n++] = COPY_SENDFILE;
+    order[n++] = COPY_SPLICE;
+  }
+  order[n++] = COPY_READ_WRITE;
+  return n;
+}
+
+/*
+ * Copy [*pos, end) with the first backend in order[*first..n) that can
+ * handle the files, and leave *first at it so the next extent starts
+ * there instead of failing through the same backends again.
+ */
+static int copy_extent(int fdin, int fdout, off_t *pos, off_t end,
+                       const copy_opts *o, copy_result *r,
+                       const copy_backend *order, int n, int *first)
+{
+  size_t chunk = o->chunk ? o->chunk : COPY_DEFAULT_CHUNK;
+  int flags = o->zero_detect ? RW_SKIP_ZERO : 0;
+  copy_span span = { *pos, end };
+  int i, ret = -1;
+
+  for (i = *first; i < n; i++) {
+    r->tried |= 1u << order[i];
+    r->backend = order[i];
+    *first = i;
+
+    switch (order[i]) {
+    case COPY_FILE_RANGE:
+      ret = do_copy_file_range(fdin, fdout, pos, end, chunk);
+      break;
+    case COPY_SENDFILE:
+      ret = do_sendfile(fdin, fdout, pos, end, chunk);
+      break;
+    case COPY_SPLICE:
+      ret = do_splice(fdin, fdout, pos, end, chunk);
+      break;
+    case COPY_READ_WRITE:
+      ret = do_read_write(fdin, fdout, pos, end, chunk, flags, r);
+      break;
+    case COPY_PREAD_WRITE:
+      ret = do_read_write(fdin, fdout, pos, end, chunk, flags | RW_POSITIONAL, r);
+      break;
+    case COPY_MMAP:
+      ret = do_mmap(fdin, fdout, pos, end, chunk);
+      break;
+    case COPY_DIRECT:
+      ret = do_direct(fdin, fdout, pos, end, chunk);
+      break;
+    case COPY_PARALLEL:
+      ret = do_parallel(fdin, fdout, &span, 1, pos, chunk, o->threads, flags, r);
+      break;
+    case COPY_URING:
+      ret = do_uring(fdin, fdout, &span, 1, pos, chunk, o->depth, r);
+      break;
+    default:
+      errno = EINVAL;
+      ret = -1;
+    }
+
+    if (ret == 0 || !unsupported(errno) || o->backend != COPY_AUTO)
+      break;
+  }
+  return ret;
+}
+
+/*
+ * The data extents of [pos, end) of a regular file, found with
+ * SEEK_DATA/SEEK_HOLE, into a new array *x; filesystems that don't
+ * report holes make the whole range one extent. Returns how many, or
+ * -1.
+ */
+static int data_spans(int fd, off_t pos, off_t end, copy_span **x)
+{
+  copy_span *grown;
+  off_t data, hole;
+  int n = 0, cap = 0;
+
+  *x = NULL;
+  while (pos < end) {
+    hole = end;
+    if ((data = lseek(fd, pos, SEEK_DATA)) == -1)
+      data = errno == ENXIO ? end : pos;    /* all hole, or no hole support */
+    else if ((hole = lseek(fd, data, SEEK_HOLE)) == -1)
+      hole = end;
+    if (data > end)
+      data = end;
+    if (hole > end)
+      hole = end;
+    if (data == end)
+      break;
+
+    if (n == cap) {
+      cap = cap ? 2 * cap : 16;
+      if ((grown = (copy_span *) realloc(*x, cap * sizeof(copy_span))) == NULL) {
+        free(*x);
+        *x = NULL;
+        return -1;
+      }
+      *x = grown;
+    }
+    (*x)[n].start = data;
+    (*x)[n].end = hole;
+    n++;
+    pos = hole;
+  }
+  return n;
+}
+
+/*
+ * Copy all the extents with one pool of threads or one io_uring ring,
+ * rather than setting one up and tearing it down for each.
+ */
+static int copy_spans(int fdin, int fdout, const copy_span *x, int nx,
+                      off_t *pos, const copy_opts *o, copy_result *r)
+{
+  size_t chunk = o->chunk ? o->chunk : COPY_DEFAULT_CHUNK;
+  int flags = o->zero_detect ? RW_SKIP_ZERO : 0;
+
+  r->tried |= 1u << o->backend;
+  r->backend = o->backend;
+  *pos = x[0].start;
+  if (o->backend == COPY_PARALLEL)
+    return do_parallel(fdin, fdout, x, nx, pos, chunk, o->threads, flags, r);
+  return do_uring(fdin, fdout, x, nx, pos, chunk, o->depth, r);
+}
+
+/*
+ * Unless o->dense is set, a regular input going to a seekable output is
+ * copied one data extent at a time, found with SEEK_DATA/SEEK_HOLE, and
+ * the holes between extents are seeked over so they stay holes in the
+ * output. The backends never see a hole. The parallel and io_uring
+ * backends get all the extents at once.
+ */
+int copy_range(int fdin, int fdout, off_t off, off_t len,
+               const copy_opts *o, copy_result *r)
+{
+  copy_backend order[COPY_NUM_BACKENDS];
+  copy_span *x = NULL;
+  off_t pos = off, end = off + len, prev;
+  struct stat in, out;
+  int n, nx = 0, k, first = 0, ret = 0;
+
+  memset(r, 0, sizeof(*r));
+
+  if (o->backend != COPY_AUTO) {
+    order[0] = o->backend;
+    n = 1;
+  } else if ((n = backend_order(fdin, fdout, order)) == -1) {
+    return -1;
+  }
+
+  if (fstat(fdin, &in) == -1 || fstat(fdout, &out) == -1)
+    return -1;
+  if (o->dense || !S_ISREG(in.st_mode) || in.st_size == 0 ||
+      !S_ISREG(out.st_mode)) {
+    ret = copy_extent(fdin, fdout, &pos, end, o, r, order, n, &first);
+    end = pos;
+  } else {
+    if (end > in.st_size)
+      end = in.st_size;
+    if ((nx = data_spans(fdin, pos, end, &x)) == -1)
+      return -1;
+  }
+
+  if (nx > 0 && (o->backend == COPY_PARALLEL || o->backend == COPY_URING)) {
+    ret = copy_spans(fdin, fdout, x, nx, &pos, o, r);
+  } else {
+    for (k = 0; k < nx; k++) {
+      pos = x[k].start;
+      if ((ret = copy_extent(fdin, fdout, &pos, x[k].end, o, r, order, n,
+                             &first)) == -1 || pos < x[k].end)
+        break;              /* failed, or the file shrank under us */
+    }
+  }
+
+  /* the holes up to pos were skipped, and a trailing one if it got there */
+  for (k = 0, prev = off; k < nx && x[k].start <= pos; prev = x[k++].end)
+    r->skipped += x[k].start - prev;
+  if (ret == 0 && (nx == 0 || pos == x[nx - 1].end)) {
+    r->skipped += end - pos;
+    pos = end;
+  }
+  free(x);
+
+  /* a trailing hole (or skipped zero block) still counts for the size */
+  if (ret == 0 && pos == end && S_ISREG(out.st_mode) &&
+      fstat(fdout, &out) == 0 && out.st_size < end && ftruncate(fdout, end) == -1)
+    ret = -1;
+
+  r->bytes = pos - off;
+  return ret;
+}
+
+/*
+ * Copy a whole file. Input that is not a regular file, or claims to be
+ * empty the way procfs files do, is copied until EOF.
+ */
+int copy_file(int fdin, int fdout, const copy_opts *o, copy_result *r)
+{
+  struct stat st;
+
+  if (fstat(fdin, &st) == -1)
+    return -1;
+  if (!S_ISREG(st.st_mode) || st.st_size == 0)
+    st.st_size = OFF_MAX;
+  return copy_range(fdin, fdout, 0, st.st_size, o, r);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copy engine shared by the lab10 copy tools.
+ *
+ * A copy is done by one of several backends. Kernel-side backends
+ * (copy_file_range, sendfile, splice) never bring the data into user
+ * space; read_write is the portable user-space loop they all fall back
+ * to. pread_write, mmap and direct (O_DIRECT) are only used when asked
+ * for by name, mostly by the copybench harness. parallel splits the
+ * range into chunks copied with pread/pwrite by a pool of threads.
+ * io_uring keeps a queue of asynchronous reads and writes in flight
+ * and drops back to pread/pwrite where io_uring is unavailable. With
+ * COPY_AUTO the engine tries the backends best-first for the file
+ * types involved and moves on to the next one whenever the kernel says
+ * a backend can't handle these files (EXDEV, EINVAL, ...).
+ *
+ * Holes in a regular input file are found with SEEK_DATA/SEEK_HOLE and
+ * left as holes in the output whatever the backend, unless dense is
+ * set; zero_detect additionally turns aligned all-zero blocks into
+ * holes in the read/write style backends.
+ *
+ * All functions return 0 on success and -1 with errno set on failure.
+ */
+
+#ifndef COPY_ENGINE_H_
+#define COPY_ENGINE_H_
+
+#include <sys/types.h>
+
+typedef enum copy_backend {
+  COPY_AUTO = 0,
+  COPY_FILE_RANGE,
+  COPY_SENDFILE,
+  COPY_SPLICE,
+  COPY_READ_WRITE,
+  COPY_PREAD_WRITE,
+  COPY_MMAP,
+  COPY_DIRECT,
+  COPY_PARALLEL,
+  COPY_URING,
+  COPY_NUM_BACKENDS
+} copy_backend;
+
+typedef struct copy_opts {
+  copy_backend backend;     /* COPY_AUTO picks and falls back */
+  size_t       chunk;       /* bytes per system call, 0 for the default */
+  int          threads;     /* parallel workers, 0 for one per CPU */
+  int          depth;       /* io_uring chunks in flight, 0 for the default */
+  int          dense;       /* write holes out as zeros */
+  int          zero_detect; /* skip COPY_ZERO_BLOCK blocks of zeros too */
+} copy_opts;
+
+typedef struct copy_result {
+  off_t        bytes;       /* bytes copied */
+  copy_backend backend;     /* backend that copied the data */
+  unsigned int tried;       /* bitmask (1 << backend) of backends tried */
+  int          threads;     /* parallel: workers used */
+  size_t       steals;      /* parallel: chunk ranges stolen by idle workers */
+  size_t       ops;         /* read/write style and io_uring: I/O requests */
+  int          depth;       /* io_uring: chunks in flight, 0 if it fell back */
+  off_t        skipped;     /* bytes of holes and zero blocks not written */
+} copy_result;
+
+#define COPY_DEFAULT_CHUNK (1 << 20)
+#define COPY_DIRECT_ALIGN  4096     /* O_DIRECT alignment when unknown */
+#define COPY_ZERO_BLOCK    4096
+
+const char *copy_backend_name (copy_backend b);
+int         copy_backend_parse(const char *name, copy_backend *b);
+
+int copy_range(int fdin, int fdout, off_t off, off_t len,
+               const copy_opts *o, copy_result *r);
+int copy_file (int fdin, int fdout, const copy_opts *o, copy_result *r);
+
+#endif /* COPY_ENGINE_H_ */
@@ -0,0 +1,173 @@
+#include <immintrin.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "copy_simd.h"
+
+/* how far ahead of the loads the source is prefetched */
+#define PREFETCH_AHEAD 512
+
+/*
+ * The original memmap loop, one byte at a time. Kept out of reach of
+ * the vectorizer so it stays the baseline it was.
+ */
+__attribute__((optimize("no-tree-vectorize")))
+void copy_byte(void *dst, const void *src, size_t n, int nt)
+{
+  char *d = (char *) dst;
+  const char *s = (const char *) src;
+  size_t i;
+
+  (void) nt;
+  /* Memory can be dereferenced using the * operator in C.  This line
+   * stores what is in the memory location pointed to by src into
+   * the memory location pointed to by dest.
+   */
+  for (i = 0; i < n; i++)
+    d[i] = s[i];
+}
+
+/*
+ * Eight bytes at a time through general purpose registers, for CPUs
+ * without any of the vector extensions below.
+ */
+__attribute__((optimize("no-tree-vectorize")))
+void copy_scalar(void *dst, const void *src, size_t n, int nt)
+{
+  char *d = (char *) dst;
+  const char *s = (const char *) src;
+  uint64_t w;
+  size_t i;
+
+  (void) nt;
+  for (i = 0; i + 8 <= n; i += 8) {
+    memcpy(&w, s + i, 8);
+    memcpy(d + i, &w, 8);
+  }
+  for (; i < n; i++)
+    d[i] = s[i];
+}
+
+/*
+ * The vector kernels share one shape: byte copies up to the first
+ * W-aligned destination address (streaming stores must be aligned),
+ * then four vectors per iteration with unaligned loads and a prefetch
+ * of every cache line PREFETCH_AHEAD bytes on, then the tail.
+ * A store fence after streaming stores orders them with whatever the
+ * caller does next.
+ */
+#define VECTOR_COPY(W, T, LOAD, STORE, STREAM)                          \
+  char *d = (char *) dst;                                               \
+  const char *s = (const char *) src;                                   \
+  size_t head = (W - ((uintptr_t) d & (W - 1))) & (W - 1), i, p;        \
+  T a, b, c, e;                                                         \
+                                                                        \
+  if (head > n)                                                         \
+    head = n;                                                           \
+  for (i = 0; i < head; i++)                                            \
+    d[i] = s[i];                                                        \
+  d += head;                                                            \
+  s += head;                                                            \
+  n -= head;                                                            \
+                                                                        \
+  for (i = 0; i + 4 * W <= n; i += 4 * W) {                             \
+    for (p = 0; p < 4 * W; p += 64) {                                   \
+      if (nt)                                                           \
+        _mm_prefetch(s + i + p + PREFETCH_AHEAD, _MM_HINT_NTA);         \
+      else                                                              \
+        _mm_prefetch(s + i + p + PREFETCH_AHEAD, _MM_HINT_T0);          \
+    }                                                                   \
+    a = LOAD((const T *) (s + i));                                      \
+    b = LOAD((const T *) (s + i + W));                                  \
+    c = LOAD((const T *) (s + i + 2 * W));                              \
+    e = LOAD((const T *) (s + i + 3 * W));                              \
+    if (nt) {                                                           \
+      STREAM((T *) (d + i), a);                                         \
+      STREAM((T *) (d + i + W), b);                                     \
+      STREAM((T *) (d + i + 2 * W), c);                                 \
+      STREAM((T *) (d + i + 3 * W), e);                                 \
+    } else {                                                            \
+      STORE((T *) (d + i), a);                                          \
+      STORE((T *) (d + i + W), b);                                      \
+      STORE((T *) (d + i + 2 * W), c);                                  \
+      STORE((T *) (d + i + 3 * W), e);                                  \
+    }                                                                   \
+  }                                                                     \
+  if (nt)                                                               \
+    _mm_sfence();                                                       \
+  for (; i < n; i++)                                                    \
+    d[i] = s[i];
+
+__attribute__((target("sse2")))
+void copy_sse2(void *dst, const void *src, size_t n, int nt)
+{
+  VECTOR_COPY(16, __m128i, _mm_loadu_si128, _mm_store_si128, _mm_stream_si128)
+}
+
+__attribute__((target("avx2")))
+void copy_avx2(void *dst, const void *src, size_t n, int nt)
+{
+  VECTOR_COPY(32, __m256i, _mm256_loadu_si256, _mm256_store_si256,
+              _mm256_stream_si256)
+}
+
+__attribute__((target("avx512f")))
+void copy_avx512(void *dst, const void *src, size_t n, int nt)
+{
+  VECTOR_COPY(64, __m512i, _mm512_loadu_si512, _mm512_store_si512,
+              _mm512_stream_si512)
+}
+
+/*
+ * Copies at least this large should use streaming stores: the size of
+ * the last level cache, or 8 MiB when the C library can't tell.
+ */
+size_t copy_nt_threshold(void)
+{
+  long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+  if (llc <= 0)
+    llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  return llc > 0 ? (size_t) llc : (size_t) 8 << 20;
+}
+
+/*
+ * Pick a kernel. With name == NULL (or "auto") the widest one the CPU
+ * supports is used; otherwise the named kernel is forced, provided the
+ * CPU can run it. The name of the kernel returned is stored in *chosen.
+ */
+copy_kernel_fn copy_kernel_select(const char *name, const char **chosen)
+{
+  int avx512, avx2, sse2;
+
+  __builtin_cpu_init();
+  avx512 = __builtin_cpu_supports("avx512f");
+  avx2 = __builtin_cpu_supports("avx2");
+  sse2 = __builtin_cpu_supports("sse2");
+
+  if (name == NULL || strcmp(name, "auto") == 0)
+    name = avx512 ? "avx512" : avx2 ? "avx2" : sse2 ? "sse2" : "scalar";
+
+  if (strcmp(name, "avx512") == 0 && avx512) {
+    *chosen = "avx512";
+    return copy_avx512;
+  }
+  if (strcmp(name, "avx2") == 0 && avx2) {
+    *chosen = "avx2";
+    return copy_avx2;
+  }
+  if (strcmp(name, "sse2") == 0 && sse2) {
+    *chosen = "sse2";
+    return copy_sse2;
+  }
+  if (strcmp(name, "scalar") == 0) {
+    *chosen = "scalar";
+    return copy_scalar;
+  }
+  if (strcmp(name, "byte") == 0) {
+    *chosen = "byte";
+    return copy_byte;
+  }
+  return NULL;
+}
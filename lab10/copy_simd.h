@@ -0,0 +1,27 @@
+/*
+ * Vectorized memory copy kernels for memmap and copykern.
+ *
+ * Every kernel copies n bytes from src to dst (which must not overlap)
+ * and prefetches the source ahead of the loads. With nt set the wide
+ * kernels store with non-temporal (streaming) stores, which go around
+ * the caches: worth it only when the copy is much larger than the last
+ * level cache and would otherwise flush it, see copy_nt_threshold().
+ */
+
+#ifndef COPY_SIMD_H_
+#define COPY_SIMD_H_
+
+#include <stddef.h>
+
+typedef void (*copy_kernel_fn)(void *dst, const void *src, size_t n, int nt);
+
+copy_kernel_fn copy_kernel_select(const char *name, const char **chosen);
+size_t         copy_nt_threshold (void);
+
+void copy_byte  (void *dst, const void *src, size_t n, int nt);
+void copy_scalar(void *dst, const void *src, size_t n, int nt);
+void copy_sse2  (void *dst, const void *src, size_t n, int nt);
+void copy_avx2  (void *dst, const void *src, size_t n, int nt);
+void copy_avx512(void *dst, const void *src, size_t n, int nt);
+
+#endif /* COPY_SIMD_H_ */
@@ -0,0 +1,355 @@
+/*
+ * io_uring copy pipeline for copy_engine.c.
+ *
+ * Up to depth chunks are in flight at once. Each chunk is a linked
+ * pair of SQEs, a read into one of the ring's buffers followed by a
+ * write of the same buffer (IOSQE_IO_LINK), so the kernel starts the
+ * write as soon as the read completes without a trip back to user
+ * space. The two files and the buffers are registered with the ring
+ * when the kernel lets us, which saves the per-request file and page
+ * lookups; otherwise plain READ/WRITE requests are used.
+ *
+ * This talks to the kernel through the raw system calls rather than
+ * liburing, which is not installed everywhere.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "copy_uring.h"
+
+#define OP_READ   0
+#define OP_WRITE  1
+
+typedef struct uring {
+  int                  fd;
+  unsigned int         sq_entries;
+  unsigned int        *sq_head;
+  unsigned int        *sq_tail;
+  unsigned int        *sq_mask;
+  unsigned int        *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned int        *cq_head;
+  unsigned int        *cq_tail;
+  unsigned int        *cq_mask;
+  struct io_uring_cqe *cqes;
+  void                *sq_ring;
+  size_t               sq_ring_sz;
+  void                *cq_ring;
+  size_t               cq_ring_sz;
+  size_t               sqes_sz;
+} uring;
+
+typedef struct uring_slot {
+  off_t   off;              /* file offset of the chunk */
+  size_t  len;              /* bytes asked for */
+  ssize_t nread;            /* result of the read */
+  int     busy;
+} uring_slot;
+
+static int uring_setup(uring *u, unsigned int entries)
+{
+  struct io_uring_params p;
+
+  memset(u, 0, sizeof(*u));
+  memset(&p, 0, sizeof(p));
+  u->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (u->fd < 0)
+    return -1;
+
+  u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_ring_sz > u->sq_ring_sz)
+      u->sq_ring_sz = u->cq_ring_sz;
+    u->cq_ring_sz = 0;
+  }
+
+  u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (u->sq_ring == MAP_FAILED)
+    goto fail;
+  if (u->cq_ring_sz) {
+    u->cq_ring = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    if (u->cq_ring == MAP_FAILED)
+      goto fail;
+  } else {
+    u->cq_ring = u->sq_ring;
+  }
+  u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED)
+    goto fail;
+
+  u->sq_entries = p.sq_entries;
+  u->sq_head  = (unsigned int *) ((char *) u->sq_ring + p.sq_off.head);
+  u->sq_tail  = (unsigned int *) ((char *) u->sq_ring + p.sq_off.tail);
+  u->sq_mask  = (unsigned int *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+  u->sq_array = (unsigned int *) ((char *) u->sq_ring + p.sq_off.array);
+  u->cq_head  = (unsigned int *) ((char *) u->cq_ring + p.cq_off.head);
+  u->cq_tail  = (unsigned int *) ((char *) u->cq_ring + p.cq_off.tail);
+  u->cq_mask  = (unsigned int *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *) ((char *) u->cq_ring + p.cq_off.cqes);
+  return 0;
+
+fail:
+  close(u->fd);
+  return -1;
+}
+
+static void uring_teardown(uring *u)
+{
+  munmap(u->sqes, u->sqes_sz);
+  if (u->cq_ring != u->sq_ring)
+    munmap(u->cq_ring, u->cq_ring_sz);
+  munmap(u->sq_ring, u->sq_ring_sz);
+  close(u->fd);
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring *u)
+{
+  unsigned int tail = *u->sq_tail;
+  unsigned int idx = tail & *u->sq_mask;
+
+  if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+    return NULL;
+  u->sq_array[idx] = idx;
+  memset(&u->sqes[idx], 0, sizeof(struct io_uring_sqe));
+  /* made visible to the kernel by the tail update in uring_queue */
+  return &u->sqes[idx];
+}
+
+static void uring_queue(uring *u)
+{
+  __atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_enter(uring *u, unsigned int submit, unsigned int wait)
+{
+  int ret;
+
+  do {
+    ret = syscall(__NR_io_uring_enter, u->fd, submit, wait,
+                  wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+  return ret;
+}
+
+/*
+ * Finish a chunk with plain pread/pwrite, for the rare cases where the
+ * ring copied less than asked: a short read that broke the link, or a
+ * short write.
+ */
+static int finish_sync(int fdin, int fdout, char *buf, off_t off, size_t len,
+                       size_t done, copy_uring_stats *st)
+{
+  ssize_t n;
+
+  while (done < len) {
+    n = pread(fdin, buf + done, len - done, off + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0) {
+      errno = EIO;
+      return -1;
+    }
+    st->ops++;
+    for (ssize_t w = 0, m; w < n; w += m) {
+      if ((m = pwrite(fdout, buf + done + w, n - w, off + done + w)) < 0) {
+        if (errno == EINTR) {
+          m = 0;
+          continue;
+        }
+        return -1;
+      }
+      st->ops++;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+int copy_uring(int fdin, int fdout, const copy_span *x, int n, size_t chunk,
+               int depth, copy_uring_stats *st)
+{
+  uring u;
+  uring_slot *slot = NULL;
+  struct iovec *iov = NULL;
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  int fds[2] = { fdin, fdout };
+  int fixed_files, fixed_bufs, ret = -1, saved, i, inflight = 0, k = 0, m;
+  unsigned int head, queued = 0, pending = 0;
+  __u64 user_data;
+  __s32 res;
+  off_t next = n > 0 ? x[0].start : 0;
+  size_t len;
+
+  memset(st, 0, sizeof(*st));
+  if (depth <= 0)
+    depth = COPY_URING_DEPTH;
+  chunk = (chunk + 4095) / 4096 * 4096;
+
+  if (uring_setup(&u, 2 * depth) == -1)
+    return -1;
+
+  slot = (uring_slot *) calloc(depth, sizeof(uring_slot));
+  iov = (struct iovec *) calloc(depth, sizeof(struct iovec));
+  if (slot == NULL || iov == NULL)
+    goto out;
+  for (i = 0; i < depth; i++) {
+    iov[i].iov_len = chunk;
+    if ((errno = posix_memalign(&iov[i].iov_base, 4096, chunk)) != 0) {
+      iov[i].iov_base = NULL;
+      goto out;
+    }
+  }
+
+  /* Registration is an optimization; RLIMIT_MEMLOCK may say no */
+  fixed_files = syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_FILES,
+                        fds, 2) == 0;
+  fixed_bufs = syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_BUFFERS,
+                       iov, depth) == 0;
+  st->fixed_files = fixed_files;
+  st->fixed_bufs = fixed_bufs;
+
+  for (;;) {
+    /*
+     * Fill every free slot with a linked read -> write pair, moving on
+     * to the next span when one is all queued
+     */
+    for (i = 0; i < depth; i++) {
+      while (k < n && next >= x[k].end)
+        if (++k < n)
+          next = x[k].start;
+      if (k == n)
+        break;
+      if (slot[i].busy)
+        continue;
+      len = (size_t)(x[k].end - next) < chunk ? (size_t)(x[k].end - next)
+                                              : chunk;
+      slot[i].off = next;
+      slot[i].len = len;
+      slot[i].nread = 0;
+      slot[i].busy = 1;
+      next += len;
+
+      sqe = uring_get_sqe(&u);
+      sqe->opcode = fixed_bufs ? IORING_OP_READ_FIXED : IORING_OP_READ;
+      sqe->fd = fixed_files ? 0 : fdin;
+      sqe->flags = IOSQE_IO_LINK | (fixed_files ? IOSQE_FIXED_FILE : 0);
+      sqe->addr = (unsigned long) iov[i].iov_base;
+      sqe->len = len;
+      sqe->off = slot[i].off;
+      sqe->buf_index = i;
+      sqe->user_data = (i << 1) | OP_READ;
+      uring_queue(&u);
+
+      sqe = uring_get_sqe(&u);
+      sqe->opcode = fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+      sqe->fd = fixed_files ? 1 : fdout;
+      sqe->flags = fixed_files ? IOSQE_FIXED_FILE : 0;
+      sqe->addr = (unsigned long) iov[i].iov_base;
+      sqe->len = len;
+      sqe->off = slot[i].off;
+      sqe->buf_index = i;
+      sqe->user_data = (i << 1) | OP_WRITE;
+      uring_queue(&u);
+
+      queued += 2;
+      inflight++;
+    }
+
+    if (inflight == 0)
+      break;
+    /*
+     * queued: SQEs the kernel hasn't taken yet; pending: ones it has
+     * taken and not completed, which are what the error path below has
+     * to wait for
+     */
+    if ((m = uring_enter(&u, queued, 1)) < 0)
+      goto out;
+    queued -= m;
+    pending += m;
+
+    /*
+     * Reap whatever has completed. Each CQE is handed back to the
+     * kernel as soon as it is read, so one we bail out on isn't seen
+     * again by the drain.
+     */
+    head = *u.cq_head;
+    while (head != __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE)) {
+      cqe = &u.cqes[head & *u.cq_mask];
+      user_data = cqe->user_data;
+      res = cqe->res;
+      __atomic_store_n(u.cq_head, ++head, __ATOMIC_RELEASE);
+      pending--;
+      i = user_data >> 1;
+      st->ops++;
+
+      if ((user_data & 1) == OP_READ) {
+        slot[i].nread = res;
+      } else {
+        /*
+         * The write either did the whole chunk or was cancelled because
+         * its read came up short (or failed); anything else left over
+         * is finished synchronously.
+         */
+        if (res < 0 && res != -ECANCELED) {
+          errno = -res;
+          goto out;
+        }
+        if (slot[i].nread < 0) {
+          errno = -slot[i].nread;
+          goto out;
+        }
+        if ((size_t) res != slot[i].len) {
+          st->sync_fixups++;
+          if (finish_sync(fdin, fdout, (char *) iov[i].iov_base, slot[i].off,
+                          slot[i].len, res > 0 ? res : 0, st) == -1)
+            goto out;
+        }
+        slot[i].busy = 0;
+        inflight--;
+      }
+    }
+  }
+
+  ret = 0;
+
+out:
+  saved = errno;
+  /*
+   * Drain every request the kernel took before its buffer goes away.
+   * Ones still queued were never submitted and never will be.
+   */
+  while (pending > 0 && uring_enter(&u, 0, 1) >= 0) {
+    head = *u.cq_head;
+    while (pending > 0 && head != __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE)) {
+      head++;
+      pending--;
+    }
+    __atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+  }
+  uring_teardown(&u);
+  if (iov)
+    for (i = 0; i < depth; i++)
+      free(iov[i].iov_base);
+  free(iov);
+  free(slot);
+  errno = saved;
+  return ret;
+}
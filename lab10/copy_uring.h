@@ -0,0 +1,35 @@
+/*
+ * io_uring copy pipeline used by the io_uring backend of copy_engine.c.
+ *
+ * copy_uring() copies the n spans x[] between two seekable files, each
+ * to the same offsets in the output, through one ring with up to depth
+ * linked read -> write pairs in flight across all of them. Every span
+ * must lie within the input. It returns 0 on success and -1 with errno
+ * set on failure; ENOSYS or EPERM mean io_uring is not available at
+ * all.
+ */
+
+#ifndef COPY_URING_H_
+#define COPY_URING_H_
+
+#include <sys/types.h>
+
+#define COPY_URING_DEPTH 16
+
+/* [start, end) of the input, copied to the same offsets of the output */
+typedef struct copy_span {
+  off_t start;
+  off_t end;
+} copy_span;
+
+typedef struct copy_uring_stats {
+  size_t ops;               /* reads and writes completed */
+  size_t sync_fixups;       /* chunks finished with pread/pwrite */
+  int    fixed_files;       /* files were registered with the ring */
+  int    fixed_bufs;        /* buffers were registered with the ring */
+} copy_uring_stats;
+
+int copy_uring(int fdin, int fdout, const copy_span *x, int n, size_t chunk,
+               int depth, copy_uring_stats *st);
+
+#endif /* COPY_URING_H_ */
@@ -0,0 +1,212 @@
+/*
+ * Copy-method benchmark.
+ *
+ * Copies <fromfile> to <tofile> with every copy_engine backend asked
+ * for, at every power-of-two buffer size from -s to -S bytes, with the
+ * page cache cold (input evicted with posix_fadvise(DONTNEED) before
+ * the run) and/or warm (input read once before the run). Each run is
+ * checked for the right output size and printed as one CSV line:
+ *
+ *   method,buf_size,cache,bytes,seconds,mb_per_s,user_s,sys_s
+ *
+ * A run that fails gets a line of zeros, and its error goes to stderr.
+ *
+ * With -f the output is fdatasync()ed inside the timed region, so the
+ * time includes getting the data to the device. -t sets the thread
+ * count of the parallel method and -q the queue depth of io_uring.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "copy_engine.h"
+
+#define MIN_BUF   512
+#define MAX_BUF   (64 << 20)
+
+void err_quit (const char * mesg)
+{
+  printf ("%s\n", mesg);
+  exit(1);
+}
+
+void err_sys (const char * mesg)
+{
+  perror(mesg);
+  exit(errno);
+}
+
+#define USAGE "usage: copybench [-m method,...] [-s min_buf] [-S max_buf] " \
+              "[-c cold|warm|both] [-r reps] [-t threads] [-q depth] [-f] " \
+              "<fromfile> <tofile>"
+
+static const copy_backend default_methods[] = {
+  COPY_READ_WRITE, COPY_MMAP, COPY_PREAD_WRITE, COPY_SENDFILE, COPY_SPLICE,
+  COPY_DIRECT, COPY_URING
+};
+
+static double tv_secs(struct timeval tv)
+{
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Evict the input from the page cache, or pull all of it in.
+ */
+static void set_cache(int fd, off_t size, int warm)
+{
+  static char buf[1 << 20];
+  off_t off;
+
+  if (!warm) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    return;
+  }
+  for (off = 0; off < size; off += sizeof(buf))
+    if (pread(fd, buf, sizeof(buf), off) <= 0)
+      break;
+}
+
+/*
+ * One timed copy. Returns -1 if the backend could not copy these files
+ * (e.g. O_DIRECT on a filesystem without it), which is reported in the
+ * CSV rather than aborting the whole sweep.
+ */
+static int run_one(const char *from, const char *to, copy_backend m,
+                   size_t bufsz, int warm, int do_sync, int threads, int depth)
+{
+  struct timespec t0, t1;
+  struct rusage r0, r1;
+  struct stat st;
+  copy_opts o;
+  copy_result r;
+  int fdin, fdout, ret;
+  double secs;
+
+  if ((fdin = open(from, O_RDONLY)) < 0)
+    err_sys("can't open input");
+  if ((fdout = open(to, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+    err_sys("can't create output");
+  if (fstat(fdin, &st) == -1)
+    err_sys("fstat error");
+
+  /* an old output copy would otherwise hog the cache too */
+  posix_fadvise(fdout, 0, 0, POSIX_FADV_DONTNEED);
+  set_cache(fdin, st.st_size, warm);
+
+  memset(&o, 0, sizeof(o));
+  o.backend = m;
+  o.chunk = bufsz;
+  o.threads = threads;
+  o.depth = depth;
+
+  getrusage(RUSAGE_SELF, &r0);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  ret = copy_range(fdin, fdout, 0, st.st_size, &o, &r);
+  if (ret == 0 && do_sync)
+    ret = fdatasync(fdout);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  getrusage(RUSAGE_SELF, &r1);
+
+  secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  if (ret == -1) {
+    fprintf(stderr, "copybench: %s, %zu byte buffer, %s: %s\n",
+            copy_backend_name(m), bufsz, warm ? "warm" : "cold",
+            strerror(errno));
+    printf("%s,%zu,%s,0,0,0,0,0\n", copy_backend_name(m), bufsz,
+           warm ? "warm" : "cold");
+  } else {
+    if (r.bytes != st.st_size) {
+      fprintf(stderr, "%s copied %lld of %lld bytes. Abort.\n",
+              copy_backend_name(m), (long long) r.bytes, (long long) st.st_size);
+      exit(1);
+    }
+    printf("%s,%zu,%s,%lld,%.6f,%.1f,%.6f,%.6f\n", copy_backend_name(m), bufsz,
+           warm ? "warm" : "cold", (long long) r.bytes, secs,
+           secs > 0 ? r.bytes / secs / 1e6 : 0.0,
+           tv_secs(r1.ru_utime) - tv_secs(r0.ru_utime),
+           tv_secs(r1.ru_stime) - tv_secs(r0.ru_stime));
+  }
+  fflush(stdout);
+
+  close(fdin);
+  close(fdout);
+  return ret;
+}
+
+int main (int argc, char *argv[])
+{
+  copy_backend methods[COPY_NUM_BACKENDS];
+  size_t min_buf = MIN_BUF, max_buf = MAX_BUF, bufsz;
+  int num_methods = 0, reps = 1, cold = 1, warm = 1, do_sync = 0, threads = 0;
+  int depth = 0;
+  int opt, i, rep, w;
+  char *name;
+
+  while ((opt = getopt(argc, argv, "m:s:S:c:r:t:q:f")) != -1) {
+    switch (opt) {
+    case 'm':
+      for (name = strtok(optarg, ","); name; name = strtok(NULL, ",")) {
+        if (num_methods == COPY_NUM_BACKENDS ||
+            copy_backend_parse(name, &methods[num_methods]) == -1)
+          err_quit (USAGE);
+        num_methods++;
+      }
+      break;
+    case 's':
+      min_buf = strtoull(optarg, NULL, 0);
+      break;
+    case 'S':
+      max_buf = strtoull(optarg, NULL, 0);
+      break;
+    case 'c':
+      cold = strcmp(optarg, "warm") != 0;
+      warm = strcmp(optarg, "cold") != 0;
+      break;
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'q':
+      depth = atoi(optarg);
+      break;
+    case 'f':
+      do_sync = 1;
+      break;
+    default:
+      err_quit (USAGE);
+    }
+  }
+  if (argc - optind != 2 || min_buf == 0 || min_buf > max_buf || reps < 1)
+    err_quit (USAGE);
+
+  if (num_methods == 0) {
+    num_methods = sizeof(default_methods) / sizeof(default_methods[0]);
+    memcpy(methods, default_methods, sizeof(default_methods));
+  }
+
+  printf("method,buf_size,cache,bytes,seconds,mb_per_s,user_s,sys_s\n");
+  for (i = 0; i < num_methods; i++)
+    for (bufsz = min_buf; bufsz <= max_buf; bufsz *= 2)
+      for (w = 0; w <= 1; w++) {
+        if ((w && !warm) || (!w && !cold))
+          continue;
+        for (rep = 0; rep < reps; rep++)
+          run_one(argv[optind], argv[optind + 1], methods[i], bufsz, w, do_sync,
+                  threads, depth);
+      }
+
+  return 0;
+}
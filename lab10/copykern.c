@@ -0,0 +1,131 @@
+/*
+ * Copy kernel microbenchmark.
+ *
+ * Times every kernel of copy_simd.c, with normal and with streaming
+ * stores, against memcpy() and the original byte loop of memmap, on
+ * in-memory buffers of every power-of-four size from -s to -S bytes.
+ * Each measurement repeats the copy for at least -t seconds and is
+ * printed as one CSV line:
+ *
+ *   kernel,stores,size,gb_per_s
+ *
+ * Kernels the CPU can't run are left out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "copy_simd.h"
+
+#define MIN_SIZE  4096
+#define MAX_SIZE  (256 << 20)
+
+void err_quit (const char * mesg)
+{
+  printf ("%s\n", mesg);
+  exit(1);
+}
+
+#define USAGE "usage: copykern [-s min_size] [-S max_size] [-t seconds]"
+
+static const char *kernels[] = {
+  "byte", "scalar", "sse2", "avx2", "avx512"
+};
+
+static void copy_memcpy(void *dst, const void *src, size_t n, int nt)
+{
+  (void) nt;
+  memcpy(dst, src, n);
+}
+
+static double now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * GB/s of fn copying size bytes, over as many copies as fit in secs.
+ */
+static double measure(copy_kernel_fn fn, char *dst, const char *src,
+                      size_t size, int nt, double secs)
+{
+  double t0, t;
+  size_t reps = 0;
+
+  fn(dst, src, size, nt);   /* warm up */
+  t0 = now();
+  do {
+    fn(dst, src, size, nt);
+    reps++;
+  } while ((t = now() - t0) < secs);
+
+  /* keep the compiler from deciding the copies are dead */
+  if (dst[size - 1] != src[size - 1])
+    err_quit ("copy mismatch. Abort.");
+  return (double) size * reps / t / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+  size_t min_size = MIN_SIZE, max_size = MAX_SIZE, size, i;
+  double secs = 0.2;
+  copy_kernel_fn fn;
+  const char *chosen;
+  char *src, *dst;
+  int opt, nt;
+
+  while ((opt = getopt(argc, argv, "s:S:t:")) != -1) {
+    switch (opt) {
+    case 's':
+      min_size = strtoull(optarg, NULL, 0);
+      break;
+    case 'S':
+      max_size = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      secs = atof(optarg);
+      break;
+    default:
+      err_quit (USAGE);
+    }
+  }
+  if (optind != argc || min_size == 0 || min_size > max_size)
+    err_quit (USAGE);
+
+  /* touch every page up front so no run pays for the page faults */
+  if ((src = malloc(max_size + 64)) == NULL || (dst = malloc(max_size + 128)) == NULL)
+    err_quit ("out of memory. Abort.");
+  for (i = 0; i < max_size + 64; i++)
+    src[i] = (char) (i * 131 + 7);
+  memset(dst, 0, max_size + 128);
+
+  printf("# last level cache %zu bytes, streaming stores from there up by default\n",
+         copy_nt_threshold());
+  printf("kernel,stores,size,gb_per_s\n");
+  for (size = min_size; size <= max_size; size *= 4) {
+    printf("memcpy,normal,%zu,%.2f\n", size,
+           measure(copy_memcpy, dst + 64, src, size, 0, secs));
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+      if ((fn = copy_kernel_select(kernels[i], &chosen)) == NULL)
+        continue;
+      for (nt = 0; nt <= 1; nt++) {
+        if (nt && (fn == copy_byte || fn == copy_scalar))
+          continue;         /* these have no streaming stores */
+        printf("%s,%s,%zu,%.2f\n", chosen, nt ? "streaming" : "normal", size,
+               measure(fn, dst + 64, src, size, nt, secs));
+      }
+      fflush(stdout);
+    }
+  }
+
+  free(src);
+  free(dst);
+  return 0;
+}
@@ -3,15 +3,29 @@
  * Environment by Richard Stevens.
  */
 
+#define _GNU_SOURCE
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h> /* mmap() is defined in this header */
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>  /* memcpy */
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
+
+#include "copy_simd.h"
+#include "checksum.h"
+
+/* -z: leave pages of the input that are all zeros as holes too */
+static int skip_zero;
+
+#define USAGE "usage: memmap [-w window_bytes] [-v] [-z] " \
+              "[-k auto|byte|scalar|sse2|avx2|avx512] [-N nt_bytes] " \
+              "[-c crc32c|xxh64] [-V] <fromfile> <tofile>"
 
 void err_quit (const char * mesg)
 {
@@ -25,22 +39,259 @@ void err_sys (const char * mesg)
   exit(errno);
 }
 
+/*
+ * Copy len bytes from one mapping to the other, with the kernel picked
+ * by -k: the widest SIMD one the CPU has by default, or "byte" for the
+ * original one-byte-at-a-time loop. Copies of at least -N bytes (the
+ * size of the last level cache by default) use streaming stores, so
+ * copying a huge file doesn't flush everything else out of the cache.
+ */
+static copy_kernel_fn kernel;
+static int use_nt;
+
+/*
+ * With -c every byte of the input is also fed to a checksum, in blocks
+ * small enough to still be in cache from the copy.
+ */
+#define SUM_BLOCK (64 * 1024)
+
+static csum sum;
+
+static void copy_bytes (char *dst, const char *src, size_t len)
+{
+  size_t n;
+
+  if (sum.kind == CSUM_NONE) {
+    kernel(dst, src, len, use_nt);
+    return;
+  }
+  for (; len > 0; dst += n, src += n, len -= n) {
+    n = len < SUM_BLOCK ? len : SUM_BLOCK;
+    kernel(dst, src, n, use_nt);
+    csum_update(&sum, src, n);
+  }
+}
+
+/*
+ * An all-zero page of the input that -z leaves as a hole.
+ */
+static int zero_page (const char *src, size_t i, size_t end, off_t off,
+                      size_t pagesz)
+{
+  return skip_zero && (off + i) % pagesz == 0 && i + pagesz <= end &&
+         src[i] == 0 && memcmp(src + i, src + i + 1, pagesz - 1) == 0;
+}
+
+/*
+ * Copy the data in [off, off + len) of the input from src to dst,
+ * which map that range of the two files. Holes in the input, found
+ * with SEEK_DATA/SEEK_HOLE, are never touched in dst, so they stay
+ * holes in the output; with skip_zero neither are pages of the data
+ * that are all zeros. Filesystems that don't report holes make the
+ * range all data.
+ */
+static void copy_data (char *dst, const char *src, off_t off, size_t len,
+                       int fdin)
+{
+  off_t pos = off, end = off + len, data, hole;
+  size_t pagesz = sysconf(_SC_PAGESIZE), i, j, last, step;
+
+  while (pos < end) {
+    hole = end;
+    if ((data = lseek(fdin, pos, SEEK_DATA)) == -1)
+      data = (errno == ENXIO) ? end : pos;
+    else if ((hole = lseek(fdin, data, SEEK_HOLE)) == -1 || hole > end)
+      hole = end;
+    if (data > end)
+      data = end;
+    csum_zeros(&sum, data - pos);
+    if (data == end)
+      break;
+
+    /* runs of pages with data, copied in one go, between zero pages */
+    last = hole - off;
+    for (i = data - off; i < last; ) {
+      for (j = i; j < last && !zero_page(src, j, last, off, pagesz); j += step) {
+        step = pagesz - (off + j) % pagesz;
+        if (step > last - j)
+          step = last - j;
+      }
+      copy_bytes(dst + i, src + i, j - i);
+      for (i = j; i < last && zero_page(src, i, last, off, pagesz); i += pagesz)
+        csum_update(&sum, src + i, pagesz);
+    }
+    pos = hole;
+  }
+}
+
+/*
+ * Copy the whole file through a single pair of mappings.
+ */
+static void copy_whole (int fdin, int fdout, off_t size)
+{
+  char *src, *dst;
+
+  /* 
+   * 4. mmap the input file 
+   */
+  src = mmap( NULL, size, PROT_READ, MAP_SHARED, fdin, 0 );
+  if (src == MAP_FAILED)
+    err_sys("mmap of input file failed");
+
+  /* 
+   * 5. mmap the output file 
+   */
+  dst = mmap( NULL, size, (PROT_READ | PROT_WRITE ), MAP_SHARED, fdout, 0 );
+  if (dst == MAP_FAILED)
+    err_sys("mmap of output file failed");
+
+  /* 
+   * 6. copy the input file to the output file 
+   */
+  copy_data(dst, src, 0, size, fdin);
+
+  munmap(src, size);
+  munmap(dst, size);
+}
+
+/*
+ * Wait for the output of a finished window to reach the device, then
+ * evict that range of both files from the page cache.
+ */
+static void evict_window (int fdin, int fdout, off_t off, size_t len)
+{
+  sync_file_range(fdout, off, len,
+                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                  SYNC_FILE_RANGE_WAIT_AFTER);
+  posix_fadvise(fdin, off, len, POSIX_FADV_DONTNEED);
+  posix_fadvise(fdout, off, len, POSIX_FADV_DONTNEED);
+}
+
+/*
+ * Copy the file through a sliding window of win bytes, so neither the
+ * address space nor the page tables ever hold more than two windows of
+ * either file, whatever its size.
+ *
+ * While window k is copied, window k+1 of the input is already mapped
+ * and marked MADV_WILLNEED so the kernel reads it ahead. Once window k
+ * is done its pages are dropped with MADV_DONTNEED and unmapped, and
+ * writeback of its output is started. Window k-1 is waited on and then
+ * evicted from the page cache of both files, which keeps the copy from
+ * flushing everybody else's cached data. The last window gets the same
+ * once the loop is done.
+ */
+static void copy_windowed (int fdin, int fdout, off_t size, size_t win)
+{
+  char *src, *dst, *next;
+  off_t off, prev_off = -1;
+  size_t len, next_len, prev_len = 0;
+
+  len = (size_t)size < win ? (size_t)size : win;
+  next = mmap(NULL, len, PROT_READ, MAP_SHARED, fdin, 0);
+  if (next == MAP_FAILED)
+    err_sys("mmap of input window failed");
+  madvise(next, len, MADV_SEQUENTIAL);
+  madvise(next, len, MADV_WILLNEED);
+
+  for (off = 0; off < size; off += len) {
+    len = (size_t)(size - off) < win ? (size_t)(size - off) : win;
+    src = next;
+
+    dst = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fdout, off);
+    if (dst == MAP_FAILED)
+      err_sys("mmap of output window failed");
+
+    /* Map the window ahead and start reading it in */
+    next = NULL;
+    if (off + (off_t)len < size) {
+      next_len = (size_t)(size - off - len) < win ? (size_t)(size - off - len) : win;
+      next = mmap(NULL, next_len, PROT_READ, MAP_SHARED, fdin, off + len);
+      if (next == MAP_FAILED)
+        err_sys("mmap of input window failed");
+      madvise(next, next_len, MADV_SEQUENTIAL);
+      madvise(next, next_len, MADV_WILLNEED);
+    }
+
+    copy_data(dst, src, off, len, fdin);
+
+    /* Drop the window behind us */
+    madvise(src, len, MADV_DONTNEED);
+    madvise(dst, len, MADV_DONTNEED);
+    munmap(src, len);
+    munmap(dst, len);
+    sync_file_range(fdout, off, len, SYNC_FILE_RANGE_WRITE);
+
+    if (prev_off >= 0)
+      evict_window(fdin, fdout, prev_off, prev_len);
+    prev_off = off;
+    prev_len = len;
+  }
+  if (prev_off >= 0)
+    evict_window(fdin, fdout, prev_off, prev_len);
+}
+
 int main (int argc, char *argv[])
 {
-  int fdin, fdout, i;
-  char *src, *dst, buf[256];
+  int fdin, fdout, opt, verbose;
+  char buf[256];
   struct stat statbuf;
+  struct rusage usage;
+  struct timespec t0, t1;
+  size_t window, pagesz, nt_min;
+  const char *kname, *chosen;
+  csum_kind kind;
+  uint64_t back;
+  int verify;
+
+  window = 0;
+  verbose = 0;
+  kname = NULL;
+  nt_min = copy_nt_threshold();
+  kind = CSUM_NONE;
+  verify = 0;
+  while ((opt = getopt(argc, argv, "w:vzk:N:c:V")) != -1) {
+    switch (opt) {
+    case 'w':
+      window = strtoull(optarg, NULL, 0);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    case 'z':
+      skip_zero = 1;
+      break;
+    case 'k':
+      kname = optarg;
+      break;
+    case 'N':
+      nt_min = strtoull(optarg, NULL, 0);
+      break;
+    case 'c':
+      if (csum_parse(optarg, &kind) == -1)
+        err_quit (USAGE);
+      break;
+    case 'V':
+      verify = 1;
+      break;
+    default:
+      err_quit (USAGE);
+    }
+  }
 
-  src = dst = NULL;
+  if (argc - optind != 2)
+    err_quit (USAGE);
 
-  if (argc != 3)
-    err_quit ("usage: memmap <fromfile> <tofile>");
+  if ((kernel = copy_kernel_select(kname, &chosen)) == NULL)
+    err_quit ("unknown copy kernel, or one this CPU can't run");
+  if (verify && kind == CSUM_NONE)
+    kind = CSUM_CRC32C;
+  csum_init(&sum, kind);
 
   /* 
    * open the input file 
    */
-  if ((fdin = open (argv[1], O_RDONLY)) < 0) {
-    sprintf(buf, "can't open %s for reading", argv[1]);
+  if ((fdin = open (argv[optind], O_RDONLY)) < 0) {
+    sprintf(buf, "can't open %s for reading", argv[optind]);
     perror(buf);
     exit(errno);
   }
@@ -48,8 +299,8 @@ int main (int argc, char *argv[])
   /* 
    * open/create the output file 
    */
-  if ((fdout = open (argv[2], O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
-    sprintf (buf, "can't create %s for writing", argv[2]);
+  if ((fdout = open (argv[optind + 1], O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+    sprintf (buf, "can't create %s for writing", argv[optind + 1]);
     perror(buf);
     exit(errno);
   }
@@ -63,38 +314,65 @@ int main (int argc, char *argv[])
     exit( errno );
   }
 
-  /* 
-   * 2. go to the location corresponding to the last byte 
+  /*
+   * 2./3. set the size of the output file, so it can be mapped. Unlike
+   * seeking to the last byte and writing a dummy one there, this
+   * allocates nothing: whatever the copy doesn't store to stays a hole.
    */
-  lseek( fdout, (off_t)(statbuf.st_size - 1), SEEK_SET );
+  if (ftruncate( fdout, statbuf.st_size ) == -1)
+    err_sys("ftruncate error");
 
-  /* 
-   * 3. write a dummy byte at the last location 
-   */
-  char dummy = 'z';
-  write( fdout, &dummy, sizeof(dummy));
+  use_nt = (size_t)statbuf.st_size >= nt_min;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
 
-  /* 
-   * 4. mmap the input file 
+  /*
+   * With -w the copy goes through a sliding window, rounded up to whole
+   * pages since mmap offsets must be page aligned. An empty file can't
+   * be mapped, and there is nothing to copy.
    */
-  src = mmap( NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fdin, 0 );
+  if (statbuf.st_size == 0) {
+    /* nothing */
+  } else if (window) {
+    pagesz = sysconf(_SC_PAGESIZE);
+    window = (window + pagesz - 1) / pagesz * pagesz;
+    copy_windowed(fdin, fdout, statbuf.st_size, window);
+  } else {
+    copy_whole(fdin, fdout, statbuf.st_size);
+  }
 
-  /* 
-   * 5. mmap the output file 
-   */
-  dst = mmap( NULL, statbuf.st_size, (PROT_READ | PROT_WRITE ), MAP_SHARED, fdout, 0 );
+  clock_gettime(CLOCK_MONOTONIC, &t1);
 
-  /* 
-   * 6. copy the input file to the output file 
+  if (verbose) {
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("copied %lld bytes in %.3f s (%.1f MB/s), window %zu, max RSS %ld KB, "
+           "kernel %s%s\n",
+           (long long)statbuf.st_size, secs,
+           secs > 0 ? statbuf.st_size / secs / 1e6 : 0.0, window,
+           usage.ru_maxrss, chosen, use_nt ? " (streaming stores)" : "");
+  }
+
+  /*
+   * -c reports the checksum computed during the copy; -V reads the
+   * output back from the device and checks it against that.
    */
-    /* Memory can be dereferenced using the * operator in C.  This line
-     * stores what is in the memory location pointed to by src into
-     * the memory location pointed to by dest.
-     */
-    //*dst = *src;
-    for( int i = 0; i < (int)statbuf.st_size; i++ ) {
-      dst[i] = src[i];
+  if (kind != CSUM_NONE) {
+    printf("%s src %0*llx", csum_name(kind), csum_width(kind),
+           (unsigned long long) csum_final(&sum));
+    if (verify) {
+      if (csum_file(fdout, statbuf.st_size, kind, &back) == -1)
+        err_sys("read back error");
+      printf(" dst %0*llx (read back)\n", csum_width(kind),
+             (unsigned long long) back);
+      if (back != csum_final(&sum))
+        err_quit ("checksum mismatch");
+    } else {
+      printf("\n");
     }
-} 
-
+  }
 
+  close(fdin);
+  close(fdout);
+  return 0;
+}
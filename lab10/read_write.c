@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -6,6 +8,8 @@
 #include <stdlib.h>
 #include <errno.h>
 
+#include "checksum.h"
+
 void err_quit (const char * mesg)
 {
   printf ("%s\n", mesg);
@@ -18,14 +22,45 @@ void err_sys (const char * mesg)
   exit(errno);
 }
 
+#define USAGE "usage: read_write [-c crc32c|xxh64] [-V] <fromfile> <tofile> <buf_size>"
+
 int main (int argc, char *argv[])
 {
-  int fdin, fdout, bufsz;
+  int fdin, fdout, bufsz, opt, verify;
+  ssize_t n = 0, m, done;
+  off_t pos, data, hole;
   char *src;
   struct stat statbuf;
+  csum_kind kind;
+  csum sum;
+  uint64_t back;
 
-  if (argc != 4)
-    err_quit ("usage: read_write <fromfile> <tofile> <buf_size>");
+  /*
+   * -c checksums the data on its way through the buffer, while it is
+   * still in cache from the read; -V then reads the output back from
+   * the device and checksums that too.
+   */
+  kind = CSUM_NONE;
+  verify = 0;
+  while ((opt = getopt(argc, argv, "c:V")) != -1) {
+    switch (opt) {
+    case 'c':
+      if (csum_parse(optarg, &kind) == -1)
+        err_quit (USAGE);
+      break;
+    case 'V':
+      verify = 1;
+      break;
+    default:
+      err_quit (USAGE);
+    }
+  }
+  if (argc - optind != 3)
+    err_quit (USAGE);
+  argv += optind - 1;
+  if (verify && kind == CSUM_NONE)
+    kind = CSUM_CRC32C;
+  csum_init(&sum, kind);
 
   /* open the input file */
   if ((fdin = open (argv[1], O_RDONLY)) < 0) {
@@ -45,12 +80,84 @@ int main (int argc, char *argv[])
 
   /* Allocate a buffer of the size specified */
   bufsz = atoi(argv[3]);
-  src = malloc(bufsz);
-  
-  /* And use it to copy the file */
-  while ((read (fdin, src, bufsz)) > 0) {
-    write (fdout, src, bufsz);
+  if (bufsz <= 0)
+    err_quit ("buf_size must be positive");
+  if ((src = malloc(bufsz)) == NULL)
+    err_sys ("malloc error");
+
+  if (fstat (fdin, &statbuf) == -1)
+    err_sys ("fstat error");
+
+  /*
+   * And use it to copy the file. A read may come up short (always at
+   * the end of the file), so write back only the n bytes it returned.
+   *
+   * Holes in the input are skipped: SEEK_DATA finds where the next data
+   * starts, and seeking the output there too leaves a hole behind. The
+   * reads stop at SEEK_HOLE so no buffer straddles one. Where holes
+   * aren't reported (or on a pipe) the whole input is one run of data.
+   */
+  pos = 0;
+  hole = -1;
+  for (;;) {
+    if (pos >= hole && S_ISREG (statbuf.st_mode)) {
+      if ((data = lseek (fdin, pos, SEEK_DATA)) == -1) {
+        if (errno != ENXIO)
+          hole = statbuf.st_size;   /* no hole support */
+        else
+          break;                    /* nothing but a hole to the end */
+      } else {
+        csum_zeros(&sum, data - pos);
+        /* SEEK_HOLE moves the file position too; put it back */
+        hole = lseek (fdin, data, SEEK_HOLE);
+        if (lseek (fdin, data, SEEK_SET) == -1 ||
+            (data != pos && lseek (fdout, data, SEEK_SET) == -1))
+          err_sys ("lseek error");
+        pos = data;
+      }
+    }
+
+    n = read (fdin, src, (hole > pos && hole - pos < bufsz) ? hole - pos : bufsz);
+    if (n <= 0)
+      break;
+    csum_update(&sum, src, n);
+    for (done = 0; done < n; done += m) {
+      if ((m = write (fdout, src + done, n - done)) < 0)
+        err_sys ("write error");
+    }
+    pos += n;
+  }
+  if (n < 0)
+    err_sys ("read error");
+
+  /* a hole at the end still counts toward the size */
+  if (S_ISREG (statbuf.st_mode)) {
+    if (ftruncate (fdout, statbuf.st_size) == -1)
+      err_sys ("ftruncate error");
+    if (pos < statbuf.st_size)
+      csum_zeros(&sum, statbuf.st_size - pos);
+    pos = statbuf.st_size;
   }
+
+  if (kind != CSUM_NONE) {
+    printf("%s src %0*llx", csum_name(kind), csum_width(kind),
+           (unsigned long long) csum_final(&sum));
+    if (verify) {
+      if (csum_file(fdout, pos, kind, &back) == -1)
+        err_sys ("read back error");
+      printf(" dst %0*llx (read back)\n", csum_width(kind),
+             (unsigned long long) back);
+      if (back != csum_final(&sum))
+        err_quit ("checksum mismatch");
+    } else {
+      printf("\n");
+    }
+  }
+
+  free(src);
+  close(fdin);
+  close(fdout);
+  return 0;
 } /* main */
 
 
@@ -9,12 +9,13 @@
 #include <sys/types.h>
 #include <linux/unistd.h>
 
+#include "dlwatch.h"
+
 #define gettid() syscall(__NR_gettid)
 
 #define NUM_PHILS 5
 #define MAX_BUF 256
 #define NUM_CHOPS NUM_PHILS
-#define FIELDS_TO_IGNORE 13
 
 #define DEADLOCK 1
 #define ACTIVE_DURATION 200
@@ -34,6 +35,8 @@ static unsigned long user_progress[NUM_PHILS];
 static unsigned long user_time[NUM_PHILS];
 static unsigned long sys_progress[NUM_PHILS];
 static unsigned long sys_time[NUM_PHILS];
+static unsigned long meals[NUM_PHILS];
+static dl_watch *watch;
 
 
 /*
@@ -146,6 +149,11 @@ static void *dp_thread(void *arg)
      */
     pthread_mutex_unlock(right_chop(me));
     pthread_mutex_unlock(left_chop(me));
+
+    /*
+     * A meal is the progress the deadlock detector looks for
+     */
+    __atomic_fetch_add(&meals[me->id], 1, __ATOMIC_RELAXED);
   }
 
   return NULL;
@@ -166,6 +174,7 @@ void set_table()
     user_time[i] = 0;
     sys_progress[i] = 0;
     sys_time[i] = 0;
+    meals[i] = 0;
   }
 
   for (i = 0; i < NUM_PHILS; i++) {
@@ -209,114 +218,98 @@ void print_progress()
   printf("\n");
 }
 
-int check_for_deadlock()
+/*
+ * Watch the philosophers until the detector decides they are stuck, or
+ * for 5 seconds, whichever comes first. The detector samples each
+ * diner's /proc/self/task/<tid>/stat in the background and needs only a
+ * few milliseconds of every diner blocked, with no meals eaten, to call
+ * it a deadlock. Returns the verdict, DL_OK if they are still eating.
+ */
+dl_verdict check_for_deadlock()
 {
-  int   deadlock;
-  char  filename[MAX_BUF];
-  int   i;
-  int   j;
-  FILE *statf;
+  dl_thread t;
+  dl_verdict verdict;
+  int i;
 
-  unsigned long new_sys_time;
-  unsigned long new_user_time;
+  verdict = dl_watch_wait(watch, 5000);
 
-  deadlock = 1;
+  /*
+   * Progress is the CPU time (in clock ticks) since the last check
+   */
   for (i = 0; i < NUM_PHILS; i++) {
+    dl_watch_thread(watch, i, &t);
+    user_progress[i] = t.utime - user_time[i];
+    user_time[i] = t.utime;
+    sys_progress[i] = t.stime - sys_time[i];
+    sys_time[i] = t.stime;
+  }
 
-    /*
-     * 1. Store the stat filename for this diner into a buffer. Use the sprintf
-     * library call.
-     */
-    sprintf( filename, statf );
-
-    /* 
-     * 2. Use fopen to open the stat file as a file stream. Open it
-     * with read only permissions.
-     */
-
-    fopen( filename, check_for_deadlock() );
-
-
-
-    /* 
-     * 3. Seek over uninteresting fields. Use fscanf to perform the seek.  You
-     * also need to determine how many fields to skip over - see proc(5)
-     * HINT: Use the the * qualifier to skip tokens without storing them.
-     */
-
-
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    fscanf( statf, "%*s");
-    
-    /* 
-     * 4. Read the time values you want. Use fscanf again. 
-     */ 
-    new_sys_time = fscanf( statf, "%us");
-    new_user_time = fscanf( statf, "%us");
-
-   
-    /*
-     * 5. Use time values to determine if deadlock has occurred.
-     */
-   
-    check_for_deadlock();
+  return verdict;
+}
 
-    /*
-     * 6. Close the stat file stream 
-     */
+/*
+ * Where each diner is stuck, as the kernel sees it
+ */
+void print_stuck()
+{
+  dl_thread t;
+  int i;
 
+  for (i = 0; i < NUM_PHILS; i++) {
+    dl_watch_thread(watch, i, &t);
+    printf("philosopher %d (tid %d): state %c, %lu meals, in %s\n",
+           i, (int) t.tid, t.state, t.progress, t.wchan);
   }
-  
-  return deadlock;
 }
 
 
 int main(int argc, char **argv)
 {
   int i;
-  int deadlock;
-  deadlock = 0;
+  pid_t tids[NUM_PHILS];
+  dl_config cfg;
+  dl_verdict verdict;
 
   srand(time(NULL));
 
   set_table();
 
-  do {
-    /*
-     * Let the philosophers do some thinking and eating
-     */
-    sleep(5);
+  /*
+   * Watch the diners: sample every 100ms while they eat, every 1ms once
+   * a sample shows no meals, and call it deadlock after 20ms of all of
+   * them blocked
+   */
+  for (i = 0; i < NUM_PHILS; i++)
+    tids[i] = diners[i].tid;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.min_ms = 1;
+  cfg.max_ms = 100;
+  cfg.confirm_ms = 20;
+  if ((watch = dl_watch_start(tids, NUM_PHILS, meals, &cfg)) == NULL) {
+    perror("can't watch the philosophers");
+    exit(errno);
+  }
 
+  do {
     /*
-     * Check for deadlock (i.e. none of the philosophers are
-     * making progress)
+     * Let the philosophers do some thinking and eating while checking
+     * for deadlock (i.e. none of the philosophers are making progress)
      */
-    deadlock = 0;
-
-    if (check_for_deadlock()) {
-      deadlock = 1;
-      break;
-    }
+    verdict = check_for_deadlock();
 
     /*
      * Print out the philosophers progress
      */
     print_progress();
-  } while (!deadlock);
+  } while (verdict == DL_OK);
 
   stop = 1;
-  printf ("Reached deadlock\n");
+  if (verdict == DL_DEADLOCK)
+    printf ("Reached deadlock\n");
+  else
+    printf ("Reached livelock\n");
+  print_stuck();
+  dl_watch_stop(watch);
 
   /*
    * Release all locks so philosophers can exit
@@ -332,4 +325,3 @@ int main(int argc, char **argv)
 
   return 0;
 }
-
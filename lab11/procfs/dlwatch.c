@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "dlwatch.h"
+
+struct dl_watch {
+  int                           n;
+  dl_thread                    *t;
+  int                          *fd;         /* open stat file per thread */
+  const volatile unsigned long *progress;
+  dl_config                     cfg;
+
+  pthread_t                     thread;
+  pthread_mutex_t               lock;       /* verdict and every t[i] */
+  pthread_cond_t                done;
+  dl_verdict                    verdict;
+  int                           stop;
+};
+
+static const char *verdict_names[] = { "ok", "deadlock", "livelock" };
+
+const char *dl_verdict_name(dl_verdict v)
+{
+  return verdict_names[v];
+}
+
+static double now_ms(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void sleep_ms(int ms)
+{
+  struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+
+  while (nanosleep(&t, &t) == -1 && errno == EINTR)
+    ;
+}
+
+static void read_wchan(dl_thread *t)
+{
+  char path[64];
+  ssize_t n;
+  int fd;
+
+  snprintf(path, sizeof(path), "/proc/self/task/%d/wchan", (int) t->tid);
+  strcpy(t->wchan, "?");
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return;
+  if ((n = read(fd, t->wchan, sizeof(t->wchan) - 1)) > 0)
+    t->wchan[n] = '\0';
+  close(fd);
+}
+
+/*
+ * One sample of every thread. Sets *progressed if any counter (or, with
+ * no counters, any CPU time) moved, *running if any thread was runnable
+ * or used CPU, and *blocked if every thread was asleep.
+ */
+static void sample(dl_watch *w, int *progressed, int *running, int *blocked)
+{
+  unsigned long p = 0;
+  dl_thread *t;
+  pstat ps;
+  int i, cpu;
+
+  *progressed = *running = 0;
+  *blocked = 1;
+  for (i = 0; i < w->n; i++) {
+    t = &w->t[i];
+    if (pstat_read(w->fd[i], &ps) == -1) {
+      pthread_mutex_lock(&w->lock);
+      t->state = 'X';       /* exited: neither blocked nor progressing */
+      pthread_mutex_unlock(&w->lock);
+      *blocked = 0;
+      continue;
+    }
+    if (w->progress)
+      p = __atomic_load_n(&w->progress[i], __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&w->lock);
+    cpu = ps.utime != t->utime || ps.stime != t->stime;
+    t->state = ps.state;
+    t->utime = ps.utime;
+    t->stime = ps.stime;
+    if (w->progress) {
+      if (p != t->progress)
+        *progressed = 1;
+      t->progress = p;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (!w->progress && cpu) {
+      *progressed = 1;
+    }
+    if (cpu || t->state == 'R')
+      *running = 1;
+    if (t->state != 'S' && t->state != 'D')
+      *blocked = 0;
+  }
+}
+
+static void *watcher(void *arg)
+{
+  dl_watch *w = (dl_watch *) arg;
+  int interval = w->cfg.max_ms, progressed, running, blocked, any_running = 0;
+  double stalled = -1, blocked_since = -1, t;
+  dl_verdict v = DL_OK;
+  int i;
+
+  while (!__atomic_load_n(&w->stop, __ATOMIC_RELAXED)) {
+    sleep_ms(interval);
+    sample(w, &progressed, &running, &blocked);
+    t = now_ms();
+
+    if (progressed) {
+      /* all is well: back off */
+      stalled = blocked_since = -1;
+      interval = interval * 2 < w->cfg.max_ms ? interval * 2 : w->cfg.max_ms;
+      continue;
+    }
+
+    /* no progress: look closely until confirmed or disproved */
+    interval = w->cfg.min_ms;
+    if (stalled < 0) {
+      stalled = t;
+      any_running = 0;
+    }
+    any_running |= running;
+    if (!blocked)
+      blocked_since = -1;
+    else if (blocked_since < 0)
+      blocked_since = t;
+
+    if (blocked_since >= 0 && t - blocked_since >= w->cfg.confirm_ms) {
+      v = DL_DEADLOCK;
+      break;
+    }
+    if (t - stalled >= w->cfg.livelock_ms) {
+      if (any_running && w->progress) {
+        v = DL_LIVELOCK;
+        break;
+      }
+      stalled = -1;         /* merely idle; start over */
+    }
+  }
+
+  if (v != DL_OK) {
+    pthread_mutex_lock(&w->lock);
+    for (i = 0; i < w->n; i++)
+      read_wchan(&w->t[i]);
+    pthread_mutex_unlock(&w->lock);
+    if (w->cfg.report)
+      w->cfg.report(w, v, w->cfg.arg);
+  }
+
+  pthread_mutex_lock(&w->lock);
+  w->verdict = v;
+  pthread_cond_broadcast(&w->done);
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+dl_watch *dl_watch_start(const pid_t *tids, int n,
+                         const volatile unsigned long *progress,
+                         const dl_config *cfg)
+{
+  char path[64];
+  dl_watch *w;
+  pstat ps;
+  int i;
+
+  if ((w = (dl_watch *) calloc(1, sizeof(*w))) == NULL)
+    return NULL;
+  w->t = (dl_thread *) calloc(n, sizeof(dl_thread));
+  if ((w->fd = (int *) malloc(n * sizeof(int))) != NULL)
+    for (i = 0; i < n; i++)
+      w->fd[i] = -1;
+  if (w->t == NULL || w->fd == NULL)
+    goto fail;
+
+  w->n = n;
+  w->progress = progress;
+  if (cfg)
+    w->cfg = *cfg;
+  if (w->cfg.min_ms <= 0)
+    w->cfg.min_ms = 1;
+  if (w->cfg.max_ms <= 0)
+    w->cfg.max_ms = 100;
+  if (w->cfg.max_ms < w->cfg.min_ms)
+    w->cfg.max_ms = w->cfg.min_ms;
+  if (w->cfg.confirm_ms <= 0)
+    w->cfg.confirm_ms = 20;
+  if (w->cfg.livelock_ms <= 0)
+    w->cfg.livelock_ms = 10 * w->cfg.confirm_ms;
+
+  for (i = 0; i < n; i++) {
+    w->t[i].tid = tids[i];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int) tids[i]);
+    if ((w->fd[i] = open(path, O_RDONLY | O_CLOEXEC)) < 0 ||
+        pstat_read(w->fd[i], &ps) == -1)
+      goto fail;
+    w->t[i].state = ps.state;
+    w->t[i].utime = ps.utime;
+    w->t[i].stime = ps.stime;
+    if (progress)
+      w->t[i].progress = __atomic_load_n(&progress[i], __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->done, NULL);
+  if ((errno = pthread_create(&w->thread, NULL, watcher, w)) != 0) {
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->done);
+    goto fail;
+  }
+  return w;
+
+fail:
+  if (w->fd)
+    for (i = 0; i < n; i++)
+      if (w->fd[i] >= 0)
+        close(w->fd[i]);
+  free(w->fd);
+  free(w->t);
+  free(w);
+  return NULL;
+}
+
+dl_verdict dl_watch_wait(dl_watch *w, int timeout_ms)
+{
+  struct timespec until;
+  dl_verdict v;
+
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += timeout_ms / 1000;
+  until.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (until.tv_nsec >= 1000000000) {
+    until.tv_nsec -= 1000000000;
+    until.tv_sec++;
+  }
+
+  pthread_mutex_lock(&w->lock);
+  while (w->verdict == DL_OK) {
+    if (timeout_ms < 0)
+      pthread_cond_wait(&w->done, &w->lock);
+    else if (pthread_cond_timedwait(&w->done, &w->lock, &until) == ETIMEDOUT)
+      break;
+  }
+  v = w->verdict;
+  pthread_mutex_unlock(&w->lock);
+  return v;
+}
+
+int dl_watch_count(const dl_watch *w)
+{
+  return w->n;
+}
+
+void dl_watch_thread(const dl_watch *w, int i, dl_thread *t)
+{
+  pthread_mutex_t *lock = (pthread_mutex_t *) &w->lock;
+
+  pthread_mutex_lock(lock);
+  *t = w->t[i];
+  pthread_mutex_unlock(lock);
+}
+
+void dl_watch_stop(dl_watch *w)
+{
+  int i;
+
+  __atomic_store_n(&w->stop, 1, __ATOMIC_RELAXED);
+  pthread_join(w->thread, NULL);
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->done);
+  for (i = 0; i < w->n; i++)
+    close(w->fd[i]);
+  free(w->fd);
+  free(w->t);
+  free(w);
+}
@@ -0,0 +1,83 @@
+/*
+ * Progress-based deadlock and livelock detector.
+ *
+ * A background thread watches a set of threads of this process through
+ * /proc/self/task/<tid>/stat (state and CPU time, read with pstat.c)
+ * and, optionally, one progress counter per thread that the thread
+ * bumps whenever it gets real work done. It reports
+ *
+ *   DL_DEADLOCK  no counter moved, and every thread sat blocked (S or
+ *                D) at every sample, for confirm_ms;
+ *   DL_LIVELOCK  no counter moved for livelock_ms although threads kept
+ *                running or using CPU.
+ *
+ * Without counters, CPU time stands in for progress and only deadlock
+ * can be told apart. Sampling is adaptive: every max_ms while things
+ * move, dropping to every min_ms as soon as a sample shows no progress,
+ * so a deadlock is reported confirm_ms (plus one sample) after progress
+ * stops. Livelock gets a longer window, since a thread may well burn a
+ * while on a single unit of work.
+ */
+
+#ifndef DLWATCH_H_
+#define DLWATCH_H_
+
+#include <sys/types.h>
+
+#include "pstat.h"
+
+typedef enum dl_verdict {
+  DL_OK = 0,
+  DL_DEADLOCK,
+  DL_LIVELOCK
+} dl_verdict;
+
+typedef struct dl_thread {
+  pid_t          tid;
+  char           state;         /* at the last sample */
+  pstat_num      utime;         /* clock ticks at the last sample */
+  pstat_num      stime;
+  unsigned long  progress;      /* counter value at the last sample */
+  char           wchan[64];     /* where it sleeps, filled in on a verdict */
+} dl_thread;
+
+typedef struct dl_watch dl_watch;
+
+typedef void (*dl_report_fn)(const dl_watch *w, dl_verdict v, void *arg);
+
+typedef struct dl_config {
+  int          min_ms;          /* fastest sampling, 0 for 1 ms */
+  int          max_ms;          /* slowest sampling, 0 for 100 ms */
+  int          confirm_ms;      /* all blocked this long, 0 for 20 ms */
+  int          livelock_ms;     /* busy without progress, 0 for 10 * confirm */
+  dl_report_fn report;          /* called from the watcher thread, or NULL */
+  void        *arg;
+} dl_config;
+
+/*
+ * Start watching the n threads in tids. progress[i], if progress is
+ * not NULL, is thread i's counter. Returns NULL with errno set on
+ * failure.
+ */
+dl_watch *dl_watch_start(const pid_t *tids, int n,
+                         const volatile unsigned long *progress,
+                         const dl_config *cfg);
+
+/*
+ * Wait up to timeout_ms (forever if negative) for a verdict; DL_OK on
+ * timeout. Once a verdict is reached the watcher stops sampling.
+ */
+dl_verdict dl_watch_wait(dl_watch *w, int timeout_ms);
+
+/*
+ * Copy what the last sample saw of thread i to *t. The watcher may
+ * still be sampling (after a timeout, say), so this takes the same
+ * lock it updates the threads under; safe from a report callback too.
+ */
+void        dl_watch_thread(const dl_watch *w, int i, dl_thread *t);
+int         dl_watch_count (const dl_watch *w);
+const char *dl_verdict_name(dl_verdict v);
+
+void dl_watch_stop(dl_watch *w);
+
+#endif /* DLWATCH_H_ */
@@ -0,0 +1,186 @@
+/*
+ * Offline analyzer for the ring files procstat -r records.
+ *
+ * Walks the records oldest first and prints, for every process, one
+ * CSV line per sampling interval (or per -b seconds) with its CPU use,
+ * fault rates and resident set size over that interval:
+ *
+ *   time,pid,tid,comm,cpu_pct,minflt_per_s,majflt_per_s,rss_kb
+ *
+ * A process is told apart from a later one that reuses its pid by its
+ * start time. -p keeps only one pid, -t adds per-thread lines (tid is
+ * the pid on process lines). Nothing is parsed: the records are mapped
+ * and read in place, so days of recording take seconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "precord.h"
+
+#define USAGE "usage: precan [-p pid] [-b secs] [-t] <ringfile>"
+
+void err_quit (const char * mesg)
+{
+  printf ("%s\n", mesg);
+  exit(1);
+}
+
+void err_sys (const char * mesg)
+{
+  perror(mesg);
+  exit(errno);
+}
+
+/* The last line printed for one process or thread */
+typedef struct task_last {
+  int32_t pid;                  /* 0: slot free */
+  int32_t tid;
+  int64_t start_time;
+  int     thread;               /* PREC_THREAD: not the process total */
+  int64_t ts_ns;
+  int64_t cpu_ticks;
+  int64_t min_flt;
+  int64_t maj_flt;
+} task_last;
+
+static task_last *table;
+static size_t table_size, table_used;
+
+static size_t slot_of(int32_t pid, int32_t tid, int64_t start_time,
+                      int thread)
+{
+  uint64_t h = ((uint64_t) pid << 32 | (uint32_t) tid) ^ start_time ^ thread;
+
+  h *= 0x9e3779b97f4a7c15ULL;
+  return (h >> 32) & (table_size - 1);
+}
+
+/* The task's slot, or the free one where it would go */
+static task_last *probe(int32_t pid, int32_t tid, int64_t start_time,
+                         int thread)
+{
+  size_t i;
+
+  for (i = slot_of(pid, tid, start_time, thread); table[i].pid;
+       i = (i + 1) & (table_size - 1))
+    if (table[i].pid == pid && table[i].tid == tid &&
+        table[i].start_time == start_time && table[i].thread == thread)
+      break;
+  return &table[i];
+}
+
+/*
+ * The entry for a task, inserted (with pid 0 still, for the caller to
+ * fill) if it isn't there yet. Open addressing, kept at most half full.
+ * thread is part of the key: a process and its main thread share pid,
+ * tid and start_time.
+ */
+static task_last *lookup(int32_t pid, int32_t tid, int64_t start_time,
+                          int thread)
+{
+  task_last *old, *t;
+  size_t i, old_size;
+
+  if (2 * (table_used + 1) > table_size) {
+    old = table;
+    old_size = table_size;
+    table_size = table_size ? 2 * table_size : 1024;
+    if ((table = (task_last *) calloc(table_size, sizeof(task_last))) == NULL)
+      err_sys("calloc");
+    for (i = 0; i < old_size; i++)
+      if (old[i].pid)
+        *probe(old[i].pid, old[i].tid, old[i].start_time,
+               old[i].thread) = old[i];
+    free(old);
+  }
+
+  t = probe(pid, tid, start_time, thread);
+  if (t->pid == 0)
+    table_used++;
+  return t;
+}
+
+int main (int argc, char *argv[])
+{
+  prec_record rec;
+  task_last *t;
+  uint64_t first, last, i, lost = 0;
+  long pid = 0, lines = 0;
+  int threads = 0, opt;
+  double bucket = 0, dt, tps, kb_per_page;
+  int64_t cpu;
+  prec r;
+
+  while ((opt = getopt(argc, argv, "p:b:t")) != -1) {
+    switch (opt) {
+    case 'p':
+      pid = atol(optarg);
+      break;
+    case 'b':
+      bucket = atof(optarg);
+      break;
+    case 't':
+      threads = 1;
+      break;
+    default:
+      err_quit (USAGE);
+    }
+  }
+  if (argc - optind != 1)
+    err_quit (USAGE);
+
+  if (prec_open(&r, argv[optind]) == -1)
+    err_sys(argv[optind]);
+  tps = r.hdr->ticks_per_sec;
+  kb_per_page = r.hdr->page_size / 1024.0;
+  setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+
+  printf("time,pid,tid,comm,cpu_pct,minflt_per_s,majflt_per_s,rss_kb\n");
+  prec_span(&r, &first, &last);
+  for (i = first; i < last; i++) {
+    if (!prec_get(&r, i, &rec)) {
+      lost++;               /* overwritten by a recorder still running */
+      continue;
+    }
+    if ((pid && rec.pid != pid) || (!threads && (rec.flags & PREC_THREAD)))
+      continue;
+
+    cpu = rec.utime + rec.stime;
+    t = lookup(rec.pid, rec.tid, rec.start_time, rec.flags & PREC_THREAD);
+    if (t->pid == 0) {
+      /* first sight: nothing to take a rate over yet */
+      t->pid = rec.pid;
+      t->tid = rec.tid;
+      t->start_time = rec.start_time;
+      t->thread = rec.flags & PREC_THREAD;
+    } else {
+      dt = (rec.ts_ns - t->ts_ns) / 1e9;
+      if (dt <= 0 || dt < bucket)
+        continue;
+      printf("%.3f,%d,%d,%.16s,%.1f,%.1f,%.1f,%.0f\n", rec.ts_ns / 1e9,
+             rec.pid, rec.tid, rec.comm, (cpu - t->cpu_ticks) / tps / dt * 100,
+             (rec.min_flt - t->min_flt) / dt, (rec.maj_flt - t->maj_flt) / dt,
+             rec.rss * kb_per_page);
+      lines++;
+    }
+    t->ts_ns = rec.ts_ns;
+    t->cpu_ticks = cpu;
+    t->min_flt = rec.min_flt;
+    t->maj_flt = rec.maj_flt;
+  }
+  fflush(stdout);
+
+  fprintf(stderr, "%llu records, %zu tasks, %ld lines", (unsigned long long)
+          (last - first), table_used, lines);
+  if (lost)
+    fprintf(stderr, ", %llu overwritten while reading", (unsigned long long) lost);
+  fprintf(stderr, "\n");
+
+  prec_close(&r);
+  return 0;
+}
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "precord.h"
+
+static int prec_map(prec *r, int prot)
+{
+  r->hdr = (prec_header *) mmap(NULL, r->map_size, prot, MAP_SHARED, r->fd, 0);
+  if (r->hdr == MAP_FAILED)
+    return -1;
+  r->ring = (char *) r->hdr + PREC_HEADER_SIZE;
+  return 0;
+}
+
+static int prec_valid(const prec_header *h, size_t file_size)
+{
+  return memcmp(h->magic, PREC_MAGIC, 8) == 0 &&
+         h->version == PREC_VERSION && h->record_size == PREC_RECORD_SIZE &&
+         h->cap > 0 &&
+         file_size == PREC_HEADER_SIZE + h->cap * PREC_RECORD_SIZE;
+}
+
+int prec_create(prec *r, const char *path, uint64_t cap)
+{
+  struct timespec now;
+  struct stat st;
+  int saved;
+
+  memset(r, 0, sizeof(*r));
+  if (cap == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((r->fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+    return -1;
+  if (fstat(r->fd, &st) == -1)
+    goto fail;
+
+  r->writable = 1;
+  r->map_size = PREC_HEADER_SIZE + cap * PREC_RECORD_SIZE;
+  if (st.st_size == 0) {
+    /* new ring; the records stay holes until written */
+    if (ftruncate(r->fd, r->map_size) == -1 ||
+        prec_map(r, PROT_READ | PROT_WRITE) == -1)
+      goto fail;
+    clock_gettime(CLOCK_REALTIME, &now);
+    r->hdr->version = PREC_VERSION;
+    r->hdr->record_size = PREC_RECORD_SIZE;
+    r->hdr->cap = cap;
+    r->hdr->head = 0;
+    r->hdr->ticks_per_sec = sysconf(_SC_CLK_TCK);
+    r->hdr->page_size = sysconf(_SC_PAGESIZE);
+    r->hdr->created_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    /* the magic goes last, so a half-made header is never taken for one */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(r->hdr->magic, PREC_MAGIC, 8);
+    return 0;
+  }
+
+  if ((size_t) st.st_size != r->map_size ||
+      prec_map(r, PROT_READ | PROT_WRITE) == -1)
+    goto exists;
+  if (!prec_valid(r->hdr, st.st_size) || r->hdr->cap != cap) {
+    munmap(r->hdr, r->map_size);
+    goto exists;
+  }
+  return 0;
+
+exists:
+  errno = EEXIST;
+fail:
+  saved = errno;
+  close(r->fd);
+  errno = saved;
+  return -1;
+}
+
+int prec_open(prec *r, const char *path)
+{
+  struct stat st;
+  int saved;
+
+  memset(r, 0, sizeof(*r));
+  if ((r->fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  if (fstat(r->fd, &st) == -1)
+    goto fail;
+  if (st.st_size < PREC_HEADER_SIZE) {
+    errno = EINVAL;
+    goto fail;
+  }
+  r->map_size = st.st_size;
+  if (prec_map(r, PROT_READ) == -1)
+    goto fail;
+  if (!prec_valid(r->hdr, st.st_size)) {
+    munmap(r->hdr, r->map_size);
+    errno = EINVAL;
+    goto fail;
+  }
+  madvise(r->ring, r->map_size - PREC_HEADER_SIZE, MADV_SEQUENTIAL);
+  return 0;
+
+fail:
+  saved = errno;
+  close(r->fd);
+  errno = saved;
+  return -1;
+}
+
+void prec_append(prec *r, const pstat *ps, pid_t pid, int flags,
+                 int64_t ts_ns)
+{
+  uint64_t i = r->hdr->head;
+  prec_record *rec = (prec_record *)
+    (r->ring + (i % r->hdr->cap) * PREC_RECORD_SIZE);
+  size_t n;
+
+  /* mark the slot torn while it is rewritten */
+  __atomic_store_n(&rec->seq, ~(uint64_t) 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  rec->ts_ns = ts_ns;
+  rec->pid = pid;
+  rec->tid = ps->pid;
+  rec->flags = flags;
+  rec->state = ps->state;
+  rec->pad = 0;
+  n = strnlen(ps->comm, sizeof(rec->comm) - 1);
+  memcpy(rec->comm, ps->comm, n);
+  memset(rec->comm + n, 0, sizeof(rec->comm) - n);
+  rec->ppid = ps->ppid;
+  rec->pgid = ps->pgid;
+  rec->sid = ps->sid;
+  rec->tty_nr = ps->tty_nr;
+  rec->task_flags = ps->flags;
+  rec->min_flt = ps->min_flt;
+  rec->cmin_flt = ps->cmin_flt;
+  rec->maj_flt = ps->maj_flt;
+  rec->cmaj_flt = ps->cmaj_flt;
+  rec->utime = ps->utime;
+  rec->stime = ps->stime;
+  rec->cutime = ps->cutime;
+  rec->cstime = ps->cstime;
+  rec->priority = ps->priority;
+  rec->nice = ps->nice;
+  rec->num_threads = ps->num_threads;
+  rec->start_time = ps->start_time;
+  rec->vsize = ps->vsize;
+  rec->rss = ps->rss;
+  rec->rsslim = ps->rsslim;
+  rec->cpu = ps->cpu;
+  rec->rt_priority = ps->rt_priority;
+  rec->policy = ps->policy;
+  rec->delayacct_blkio_ticks = ps->delayacct_blkio_ticks;
+  rec->guest_time = ps->guest_time;
+
+  __atomic_store_n(&rec->seq, i, __ATOMIC_RELEASE);
+  __atomic_store_n(&r->hdr->head, i + 1, __ATOMIC_RELEASE);
+}
+
+void prec_span(const prec *r, uint64_t *first, uint64_t *last)
+{
+  *last = __atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE);
+  *first = *last > r->hdr->cap ? *last - r->hdr->cap : 0;
+}
+
+int prec_get(const prec *r, uint64_t i, prec_record *out)
+{
+  const prec_record *rec = (const prec_record *)
+    (r->ring + (i % r->hdr->cap) * PREC_RECORD_SIZE);
+
+  if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != i)
+    return 0;
+  memcpy(out, rec, sizeof(*out));
+
+  /*
+   * A writer may have lapped us mid-copy: the copy is whole only if
+   * seq still says i after it. Once it doesn't, record i is gone for
+   * good, so there is nothing to retry.
+   */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == i;
+}
+
+void prec_close(prec *r)
+{
+  if (r->writable)
+    msync(r->hdr, r->map_size, MS_ASYNC);
+  munmap(r->hdr, r->map_size);
+  close(r->fd);
+}
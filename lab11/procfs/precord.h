@@ -0,0 +1,124 @@
+/*
+ * Ring file of fixed-width binary /proc/<pid>/stat samples.
+ *
+ * The file is a one-page header followed by a ring of cap records of
+ * PREC_RECORD_SIZE bytes each, all of it mapped MAP_SHARED, so taking a
+ * sample is a handful of stores and no system call. Once the ring is
+ * full the oldest record is overwritten, which bounds the file at
+ * header + cap * 256 bytes however long the recording runs.
+ *
+ * head counts every record ever written; record i lives in slot
+ * i % cap and carries i in its seq field. A record is filled in first
+ * and head bumped after it (release), so a reader that loads head
+ * (acquire) and finds seq == i both before and after copying record i
+ * knows its copy is whole. Reopening an existing file with the same
+ * geometry appends to it.
+ */
+
+#ifndef PRECORD_H_
+#define PRECORD_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "pstat.h"
+
+#define PREC_MAGIC        "PSTATRNG"
+#define PREC_VERSION      1
+#define PREC_HEADER_SIZE  4096
+#define PREC_RECORD_SIZE  256
+
+#define PREC_THREAD       0x1   /* a task of pid, not the process total */
+
+typedef struct prec_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t cap;                 /* records in the ring */
+  uint64_t head;                /* records ever written */
+  int64_t  ticks_per_sec;       /* of utime, stime etc. */
+  int64_t  page_size;           /* of rss */
+  int64_t  created_ns;          /* CLOCK_REALTIME */
+} prec_header;
+
+/*
+ * One sample. Times are clock ticks and rss is in pages, as in stat;
+ * ts_ns is CLOCK_REALTIME. Everything but the identity is int64_t so a
+ * record reads the same on any machine.
+ */
+typedef struct prec_record {
+  uint64_t seq;
+  int64_t  ts_ns;
+  int32_t  pid;
+  int32_t  tid;
+  uint16_t flags;
+  char     state;
+  char     pad;
+  char     comm[16];            /* truncated, for labels only */
+  int64_t  ppid;
+  int64_t  pgid;
+  int64_t  sid;
+  int64_t  tty_nr;
+  int64_t  task_flags;
+  int64_t  min_flt;
+  int64_t  cmin_flt;
+  int64_t  maj_flt;
+  int64_t  cmaj_flt;
+  int64_t  utime;
+  int64_t  stime;
+  int64_t  cutime;
+  int64_t  cstime;
+  int64_t  priority;
+  int64_t  nice;
+  int64_t  num_threads;
+  int64_t  start_time;
+  int64_t  vsize;
+  int64_t  rss;
+  int64_t  rsslim;
+  int64_t  cpu;
+  int64_t  rt_priority;
+  int64_t  policy;
+  int64_t  delayacct_blkio_ticks;
+  int64_t  guest_time;
+} prec_record;
+
+_Static_assert(sizeof(prec_record) <= PREC_RECORD_SIZE, "prec_record grew");
+
+typedef struct prec {
+  int          fd;
+  int          writable;
+  prec_header *hdr;
+  char        *ring;
+  size_t       map_size;
+} prec;
+
+/*
+ * Open path for recording, creating it with room for cap records, or
+ * appending to it if it already has that geometry. Returns 0 or -1
+ * with errno set (EEXIST: a ring of some other size is in the way).
+ */
+int prec_create(prec *r, const char *path, uint64_t cap);
+
+/*
+ * Open an existing ring read-only. Returns 0 or -1 with errno set
+ * (EINVAL: not a ring file).
+ */
+int prec_open(prec *r, const char *path);
+
+/*
+ * Add a sample of ps, taken at ts_ns, as the next record.
+ */
+void prec_append(prec *r, const pstat *ps, pid_t pid, int flags,
+                 int64_t ts_ns);
+
+/*
+ * The records still in the ring are [*first, *last); prec_get(r, i, out)
+ * copies record i to out and returns 1, or 0 if it has been overwritten
+ * since (by a recorder still running).
+ */
+void prec_span(const prec *r, uint64_t *first, uint64_t *last);
+int  prec_get (const prec *r, uint64_t i, prec_record *out);
+
+void prec_close(prec *r);
+
+#endif /* PRECORD_H_ */
@@ -1,9 +1,12 @@
 /*
  * Displays linux /proc/pid/stat in human-readable format
  *
- * Build: gcc -o procstat procstat.c
+ * Build: gcc -o procstat procstat.c pstat.c precord.c
  * Usage: procstat pid
  *        cat /proc/pid/stat | procstat
+ *        procstat -a
+ *        procstat -r ringfile [-i ms] [-n records] [-d secs] [-t] [pid ...]
+ *        procstat -w secs [-t] [-n top] [-c count] [pid ...]
  *
  * Homepage: http://www.brokestream.com/procstat.html
  * Version : 2009-03-05
@@ -14,6 +17,23 @@
  *
  * 2009-03-05 tickspersec are taken from sysconf (Sabuj Pattanayek)
  *
+ * ALTERED VERSION, not the original from the homepage above:
+ *
+ * stat is read with one read() and parsed by pstat.c instead of one
+ * fscanf() per field, so a comm with spaces or parentheses in it no
+ * longer throws off every field after it
+ *
+ * -a lists every process in /proc, one compact line each, found with
+ * getdents64()
+ *
+ * -r records samples of every process (or of the pids given) into a
+ * binary ring file, see precord.h, for precan to turn into time series
+ *
+ * a pid's schedstat and io are shown after its stat
+ *
+ * -w reports run queue wait and I/O rates of every process every few
+ * seconds
+ *
  */
 
 
@@ -39,78 +59,35 @@
 
 */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
+#include <signal.h>
 #include <linux/limits.h>
 #include <sys/times.h>
+#include <sys/syscall.h>
 
+#include "pstat.h"
+#include "precord.h"
 
-typedef long long int num;
-
-num pid;
-char tcomm[PATH_MAX];
-char state;
-
-num ppid;
-num pgid;
-num sid;
-num tty_nr;
-num tty_pgrp;
-
-num flags;
-num min_flt;
-num cmin_flt;
-num maj_flt;
-num cmaj_flt;
-num utime;
-num stimev;
-
-num cutime;
-num cstime;
-num priority;
-num nicev;
-num num_threads;
-num it_real_value;
-
-unsigned long long start_time;
-
-num vsize;
-num rss;
-num rsslim;
-num start_code;
-num end_code;
-num start_stack;
-num esp;
-num eip;
-
-num pending;
-num blocked;
-num sigign;
-num sigcatch;
-num wchan;
-num zero1;
-num zero2;
-num exit_signal;
-num cpu;
-num rt_priority;
-num policy;
+typedef pstat_num num;
 
 long tickspersec;
 
-FILE *input;
-
-void readone(num *x) { fscanf(input, "%lld ", x); }
-void readunsigned(unsigned long long *x) { fscanf(input, "%llu ", x); }
-void readstr(char *x) {  fscanf(input, "%s ", x);}
-void readchar(char *x) {  fscanf(input, "%c ", x);}
-
 void printone(char *name, num x) {  printf("%20s: %lld\n", name, x);}
 void printonex(char *name, num x) {  printf("%20s: %016llx\n", name, x);}
 void printunsigned(char *name, unsigned long long x) {  printf("%20s: %llu\n", name, x);}
 void printchar(char *name, char x) {  printf("%20s: %c\n", name, x);}
 void printstr(char *name, char *x) {  printf("%20s: %s\n", name, x);}
+void printcomm(char *name, char *x) {  printf("%20s: (%s)\n", name, x);}
 void printtime(char *name, num x) {  printf("%20s: %f\n", name, (((double)x) / tickspersec));}
+void printns(char *name, num x) {  printf("%20s: %f\n", name, x / 1e9);}
 
 int gettimesinceboot() {
   FILE *procuptime;
@@ -132,107 +109,601 @@ void printtimediff(char *name, num x) {
   printf("%20s: %s (%lu.%lus)\n", name, buf, running / tickspersec, running % tickspersec);
 }
 
+/* What getdents64() fills its buffer with */
+struct linux_dirent64 {
+  uint64_t       d_ino;
+  int64_t        d_off;
+  unsigned short d_reclen;
+  unsigned char  d_type;
+  char           d_name[];
+};
+
+/*
+ * Call fn for every all-digits entry of the directory open on dirfd,
+ * read in big batches with getdents64(). fn may walk another directory
+ * this way (a process's tasks), so every call has a buffer of its own.
+ * Returns 0, or -1 if the directory could not be read.
+ */
+#define DENTS_SIZE (64 * 1024)
+
+int each_number(int dirfd, void (*fn)(int dirfd, const char *name, void *arg),
+                void *arg) {
+  struct linux_dirent64 *d;
+  char *dents;
+  long n, off;
+  size_t len;
+
+  if((dents = malloc(DENTS_SIZE)) == NULL)
+    return -1;
+  lseek(dirfd, 0, SEEK_SET);
+  while((n = syscall(SYS_getdents64, dirfd, dents, DENTS_SIZE)) > 0) {
+    for(off = 0; off < n; off += d->d_reclen) {
+      d = (struct linux_dirent64 *) (dents + off);
+      len = strspn(d->d_name, "0123456789");
+      if(len > 0 && d->d_name[len] == '\0')
+        fn(dirfd, d->d_name, arg);
+    }
+  }
+  free(dents);
+  return n < 0 ? -1 : 0;
+}
+
+/*
+ * Read <name>/stat relative to dirfd with one read(). Processes come
+ * and go while we look, so a missing one is simply skipped (-1).
+ */
+int read_stat(int dirfd, const char *name, pstat *ps) {
+  char path[48];
+  int fd, ret;
+
+  if(snprintf(path, sizeof(path), "%s/stat", name) >= (int) sizeof(path))
+    return -1;
+  if((fd = openat(dirfd, path, O_RDONLY)) < 0)
+    return -1;
+  ret = pstat_read(fd, ps);
+  close(fd);
+  return ret;
+}
+
+/*
+ * Read <name>/schedstat and <name>/io the same way. Either may be
+ * missing: no CONFIG_SCHED_INFO, or no ptrace access for io.
+ */
+int read_sched(int dirfd, const char *name, pstat_sched *sc) {
+  char path[48];
+  int fd, ret;
+
+  snprintf(path, sizeof(path), "%s/schedstat", name);
+  if((fd = openat(dirfd, path, O_RDONLY)) < 0)
+    return -1;
+  ret = pstat_read_sched(fd, sc);
+  close(fd);
+  return ret;
+}
+
+int read_io(int dirfd, const char *name, pstat_io *io) {
+  char path[48];
+  int fd, ret;
+
+  snprintf(path, sizeof(path), "%s/io", name);
+  if((fd = openat(dirfd, path, O_RDONLY)) < 0)
+    return -1;
+  ret = pstat_read_io(fd, io);
+  close(fd);
+  return ret;
+}
+
+void batch_one(int procfd, const char *name, void *arg) {
+  int *count = (int *) arg;
+  pstat ps;
+
+  if(read_stat(procfd, name, &ps) == 0) {
+    printf("%7lld %7lld %c %10lld %10lld %4lld %14lld %9lld %3lld %s\n",
+           ps.pid, ps.ppid, ps.state, ps.utime, ps.stime, ps.num_threads,
+           ps.vsize, ps.rss, ps.cpu, ps.comm);
+    (*count)++;
+  }
+}
+
+/*
+ * One line for every process in /proc. Each stat file is read with a
+ * single read(), relative to a /proc fd so no path is looked up from
+ * the root again.
+ */
+int batch(void) {
+  int procfd, count = 0;
+
+  if((procfd = open("/proc", O_RDONLY | O_DIRECTORY)) < 0) {
+    perror("open /proc");
+    return 1;
+  }
+  setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+
+  printf("%7s %7s S %10s %10s %4s %14s %9s %3s COMM\n",
+         "PID", "PPID", "UTIME", "STIME", "THR", "VSIZE", "RSS", "CPU");
+  if(each_number(procfd, batch_one, &count) < 0) {
+    perror("getdents64");
+    return 1;
+  }
+  close(procfd);
+  fflush(stdout);
+  fprintf(stderr, "%d processes\n", count);
+  return 0;
+}
+
+/* State of a -r recording */
+typedef struct recorder {
+  prec    ring;
+  int     threads;              /* -t: a record per task as well */
+  int64_t ts_ns;                /* time of the current pass */
+  pid_t   pid;                  /* process whose tasks are being read */
+  long    records;
+} recorder;
+
+static volatile sig_atomic_t stop_recording;
+
+void on_signal(int sig) {
+  (void) sig;
+  stop_recording = 1;
+}
+
+void record_task(int taskfd, const char *name, void *arg) {
+  recorder *rc = (recorder *) arg;
+  pstat ps;
+
+  if(read_stat(taskfd, name, &ps) == 0) {
+    prec_append(&rc->ring, &ps, rc->pid, PREC_THREAD, rc->ts_ns);
+    rc->records++;
+  }
+}
+
+void record_one(int procfd, const char *name, void *arg) {
+  recorder *rc = (recorder *) arg;
+  char path[48];
+  pstat ps;
+  int taskfd;
+
+  if(read_stat(procfd, name, &ps) < 0)
+    return;
+  prec_append(&rc->ring, &ps, ps.pid, 0, rc->ts_ns);
+  rc->records++;
+
+  /* a single-threaded process's one task is the process itself */
+  if(rc->threads && ps.num_threads > 1) {
+    snprintf(path, sizeof(path), "%s/task", name);
+    if((taskfd = openat(procfd, path, O_RDONLY | O_DIRECTORY)) < 0)
+      return;
+    rc->pid = ps.pid;
+    each_number(taskfd, record_task, rc);
+    close(taskfd);
+  }
+}
+
+#define RECORD_USAGE "usage: procstat -r ringfile [-i ms] [-n records] " \
+                     "[-d secs] [-t] [pid ...]"
+
+/*
+ * Sample every process, or the pids given, every -i milliseconds (1000
+ * by default) into a ring of -n records (1M, 256MB, by default) until
+ * -d seconds have passed or SIGINT. The passes run on an absolute
+ * schedule, so a slow one doesn't push all the later ones back.
+ */
+int record(int argc, char *argv[]) {
+  struct timespec next, t0, t1;
+  struct sigaction sa;
+  const char *path = NULL;
+  long interval_ms = 1000, passes = 0;
+  unsigned long long cap = 1 << 20;
+  double duration = 0, secs;
+  recorder rc;
+  int procfd, opt, i;
+
+  memset(&rc, 0, sizeof(rc));
+  while((opt = getopt(argc, argv, "r:i:n:d:t")) != -1) {
+    switch(opt) {
+    case 'r': path = optarg; break;
+    case 'i': interval_ms = atol(optarg); break;
+    case 'n': cap = strtoull(optarg, NULL, 0); break;
+    case 'd': duration = atof(optarg); break;
+    case 't': rc.threads = 1; break;
+    default:
+      fprintf(stderr, "%s\n", RECORD_USAGE);
+      return 1;
+    }
+  }
+  if(path == NULL || interval_ms <= 0 || cap == 0) {
+    fprintf(stderr, "%s\n", RECORD_USAGE);
+    return 1;
+  }
+
+  if((procfd = open("/proc", O_RDONLY | O_DIRECTORY)) < 0) {
+    perror("open /proc");
+    return 1;
+  }
+  if(prec_create(&rc.ring, path, cap) < 0) {
+    perror(path);
+    return 1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  next = t0;
+  while(!stop_recording) {
+    clock_gettime(CLOCK_REALTIME, &t1);
+    rc.ts_ns = t1.tv_sec * 1000000000LL + t1.tv_nsec;
+    if(optind == argc)
+      each_number(procfd, record_one, &rc);
+    else
+      for(i = optind; i < argc; i++)
+        record_one(procfd, argv[i], &rc);
+    passes++;
+
+    next.tv_nsec += interval_ms % 1000 * 1000000;
+    next.tv_sec += interval_ms / 1000 + next.tv_nsec / 1000000000;
+    next.tv_nsec %= 1000000000;
+    if(duration > 0 &&
+       next.tv_sec - t0.tv_sec + (next.tv_nsec - t0.tv_nsec) / 1e9 > duration)
+      break;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  secs = t1.tv_sec - t0.tv_sec + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  fprintf(stderr, "%ld records in %ld passes over %.1f s; %s holds %llu of "
+          "%llu ever written\n", rc.records, passes, secs, path,
+          (unsigned long long) (rc.ring.hdr->head < cap ? rc.ring.hdr->head : cap),
+          (unsigned long long) rc.ring.hdr->head);
+  prec_close(&rc.ring);
+  close(procfd);
+  return 0;
+}
+
+/* One process or thread in a -w pass */
+typedef struct usage {
+  pid_t pid;
+  pid_t tid;
+  int   thread;                 /* a task's line, not the process total */
+  num   num_threads;
+  unsigned long long start_time;
+  char  comm[16];
+  num   cpu_ticks;
+  num   blkio_ticks;            /* delayacct_blkio_ticks */
+  num   wait_ns;                /* schedstat run queue wait, -1 if none */
+  num   read_bytes;             /* io, -1 if not allowed */
+  num   write_bytes;
+  /* rates over the last interval, filled in when printed, -1 if unknown */
+  double cpu, wait, blkio, rd, wr;
+} usage;
+
+typedef struct usage_list {
+  usage  *a;
+  size_t n, cap;
+  int    threads;
+  pid_t  pid;                   /* process whose tasks are being read */
+} usage_list;
+
+void usage_add(usage_list *l, int dirfd, const char *name, pid_t pid) {
+  pstat_sched sc;
+  pstat_io io;
+  pstat ps;
+  usage *a;
+
+  if(read_stat(dirfd, name, &ps) < 0)
+    return;
+  if(l->n == l->cap) {
+    l->cap = l->cap ? 2 * l->cap : 1024;
+    if((l->a = realloc(l->a, l->cap * sizeof(usage))) == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  a = &l->a[l->n++];
+  memset(a, 0, sizeof(*a));
+  a->pid = pid ? pid : ps.pid;
+  a->tid = ps.pid;
+  a->thread = pid != 0;
+  a->num_threads = ps.num_threads;
+  a->start_time = ps.start_time;
+  strncpy(a->comm, ps.comm, sizeof(a->comm) - 1);
+  a->cpu_ticks = ps.utime + ps.stime;
+  a->blkio_ticks = ps.delayacct_blkio_ticks;
+  a->wait_ns = read_sched(dirfd, name, &sc) == 0 ? sc.wait_ns : -1;
+  if(read_io(dirfd, name, &io) == 0) {
+    a->read_bytes = io.read_bytes;
+    a->write_bytes = io.write_bytes;
+  } else {
+    a->read_bytes = a->write_bytes = -1;
+  }
+}
+
+void usage_task(int taskfd, const char *name, void *arg) {
+  usage_list *l = (usage_list *) arg;
+
+  usage_add(l, taskfd, name, l->pid);
+}
+
+void usage_one(int procfd, const char *name, void *arg) {
+  usage_list *l = (usage_list *) arg;
+  size_t n = l->n;
+  char path[48];
+  int taskfd;
+
+  usage_add(l, procfd, name, 0);
+  /* a single-threaded process's one task is the process itself */
+  if(l->n == n || !l->threads || l->a[n].num_threads < 2)
+    return;
+  snprintf(path, sizeof(path), "%s/task", name);
+  if((taskfd = openat(procfd, path, O_RDONLY | O_DIRECTORY)) < 0)
+    return;
+  l->pid = l->a[n].pid;
+  each_number(taskfd, usage_task, l);
+  close(taskfd);
+}
+
+/* process lines first, then their threads, by tid */
+int usage_by_id(const void *x, const void *y) {
+  const usage *a = x, *b = y;
+
+  if(a->pid != b->pid)
+    return a->pid < b->pid ? -1 : 1;
+  if(a->thread != b->thread)
+    return a->thread - b->thread;
+  return a->tid < b->tid ? -1 : a->tid > b->tid;
+}
+
+/* A counter's change per unit, or -1 if either end of it is unknown */
+double rate(num now, num then, double per) {
+  return now < 0 || then < 0 ? -1 : (now - then) / per;
+}
+
+/* most time waiting, on a run queue or on storage, first */
+int usage_by_wait(const void *x, const void *y) {
+  const usage *a = x, *b = y;
+  double wa = (a->wait > 0 ? a->wait : 0) + a->blkio;
+  double wb = (b->wait > 0 ? b->wait : 0) + b->blkio;
+
+  if(wa != wb)
+    return wa > wb ? -1 : 1;
+  return a->cpu > b->cpu ? -1 : a->cpu < b->cpu;
+}
+
+void print_rate(double x, int known) {
+  if(known)
+    printf(" %10.0f", x);
+  else
+    printf(" %10s", "-");
+}
+
+#define WATCH_USAGE "usage: procstat -w secs [-t] [-n top] [-c count] [pid ...]"
+
+/*
+ * Every -w seconds, per process (and with -t per thread): CPU use, and
+ * the milliseconds per second it spent runnable but waiting for a CPU
+ * (schedstat) or blocked on storage (delayacct_blkio_ticks, needs
+ * kernel.task_delayacct=1), and the bytes per second it read from and
+ * wrote to storage (io). High RUNQ with low CPU is a CPU-starved
+ * process; high BLKIO and I/O rates an I/O-bound one. The -n (20)
+ * tasks waiting most are shown, -c times (forever by default).
+ */
+int watch(int argc, char *argv[]) {
+  usage_list prev, cur, tmp;
+  struct timespec next, now;
+  double interval = 0, dt, last_ts = 0, ts;
+  long top = 20, count = 0, pass, shown;
+  const usage *p;
+  usage *a;
+  size_t i;
+  int procfd, opt, j;
+  char stamp[32];
+  time_t t;
+
+  memset(&prev, 0, sizeof(prev));
+  memset(&cur, 0, sizeof(cur));
+  while((opt = getopt(argc, argv, "w:tn:c:")) != -1) {
+    switch(opt) {
+    case 'w': interval = atof(optarg); break;
+    case 't': cur.threads = prev.threads = 1; break;
+    case 'n': top = atol(optarg); break;
+    case 'c': count = atol(optarg); break;
+    default:
+      fprintf(stderr, "%s\n", WATCH_USAGE);
+      return 1;
+    }
+  }
+  if(interval <= 0) {
+    fprintf(stderr, "%s\n", WATCH_USAGE);
+    return 1;
+  }
+  if((procfd = open("/proc", O_RDONLY | O_DIRECTORY)) < 0) {
+    perror("open /proc");
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for(pass = 0; count == 0 || pass <= count; pass++) {
+    cur.n = 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ts = now.tv_sec + now.tv_nsec / 1e9;
+    if(optind == argc)
+      each_number(procfd, usage_one, &cur);
+    else
+      for(j = optind; j < argc; j++)
+        usage_one(procfd, argv[j], &cur);
+    qsort(cur.a, cur.n, sizeof(usage), usage_by_id);
+
+    if(pass > 0) {
+      dt = ts - last_ts;
+      for(i = 0; i < cur.n; i++) {
+        a = &cur.a[i];
+        p = bsearch(a, prev.a, prev.n, sizeof(usage), usage_by_id);
+        if(p && p->start_time != a->start_time)
+          p = NULL;         /* pid reused */
+        a->cpu = p ? (a->cpu_ticks - p->cpu_ticks) * 100.0 / tickspersec / dt : 0;
+        a->blkio = p ? (a->blkio_ticks - p->blkio_ticks) * 1000.0 / tickspersec / dt : 0;
+        /* -1: unavailable at either end of the interval */
+        a->wait = rate(a->wait_ns, p ? p->wait_ns : a->wait_ns, 1e6 * dt);
+        a->rd = rate(a->read_bytes, p ? p->read_bytes : a->read_bytes, dt);
+        a->wr = rate(a->write_bytes, p ? p->write_bytes : a->write_bytes, dt);
+      }
+
+      /* rank a copy; cur stays sorted by id for the next pass */
+      tmp.n = cur.n;
+      tmp.a = malloc(cur.n * sizeof(usage));
+      if(tmp.a == NULL) {
+        perror("malloc");
+        return 1;
+      }
+      memcpy(tmp.a, cur.a, cur.n * sizeof(usage));
+      qsort(tmp.a, tmp.n, sizeof(usage), usage_by_wait);
+
+      t = time(NULL);
+      strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&t));
+      printf("%s  %zu tasks over %.2fs\n", stamp, cur.n, dt);
+      printf("%7s %7s %6s %10s %10s %10s %10s COMM\n",
+             "PID", "TID", "CPU%", "RUNQ_ms/s", "BLKIO_ms/s", "READ_B/s",
+             "WRITE_B/s");
+      for(i = 0, shown = 0; i < tmp.n && shown < top; i++, shown++) {
+        a = &tmp.a[i];
+        printf("%7d %7d %6.1f", (int) a->pid, (int) a->tid, a->cpu);
+        print_rate(a->wait, a->wait >= 0);
+        print_rate(a->blkio, 1);
+        print_rate(a->rd, a->rd >= 0);
+        print_rate(a->wr, a->wr >= 0);
+        printf(" %s%s\n", a->thread ? "  " : "", a->comm);
+      }
+      printf("\n");
+      fflush(stdout);
+      free(tmp.a);
+      if(count && pass == count)
+        break;
+    }
+    last_ts = ts;
+    tmp = prev;
+    prev = cur;
+    cur = tmp;
+
+    next.tv_sec += (time_t) interval;
+    next.tv_nsec += (long) ((interval - (time_t) interval) * 1e9);
+    if(next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  free(prev.a);
+  free(cur.a);
+  close(procfd);
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
+  char buf[PSTAT_BUF], path[PATH_MAX];
+  size_t len;
+  ssize_t n;
+  pstat ps;
+  int fd;
+
   tickspersec = sysconf(_SC_CLK_TCK);
-  input = NULL;
+
+  if(argc > 1 && strcmp(argv[1], "-a") == 0)
+    return batch();
+  if(argc > 1 && strncmp(argv[1], "-r", 2) == 0)
+    return record(argc, argv);
+  if(argc > 1 && strncmp(argv[1], "-w", 2) == 0)
+    return watch(argc, argv);
 
   if(argc > 1) {
-    chdir("/proc");
-    if(chdir(argv[1]) == 0) { input = fopen("stat", "r"); }
-    if(!input) {
+    snprintf(path, sizeof(path), "/proc/%s/stat", argv[1]);
+    if((fd = open(path, O_RDONLY)) < 0 || pstat_read(fd, &ps) < 0) {
       perror("open");
       return 1;
     }
+    close(fd);
   } else {
-    input = stdin;
-  }
-
-
-  readone(&pid);
-  readstr(tcomm);
-  readchar(&state);
-  readone(&ppid);
-  readone(&pgid);
-  readone(&sid);
-  readone(&tty_nr);
-  readone(&tty_pgrp);
-  readone(&flags);
-  readone(&min_flt);
-  readone(&cmin_flt);
-  readone(&maj_flt);
-  readone(&cmaj_flt);
-  readone(&utime);
-  readone(&stimev);
-  readone(&cutime);
-  readone(&cstime);
-  readone(&priority);
-  readone(&nicev);
-  readone(&num_threads);
-  readone(&it_real_value);
-  readunsigned(&start_time);
-  readone(&vsize);
-  readone(&rss);
-  readone(&rsslim);
-  readone(&start_code);
-  readone(&end_code);
-  readone(&start_stack);
-  readone(&esp);
-  readone(&eip);
-  readone(&pending);
-  readone(&blocked);
-  readone(&sigign);
-  readone(&sigcatch);
-  readone(&wchan);
-  readone(&zero1);
-  readone(&zero2);
-  readone(&exit_signal);
-  readone(&cpu);
-  readone(&rt_priority);
-  readone(&policy);
+    /* a pipe may hand the line over in pieces */
+    for(len = 0; len < sizeof(buf); len += n)
+      if((n = read(0, buf + len, sizeof(buf) - len)) <= 0)
+        break;
+    if(pstat_parse(buf, len, &ps) < 0) {
+      fprintf(stderr, "procstat: not a /proc/pid/stat line\n");
+      return 1;
+    }
+  }
 
   {
 
-    printone("pid", pid);
-    printstr("tcomm", tcomm);
-    printchar("state", state);
-    printone("ppid", ppid);
-    printone("pgid", pgid);
-    printone("sid", sid);
-    printone("tty_nr", tty_nr);
-    printone("tty_pgrp", tty_pgrp);
-    printone("flags", flags);
-    printone("min_flt", min_flt);
-    printone("cmin_flt", cmin_flt);
-    printone("maj_flt", maj_flt);
-    printone("cmaj_flt", cmaj_flt);
-    printtime("utime", utime);
-    printtime("stime", stimev);
-    printtime("cutime", cutime);
-    printtime("cstime", cstime);
-    printone("priority", priority);
-    printone("nice", nicev);
-    printone("num_threads", num_threads);
-    printtime("it_real_value", it_real_value);
-    printtimediff("start_time", start_time);
-    printone("vsize", vsize);
-    printone("rss", rss);
-    printone("rsslim", rsslim);
-    printone("start_code", start_code);
-    printone("end_code", end_code);
-    printone("start_stack", start_stack);
-    printone("esp", esp);
-    printone("eip", eip);
-    printonex("pending", pending);
-    printonex("blocked", blocked);
-    printonex("sigign", sigign);
-    printonex("sigcatch", sigcatch);
-    printone("wchan", wchan);
-    printone("zero1", zero1);
-    printone("zero2", zero2);
-    printonex("exit_signal", exit_signal);
-    printone("cpu", cpu);
-    printone("rt_priority", rt_priority);
-    printone("policy", policy);
+    printone("pid", ps.pid);
+    printcomm("tcomm", ps.comm);
+    printchar("state", ps.state);
+    printone("ppid", ps.ppid);
+    printone("pgid", ps.pgid);
+    printone("sid", ps.sid);
+    printone("tty_nr", ps.tty_nr);
+    printone("tty_pgrp", ps.tty_pgrp);
+    printone("flags", ps.flags);
+    printone("min_flt", ps.min_flt);
+    printone("cmin_flt", ps.cmin_flt);
+    printone("maj_flt", ps.maj_flt);
+    printone("cmaj_flt", ps.cmaj_flt);
+    printtime("utime", ps.utime);
+    printtime("stime", ps.stime);
+    printtime("cutime", ps.cutime);
+    printtime("cstime", ps.cstime);
+    printone("priority", ps.priority);
+    printone("nice", ps.nice);
+    printone("num_threads", ps.num_threads);
+    printtime("it_real_value", ps.it_real_value);
+    printtimediff("start_time", ps.start_time);
+    printone("vsize", ps.vsize);
+    printone("rss", ps.rss);
+    printone("rsslim", ps.rsslim);
+    printone("start_code", ps.start_code);
+    printone("end_code", ps.end_code);
+    printone("start_stack", ps.start_stack);
+    printone("esp", ps.esp);
+    printone("eip", ps.eip);
+    printonex("pending", ps.pending);
+    printonex("blocked", ps.blocked);
+    printonex("sigign", ps.sigign);
+    printonex("sigcatch", ps.sigcatch);
+    printone("wchan", ps.wchan);
+    printone("zero1", ps.zero1);
+    printone("zero2", ps.zero2);
+    printonex("exit_signal", ps.exit_signal);
+    printone("cpu", ps.cpu);
+    printone("rt_priority", ps.rt_priority);
+    printone("policy", ps.policy);
+    printtime("delayacct_blkio", ps.delayacct_blkio_ticks);
+    printtime("guest_time", ps.guest_time);
+    printtime("cguest_time", ps.cguest_time);
+  }
+
+  /* a pid's schedstat and io; a line on stdin has neither */
+  if(argc > 1) {
+    pstat_sched sc;
+    pstat_io io;
+    int procfd = open("/proc", O_RDONLY | O_DIRECTORY);
+
+    if(read_sched(procfd, argv[1], &sc) == 0) {
+      printns("sched_run", sc.run_ns);
+      printns("sched_wait", sc.wait_ns);
+      printone("sched_slices", sc.timeslices);
+    }
+    if(read_io(procfd, argv[1], &io) == 0) {
+      printone("rchar", io.rchar);
+      printone("wchar", io.wchar);
+      printone("syscr", io.syscr);
+      printone("syscw", io.syscw);
+      printone("read_bytes", io.read_bytes);
+      printone("write_bytes", io.write_bytes);
+      printone("cancelled_write", io.cancelled_write_bytes);
+    }
+    close(procfd);
   }
 
   return 0;
@@ -0,0 +1,214 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "pstat.h"
+
+/*
+ * One whitespace-terminated number starting at *p, saturating like
+ * strtoll (rsslim is often 2^64 - 1). Advances *p past the number and
+ * the blank after it; returns -1 if there is no number there.
+ */
+static int parse_num(const char **p, const char *end, pstat_num *out)
+{
+  const char *s = *p;
+  unsigned long long v = 0;
+  int neg = 0, sat = 0;
+
+  if (s < end && *s == '-') {
+    neg = 1;
+    s++;
+  }
+  if (s == end || *s < '0' || *s > '9')
+    return -1;
+  for (; s < end && *s >= '0' && *s <= '9'; s++) {
+    if (v > (ULLONG_MAX - 9) / 10)
+      sat = 1;
+    else
+      v = v * 10 + (*s - '0');
+  }
+  if (neg)
+    *out = (sat || v > (unsigned long long) LLONG_MAX + 1) ? LLONG_MIN :
+           -(long long) v;
+  else
+    *out = (sat || v > LLONG_MAX) ? LLONG_MAX : (long long) v;
+
+  while (s < end && (*s == ' ' || *s == '\n'))
+    s++;
+  *p = s;
+  return 0;
+}
+
+static int parse_unsigned(const char **p, const char *end, unsigned long long *out)
+{
+  const char *s = *p;
+  unsigned long long v = 0;
+
+  if (s == end || *s < '0' || *s > '9')
+    return -1;
+  for (; s < end && *s >= '0' && *s <= '9'; s++)
+    v = v * 10 + (*s - '0');
+  while (s < end && (*s == ' ' || *s == '\n'))
+    s++;
+  *p = s;
+  *out = v;
+  return 0;
+}
+
+int pstat_parse(const char *buf, size_t len, pstat *ps)
+{
+  const char *p = buf, *end = buf + len, *open, *close;
+  size_t n;
+  int i;
+
+  /* Fields after comm, in file order up to the last one required */
+  pstat_num *after[] = {
+    &ps->ppid, &ps->pgid, &ps->sid, &ps->tty_nr, &ps->tty_pgrp, &ps->flags,
+    &ps->min_flt, &ps->cmin_flt, &ps->maj_flt, &ps->cmaj_flt, &ps->utime,
+    &ps->stime, &ps->cutime, &ps->cstime, &ps->priority, &ps->nice,
+    &ps->num_threads, &ps->it_real_value
+  };
+  pstat_num *tail[] = {
+    &ps->vsize, &ps->rss, &ps->rsslim, &ps->start_code, &ps->end_code,
+    &ps->start_stack, &ps->esp, &ps->eip, &ps->pending, &ps->blocked,
+    &ps->sigign, &ps->sigcatch, &ps->wchan, &ps->zero1, &ps->zero2,
+    &ps->exit_signal, &ps->cpu, &ps->rt_priority, &ps->policy,
+    /* optional from here on */
+    &ps->delayacct_blkio_ticks, &ps->guest_time, &ps->cguest_time
+  };
+  const int tail_required = 19;
+
+  memset(ps, 0, sizeof(*ps));
+
+  if (parse_num(&p, end, &ps->pid) == -1)
+    goto bad;
+
+  /* comm may itself contain ") " -- only the last ')' ends it */
+  if ((open = memchr(p, '(', end - p)) == NULL)
+    goto bad;
+  for (close = end - 1; close > open && *close != ')'; close--)
+    ;
+  if (close == open)
+    goto bad;
+  n = close - open - 1;
+  if (n >= PSTAT_COMM_MAX)
+    n = PSTAT_COMM_MAX - 1;
+  memcpy(ps->comm, open + 1, n);
+  ps->comm[n] = '\0';
+
+  p = close + 1;
+  if (p + 3 > end || *p++ != ' ')
+    goto bad;
+  ps->state = *p++;
+  if (*p++ != ' ')
+    goto bad;
+
+  for (i = 0; i < (int) (sizeof(after) / sizeof(after[0])); i++)
+    if (parse_num(&p, end, after[i]) == -1)
+      goto bad;
+  if (parse_unsigned(&p, end, &ps->start_time) == -1)
+    goto bad;
+  for (i = 0; i < (int) (sizeof(tail) / sizeof(tail[0])); i++)
+    if (parse_num(&p, end, tail[i]) == -1) {
+      if (i < tail_required)
+        goto bad;
+      break;
+    }
+  return 0;
+
+bad:
+  errno = EINVAL;
+  return -1;
+}
+
+static ssize_t read_at_zero(int fd, char *buf, size_t size)
+{
+  ssize_t n;
+
+  do {
+    n = pread(fd, buf, size, 0);
+  } while (n < 0 && errno == EINTR);
+  return n;
+}
+
+int pstat_read(int fd, pstat *ps)
+{
+  char buf[PSTAT_BUF];
+  ssize_t n;
+
+  if ((n = read_at_zero(fd, buf, sizeof(buf))) < 0)
+    return -1;
+  return pstat_parse(buf, n, ps);
+}
+
+int pstat_parse_sched(const char *buf, size_t len, pstat_sched *s)
+{
+  const char *p = buf, *end = buf + len;
+
+  memset(s, 0, sizeof(*s));
+  if (parse_num(&p, end, &s->run_ns) == -1 ||
+      parse_num(&p, end, &s->wait_ns) == -1 ||
+      parse_num(&p, end, &s->timeslices) == -1) {
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+int pstat_read_sched(int fd, pstat_sched *s)
+{
+  char buf[128];
+  ssize_t n;
+
+  if ((n = read_at_zero(fd, buf, sizeof(buf))) < 0)
+    return -1;
+  return pstat_parse_sched(buf, n, s);
+}
+
+int pstat_parse_io(const char *buf, size_t len, pstat_io *io)
+{
+  static const char *names[] = {
+    "rchar", "wchar", "syscr", "syscw", "read_bytes", "write_bytes",
+    "cancelled_write_bytes"
+  };
+  pstat_num *fields[] = {
+    &io->rchar, &io->wchar, &io->syscr, &io->syscw, &io->read_bytes,
+    &io->write_bytes, &io->cancelled_write_bytes
+  };
+  const char *p = buf, *end = buf + len, *colon, *eol;
+  int i, found = 0;
+
+  memset(io, 0, sizeof(*io));
+  for (; p < end; p = eol + 1) {
+    if ((eol = memchr(p, '\n', end - p)) == NULL)
+      eol = end;
+    if ((colon = memchr(p, ':', eol - p)) == NULL)
+      continue;
+    for (i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+      if (strlen(names[i]) != (size_t) (colon - p) ||
+          memcmp(p, names[i], colon - p) != 0)
+        continue;
+      for (p = colon + 1; p < eol && *p == ' '; p++)
+        ;
+      if (parse_num(&p, eol, fields[i]) == 0)
+        found++;
+      break;
+    }
+  }
+  if (found == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+int pstat_read_io(int fd, pstat_io *io)
+{
+  char buf[512];
+  ssize_t n;
+
+  if ((n = read_at_zero(fd, buf, sizeof(buf))) < 0)
+    return -1;
+  return pstat_parse_io(buf, n, io);
+}
@@ -0,0 +1,117 @@
+/*
+ * Parser for /proc/<pid>/stat and /proc/<pid>/task/<tid>/stat, and for
+ * the schedstat and io files next to them.
+ *
+ * The whole file is taken in with a single read() and parsed in place;
+ * no stdio. The command name is whatever lies between the first '('
+ * and the last ')', so names with spaces or parentheses in them come
+ * out whole. Fields are named as in proc(5).
+ */
+
+#ifndef PSTAT_H_
+#define PSTAT_H_
+
+#include <sys/types.h>
+
+#define PSTAT_COMM_MAX 64       /* kernel threads can exceed TASK_COMM_LEN */
+#define PSTAT_BUF      1024     /* ample for a stat line */
+
+typedef long long int pstat_num;
+
+typedef struct pstat {
+  pstat_num pid;
+  char      comm[PSTAT_COMM_MAX];
+  char      state;
+  pstat_num ppid;
+  pstat_num pgid;
+  pstat_num sid;
+  pstat_num tty_nr;
+  pstat_num tty_pgrp;
+  pstat_num flags;
+  pstat_num min_flt;
+  pstat_num cmin_flt;
+  pstat_num maj_flt;
+  pstat_num cmaj_flt;
+  pstat_num utime;
+  pstat_num stime;
+  pstat_num cutime;
+  pstat_num cstime;
+  pstat_num priority;
+  pstat_num nice;
+  pstat_num num_threads;
+  pstat_num it_real_value;
+  unsigned long long start_time;
+  pstat_num vsize;
+  pstat_num rss;
+  pstat_num rsslim;
+  pstat_num start_code;
+  pstat_num end_code;
+  pstat_num start_stack;
+  pstat_num esp;
+  pstat_num eip;
+  pstat_num pending;
+  pstat_num blocked;
+  pstat_num sigign;
+  pstat_num sigcatch;
+  pstat_num wchan;
+  pstat_num zero1;
+  pstat_num zero2;
+  pstat_num exit_signal;
+  pstat_num cpu;
+  pstat_num rt_priority;
+  pstat_num policy;
+  pstat_num delayacct_blkio_ticks;  /* 0 on kernels too old to have it */
+  pstat_num guest_time;
+  pstat_num cguest_time;
+} pstat;
+
+/*
+ * Parse len bytes of stat text. Returns 0, or -1 with errno EINVAL if
+ * the text is cut short before the policy field or is not a stat line.
+ */
+int pstat_parse(const char *buf, size_t len, pstat *ps);
+
+/*
+ * Read and parse the stat file open on fd, from offset 0 with pread()
+ * so the same fd can be read again and again. Returns 0 or -1 with
+ * errno set (ESRCH once the task is gone).
+ */
+int pstat_read (int fd, pstat *ps);
+
+/*
+ * /proc/<pid>/schedstat: time on the CPU, time spent runnable but
+ * waiting on a run queue (both in nanoseconds), and timeslices run.
+ * Needs CONFIG_SCHED_INFO.
+ */
+typedef struct pstat_sched {
+  pstat_num run_ns;
+  pstat_num wait_ns;
+  pstat_num timeslices;
+} pstat_sched;
+
+/*
+ * /proc/<pid>/io. rchar/wchar count every byte passed to read() and
+ * write() and friends; read_bytes/write_bytes only what went to or
+ * came from storage. Reading another user's needs ptrace access.
+ */
+typedef struct pstat_io {
+  pstat_num rchar;
+  pstat_num wchar;
+  pstat_num syscr;
+  pstat_num syscw;
+  pstat_num read_bytes;
+  pstat_num write_bytes;
+  pstat_num cancelled_write_bytes;
+} pstat_io;
+
+int pstat_parse_sched(const char *buf, size_t len, pstat_sched *s);
+int pstat_read_sched (int fd, pstat_sched *s);
+
+/*
+ * Fields missing from the text (or unknown to us) are left 0; -1 with
+ * EINVAL only if none is found.
+ */
+int pstat_parse_io(const char *buf, size_t len, pstat_io *io);
+int pstat_read_io (int fd, pstat_io *io);
+
+#endif /* PSTAT_H_ */
@@ -0,0 +1,212 @@
+/*
+ * Continuous per-thread CPU sampler.
+ *
+ * Samples every thread of a process at -r Hz (100 by default) through
+ * tsampler.c and every -i seconds prints the -n busiest threads over
+ * that window with their user, system and total CPU%, plus what the
+ * sampler itself has cost so far. -L starts that many threads in this
+ * process instead (one in 500 of them busy, the rest asleep) and
+ * samples those, to measure the sampler's overhead at scale.
+ *
+ * Usage: tsample [-r hz] [-i secs] [-d secs] [-n top] [-k max_skip] pid
+ *        tsample [options] -L threads
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "tsampler.h"
+
+#define USAGE "usage: tsample [-r hz] [-i report_secs] [-d secs] [-n top] " \
+              "[-k max_skip] (pid | -L threads)"
+
+static volatile int stop;
+static long tickspersec;
+
+void err_quit (const char * mesg)
+{
+  printf ("%s\n", mesg);
+  exit(1);
+}
+
+void err_sys (const char * mesg)
+{
+  perror(mesg);
+  exit(errno);
+}
+
+/*
+ * Load threads for -L: a few spin in short bursts, the rest sleep.
+ */
+static void *load_thread(void *arg)
+{
+  long id = (long) arg;
+  struct timespec nap = { 0, 10 * 1000 * 1000 };
+  volatile unsigned long x = 0;
+  long i;
+
+  while (!stop) {
+    if (id % 500 == 0)
+      for (i = 0; i < 2000000; i++)
+        x++;
+    else
+      nap.tv_sec = 1;
+    nanosleep(&nap, NULL);
+  }
+  return NULL;
+}
+
+static double thread_cpu_secs(void)
+{
+  struct rusage ru;
+
+  getrusage(RUSAGE_THREAD, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+         ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int cmp_busy(const void *a, const void *b)
+{
+  const ts_thread *x = *(const ts_thread * const *) a;
+  const ts_thread *y = *(const ts_thread * const *) b;
+  pstat_num bx = x->w_utime + x->w_stime, by = y->w_utime + y->w_stime;
+
+  return (by > bx) - (by < bx);
+}
+
+static void report(tsampler *s, int top, double t, double overhead)
+{
+  double secs = tsampler_window_secs(s), scale;
+  ts_thread **order;
+  size_t i;
+
+  if ((order = (ts_thread **) malloc(s->n * sizeof(*order) + 1)) == NULL)
+    err_sys("malloc");
+  for (i = 0; i < s->n; i++)
+    order[i] = &s->t[i];
+  qsort(order, s->n, sizeof(*order), cmp_busy);
+
+  scale = secs > 0 ? 100.0 / (tickspersec * secs) : 0;
+  printf("t=%.2fs threads=%zu stat reads=%zu sampler cpu=%.2f%%\n",
+         t, s->n, s->reads, overhead);
+  printf("%8s S %7s %7s %7s COMM\n", "TID", "USR%", "SYS%", "CPU%");
+  for (i = 0; i < s->n && (int) i < top; i++)
+    printf("%8d %c %7.1f %7.1f %7.1f %s\n", (int) order[i]->tid, order[i]->state,
+           order[i]->w_utime * scale, order[i]->w_stime * scale,
+           (order[i]->w_utime + order[i]->w_stime) * scale, order[i]->comm);
+  printf("\n");
+  fflush(stdout);
+  free(order);
+}
+
+int main (int argc, char *argv[])
+{
+  double hz = 100, every = 1, duration = 5, t, cpu0;
+  int opt, top = 10, nload = 0;
+  unsigned max_skip = 256;
+  struct timespec start, next, now;
+  pthread_t *load = NULL;
+  long samples = 0, i;
+  double next_report, next_rescan;
+  tsampler s;
+  pid_t pid;
+
+  while ((opt = getopt(argc, argv, "r:i:d:n:k:L:")) != -1) {
+    switch (opt) {
+    case 'r':
+      hz = atof(optarg);
+      break;
+    case 'i':
+      every = atof(optarg);
+      break;
+    case 'd':
+      duration = atof(optarg);
+      break;
+    case 'n':
+      top = atoi(optarg);
+      break;
+    case 'k':
+      max_skip = atoi(optarg);
+      break;
+    case 'L':
+      nload = atoi(optarg);
+      break;
+    default:
+      err_quit (USAGE);
+    }
+  }
+  if (hz <= 0 || every <= 0 || (nload == 0) == (argc - optind != 1))
+    err_quit (USAGE);
+  tickspersec = sysconf(_SC_CLK_TCK);
+
+  if (nload) {
+    pid = getpid();
+    if ((load = (pthread_t *) calloc(nload, sizeof(pthread_t))) == NULL)
+      err_sys("calloc");
+    for (i = 0; i < nload; i++)
+      if ((errno = pthread_create(&load[i], NULL, load_thread, (void *) i)) != 0)
+        err_sys("pthread_create");
+  } else {
+    pid = atoi(argv[optind]);
+  }
+
+  if (tsampler_open(&s, pid, max_skip) == -1)
+    err_sys("can't sample that process");
+
+  /*
+   * Sample on an absolute schedule so the rate doesn't drift with the
+   * time each sample takes. New threads are picked up once a second.
+   */
+  cpu0 = thread_cpu_secs();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  next = start;
+  next_report = every;
+  next_rescan = 1;
+  for (;;) {
+    next.tv_nsec += (long) (1e9 / hz);
+    while (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+    tsampler_sample(&s);
+    samples++;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    t = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+    if (t >= next_rescan) {
+      tsampler_rescan(&s);
+      next_rescan += 1;
+    }
+    if (t >= next_report) {
+      report(&s, top, t, 100 * (thread_cpu_secs() - cpu0) / t);
+      tsampler_window(&s);
+      next_report += every;
+    }
+    if (s.n == 0 || (duration > 0 && t >= duration))
+      break;
+  }
+
+  printf("%ld samples in %.2f s (%.1f Hz), %.1f stat reads per sample, "
+         "sampler cpu %.2f%%\n", samples, t, samples / t,
+         (double) s.reads / samples, 100 * (thread_cpu_secs() - cpu0) / t);
+
+  tsampler_close(&s);
+  if (nload) {
+    stop = 1;
+    for (i = 0; i < nload; i++)
+      pthread_join(load[i], NULL);
+    free(load);
+  }
+  return 0;
+}
@@ -0,0 +1,270 @@
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "tsampler.h"
+
+/* What getdents64() fills its buffer with */
+struct linux_dirent64 {
+  uint64_t       d_ino;
+  int64_t        d_off;
+  unsigned short d_reclen;
+  unsigned char  d_type;
+  char           d_name[];
+};
+
+static double elapsed(const struct timespec *since)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static int cmp_tid(const void *a, const void *b)
+{
+  pid_t x = ((const ts_thread *) a)->tid, y = ((const ts_thread *) b)->tid;
+
+  return (x > y) - (x < y);
+}
+
+static ts_thread *find(tsampler *s, pid_t tid)
+{
+  ts_thread key;
+
+  key.tid = tid;
+  return (ts_thread *) bsearch(&key, s->t, s->n, sizeof(ts_thread), cmp_tid);
+}
+
+int tsampler_open(tsampler *s, pid_t pid, unsigned max_skip)
+{
+  char path[64];
+  struct rlimit rl;
+
+  memset(s, 0, sizeof(*s));
+  s->pid = pid;
+  s->max_skip = max_skip;
+  s->tick_ns = 1000000000 / sysconf(_SC_CLK_TCK);
+
+  /* two fds per thread: allow as many as we are allowed to */
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  snprintf(path, sizeof(path), "/proc/%d/task", (int) pid);
+  if ((s->taskfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+    return -1;
+  clock_gettime(CLOCK_MONOTONIC, &s->window);
+  return tsampler_rescan(s);
+}
+
+/*
+ * Open the stat and schedstat files of every thread not seen before.
+ * New threads are appended and the array re-sorted once at the end.
+ */
+int tsampler_rescan(tsampler *s)
+{
+  static char dents[32 * 1024];
+  struct linux_dirent64 *d;
+  size_t known = s->n, len, i, cap;
+  unsigned *due;
+  struct stat st;
+  char path[32];
+  ts_thread *t;
+  pstat_sched sc;
+  pstat ps;
+  long n, off;
+  pid_t tid;
+  int fd, sfd;
+
+  /*
+   * The common case: no thread came or went. The task directory's
+   * link count is cheap to get, where /proc/<pid>/stat walks every
+   * thread to sum their times.
+   */
+  if (known && !s->gone && fstat(s->taskfd, &st) == 0 &&
+      st.st_nlink == known + 2)
+    return 0;
+
+  if (lseek(s->taskfd, 0, SEEK_SET) == -1)
+    return -1;
+
+  while ((n = syscall(SYS_getdents64, s->taskfd, dents, sizeof(dents))) > 0) {
+    for (off = 0; off < n; off += d->d_reclen) {
+      d = (struct linux_dirent64 *) (dents + off);
+      len = strspn(d->d_name, "0123456789");
+      if (len == 0 || d->d_name[len] != '\0' || len + 11 > sizeof(path))
+        continue;
+      tid = atoi(d->d_name);
+      if (known && find(s, tid) != NULL)
+        continue;
+
+      memcpy(path, d->d_name, len);
+      memcpy(path + len, "/stat", 6);
+      if ((fd = openat(s->taskfd, path, O_RDONLY | O_CLOEXEC)) < 0)
+        continue;           /* exited already, or out of fds */
+      if (pstat_read(fd, &ps) == -1) {
+        close(fd);
+        continue;
+      }
+      memcpy(path + len, "/schedstat", 11);
+      if ((sfd = openat(s->taskfd, path, O_RDONLY | O_CLOEXEC)) >= 0 &&
+          pstat_read_sched(sfd, &sc) == -1) {
+        close(sfd);
+        sfd = -1;
+      }
+
+      if (s->n == s->cap) {
+        cap = s->cap ? 2 * s->cap : 64;
+        if ((t = (ts_thread *) realloc(s->t, cap * sizeof(ts_thread))) != NULL)
+          s->t = t;
+        due = (unsigned *) realloc(s->due, cap * sizeof(unsigned));
+        if (due != NULL)
+          s->due = due;
+        if (t == NULL || due == NULL) {
+          close(fd);
+          if (sfd >= 0)
+            close(sfd);
+          return -1;
+        }
+        s->cap = cap;
+      }
+      t = &s->t[s->n++];
+      memset(t, 0, sizeof(*t));
+      t->tid = tid;
+      t->fd = fd;
+      t->sfd = sfd;
+      t->run_ns = sfd >= 0 ? sc.run_ns : 0;
+      t->state = ps.state;
+      memcpy(t->comm, ps.comm, sizeof(t->comm));
+      t->utime = ps.utime;
+      t->stime = ps.stime;
+      t->interval = 1;
+      t->due = s->samples + 1;
+      s->reads++;
+    }
+  }
+  if (n < 0)
+    return -1;
+  s->gone = 0;
+
+  if (s->n > known) {
+    qsort(s->t, s->n, sizeof(ts_thread), cmp_tid);
+    for (i = 0; i < s->n; i++)
+      s->due[i] = s->t[i].due;
+  }
+  return 0;
+}
+
+/*
+ * Take one sample: read every thread that is due, fold the deltas into
+ * the window counters and adjust its backoff. Threads that have exited
+ * (ESRCH, or an empty read) are closed and removed.
+ *
+ * schedstat is checked first: it costs a fraction of a stat read, and
+ * until a thread has run for a tick since stat was last read its tick
+ * counts can hardly have moved, so it is taken as idle unread.
+ */
+int tsampler_sample(tsampler *s)
+{
+  unsigned now = ++s->samples;
+  size_t i, live, gone = 0;
+  pstat_sched sc;
+  ts_thread *t;
+  pstat ps;
+  int sched, idle;
+
+  for (i = 0; i < s->n; i++) {
+    if (s->due[i] != now)
+      continue;
+    t = &s->t[i];
+
+    sched = t->sfd >= 0 && pstat_read_sched(t->sfd, &sc) == 0;
+    idle = sched && sc.run_ns - t->run_ns < s->tick_ns;
+    if (idle) {
+      t->d_utime = t->d_stime = 0;
+    } else {
+      s->reads++;
+      if (pstat_read(t->fd, &ps) == -1) {
+        close(t->fd);
+        if (t->sfd >= 0)
+          close(t->sfd);
+        t->fd = -1;         /* gone: dropped below */
+        gone++;
+        continue;
+      }
+      if (sched)
+        t->run_ns = sc.run_ns;
+      t->d_utime = ps.utime - t->utime;
+      t->d_stime = ps.stime - t->stime;
+      t->utime = ps.utime;
+      t->stime = ps.stime;
+      t->state = ps.state;
+      t->w_utime += t->d_utime;
+      t->w_stime += t->d_stime;
+    }
+
+    if (!idle && (t->d_utime || t->d_stime || t->state == 'R'))
+      t->interval = 1;
+    else if (t->interval <= s->max_skip)
+      t->interval = t->interval * 2 > s->max_skip + 1 ? s->max_skip + 1 :
+                    t->interval * 2;
+    s->due[i] = t->due = now + t->interval;
+  }
+
+  if (gone) {
+    s->gone = 1;
+    for (i = live = 0; i < s->n; i++) {
+      if (s->t[i].fd < 0)
+        continue;
+      if (live != i) {
+        s->t[live] = s->t[i];
+        s->due[live] = s->due[i];
+      }
+      live++;
+    }
+    s->n = live;
+  }
+  return 0;
+}
+
+void tsampler_window(tsampler *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->n; i++)
+    s->t[i].w_utime = s->t[i].w_stime = 0;
+  clock_gettime(CLOCK_MONOTONIC, &s->window);
+}
+
+double tsampler_window_secs(const tsampler *s)
+{
+  return elapsed(&s->window);
+}
+
+void tsampler_close(tsampler *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->n; i++) {
+    close(s->t[i].fd);
+    if (s->t[i].sfd >= 0)
+      close(s->t[i].sfd);
+  }
+  close(s->taskfd);
+  free(s->t);
+  free(s->due);
+  memset(s, 0, sizeof(*s));
+  s->taskfd = -1;
+}
@@ -0,0 +1,71 @@
+/*
+ * Continuous per-thread CPU sampler for one process.
+ *
+ * Every thread's /proc/<pid>/task/<tid>/stat is opened once and kept
+ * open; a sample is one pread() from offset 0 per thread, parsed by
+ * pstat.c. Its schedstat is kept open too and read first, so a thread
+ * that hasn't run for a clock tick since its last stat read costs a
+ * much cheaper read of three numbers instead.
+ *
+ * The task directory is rescanned for new threads only when asked
+ * (tsampler_rescan), and threads that have exited drop out on the next
+ * sample. A rescan is skipped while the link count of /proc/<pid>/task
+ * (threads + 2) matches the threads already known and none of them has
+ * gone since the last rescan: a thread that exits while another starts
+ * leaves the count alone, so a failed read forces the next one.
+ *
+ * Threads that used no CPU since their last sample are sampled less
+ * and less often, down to once every max_skip + 1 samples; any CPU use
+ * puts them back to every sample. With thousands of mostly idle
+ * threads this is what keeps the sampler itself cheap, and why a
+ * sample walks only the small due[] array rather than every thread.
+ */
+
+#ifndef TSAMPLER_H_
+#define TSAMPLER_H_
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "pstat.h"
+
+typedef struct ts_thread {
+  pid_t     tid;
+  int       fd;             /* open stat file, -1 once the thread is gone */
+  int       sfd;            /* open schedstat file, -1 if there is none */
+  pstat_num run_ns;         /* schedstat run time at the last stat read */
+  char      state;
+  char      comm[PSTAT_COMM_MAX];
+  pstat_num utime;          /* clock ticks at the last read */
+  pstat_num stime;
+  pstat_num d_utime;        /* ticks found by the last sample */
+  pstat_num d_stime;
+  pstat_num w_utime;        /* ticks since tsampler_window() */
+  pstat_num w_stime;
+  unsigned  interval;       /* read every interval samples */
+  unsigned  due;            /* sample number of the next read */
+} ts_thread;
+
+typedef struct tsampler {
+  pid_t      pid;
+  int        taskfd;        /* /proc/<pid>/task */
+  ts_thread *t;             /* sorted by tid */
+  unsigned  *due;           /* t[i].due, packed for the per-sample walk */
+  size_t     n;
+  size_t     cap;
+  unsigned   samples;       /* taken so far */
+  int        gone;          /* a thread exited since the last rescan */
+  unsigned   max_skip;      /* idle backoff limit, 0 reads every thread */
+  long       tick_ns;       /* one clock tick of utime/stime */
+  size_t     reads;         /* stat reads done, for overhead accounting */
+  struct timespec window;   /* start of the current window */
+} tsampler;
+
+int    tsampler_open  (tsampler *s, pid_t pid, unsigned max_skip);
+int    tsampler_rescan(tsampler *s);
+int    tsampler_sample(tsampler *s);
+void   tsampler_window(tsampler *s);    /* zero the w_* counters */
+double tsampler_window_secs(const tsampler *s);
+void   tsampler_close (tsampler *s);
+
+#endif /* TSAMPLER_H_ */
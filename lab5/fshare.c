@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fshare.h"
+
+void fs_map_init(fs_map *m)
+{
+  memset(m, 0, sizeof(*m));
+}
+
+void fs_map_free(fs_map *m)
+{
+  free(m->c);
+  memset(m, 0, sizeof(*m));
+}
+
+void fs_claim(fs_map *m, int thread, const void *addr, size_t len,
+              const char *what)
+{
+  if (m->n == m->cap) {
+    m->cap = m->cap ? 2 * m->cap : 64;
+    if ((m->c = realloc(m->c, m->cap * sizeof(fs_claim_rec))) == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  m->c[m->n].start = (uintptr_t) addr;
+  m->c[m->n].len = len;
+  m->c[m->n].thread = thread;
+  m->c[m->n].what = what;
+  m->n++;
+}
+
+static int by_start(const void *x, const void *y)
+{
+  const fs_claim_rec *a = x, *b = y;
+
+  return a->start < b->start ? -1 : a->start > b->start;
+}
+
+int fs_report(fs_map *m, FILE *out)
+{
+  uintptr_t line, first, last;
+  int i, j, k, shared = 0, other;
+
+  qsort(m->c, m->n, sizeof(fs_claim_rec), by_start);
+
+  /*
+   * For each line any claim touches, see whether claims from two
+   * threads touch it. Claims are sorted, so they are a window.
+   */
+  for (i = 0; i < m->n; i++) {
+    first = m->c[i].start / FS_LINE;
+    last = (m->c[i].start + m->c[i].len - 1) / FS_LINE;
+    for (line = first; line <= last; line++) {
+      /* each line once: skip it if an earlier claim already covered it */
+      for (j = i - 1; j >= 0; j--)
+        if ((m->c[j].start + m->c[j].len - 1) / FS_LINE >= line)
+          break;
+      if (j >= 0)
+        continue;
+
+      other = 0;
+      for (k = i; k < m->n && m->c[k].start / FS_LINE <= line; k++)
+        if ((m->c[k].start + m->c[k].len - 1) / FS_LINE >= line &&
+            m->c[k].thread != m->c[i].thread)
+          other = 1;
+      if (!other)
+        continue;
+
+      shared++;
+      if (out == NULL)
+        continue;
+      fprintf(out, "  line %#lx:", (unsigned long) (line * FS_LINE));
+      for (k = i; k < m->n && m->c[k].start / FS_LINE <= line; k++)
+        if ((m->c[k].start + m->c[k].len - 1) / FS_LINE >= line)
+          fprintf(out, " %s(t%d,%+ld)", m->c[k].what, m->c[k].thread,
+                  (long) (m->c[k].start - line * FS_LINE));
+      fprintf(out, "\n");
+    }
+  }
+  return shared;
+}
+
+static int perf_open(unsigned int type, unsigned long long config)
+{
+  struct perf_event_attr a;
+
+  memset(&a, 0, sizeof(a));
+  a.size = sizeof(a);
+  a.type = type;
+  a.config = config;
+  a.disabled = 1;
+  /* all perf_event_paranoid=2 lets an unprivileged process count */
+  a.exclude_kernel = 1;
+  a.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+static long long thread_ns(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+void fs_perf_open(fs_perf *p)
+{
+  p->fd_miss = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  p->fd_clock = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  p->t0 = 0;
+}
+
+void fs_perf_start(fs_perf *p)
+{
+  if (p->fd_miss >= 0) {
+    ioctl(p->fd_miss, PERF_EVENT_IOC_RESET, 0);
+    ioctl(p->fd_miss, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  if (p->fd_clock >= 0) {
+    ioctl(p->fd_clock, PERF_EVENT_IOC_RESET, 0);
+    ioctl(p->fd_clock, PERF_EVENT_IOC_ENABLE, 0);
+  } else {
+    p->t0 = thread_ns();
+  }
+}
+
+static long long perf_value(int fd)
+{
+  long long v;
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd, &v, sizeof(v)) != sizeof(v))
+    return -1;
+  return v;
+}
+
+void fs_perf_stop(fs_perf *p, fs_sample *s)
+{
+  s->ns = p->fd_clock >= 0 ? perf_value(p->fd_clock) : thread_ns() - p->t0;
+  s->misses = p->fd_miss >= 0 ? perf_value(p->fd_miss) : -1;
+}
+
+void fs_perf_close(fs_perf *p)
+{
+  if (p->fd_miss >= 0)
+    close(p->fd_miss);
+  if (p->fd_clock >= 0)
+    close(p->fd_clock);
+}
+
+const char *fs_perf_source(const fs_perf *p)
+{
+  if (p->fd_miss >= 0)
+    return "perf";
+  return p->fd_clock >= 0 ? "perf-sw" : "timing";
+}
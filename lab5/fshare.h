@@ -0,0 +1,77 @@
+/*
+ * False-sharing instrumentation.
+ *
+ * Two parts, usable from any threaded program:
+ *
+ * A layout map. Each thread claims the bytes it writes with fs_claim();
+ * fs_report() then lists every cache line that more than one thread
+ * writes. That is exact, and free: it looks only at addresses.
+ *
+ * Per-thread counters. fs_perf_open() opens, for the calling thread,
+ * the hardware cache-miss counter with perf_event_open() where the
+ * CPU (or hypervisor) has one and perf_event_paranoid allows it, and
+ * the task clock, so the cost of the writes can be measured. Without
+ * a hardware counter misses read -1, and without perf at all the time
+ * comes from CLOCK_THREAD_CPUTIME_ID; a layout is then judged on time
+ * per write alone, against a padded copy of itself.
+ */
+
+#ifndef FSHARE_H_
+#define FSHARE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FS_LINE 64
+
+typedef struct fs_claim_rec {
+  uintptr_t   start;
+  size_t      len;
+  int         thread;
+  const char *what;
+} fs_claim_rec;
+
+typedef struct fs_map {
+  fs_claim_rec *c;
+  int           n, cap;
+} fs_map;
+
+void fs_map_init (fs_map *m);
+void fs_map_free (fs_map *m);
+
+/* thread writes the len bytes at addr; what names them in the report */
+void fs_claim    (fs_map *m, int thread, const void *addr, size_t len,
+                  const char *what);
+
+/*
+ * Print each cache line written by two or more threads, with what each
+ * writes there and its offset from the start of the line (negative if
+ * it begins in an earlier one), to out (NULL for none). Returns the
+ * number of lines.
+ */
+int  fs_report   (fs_map *m, FILE *out);
+
+typedef struct fs_perf {
+  int fd_miss;                  /* -1 if no hardware counter */
+  int fd_clock;                 /* -1: timing fallback */
+  long long t0;                 /* fallback start, ns */
+} fs_perf;
+
+typedef struct fs_sample {
+  long long misses;             /* -1 if not counted */
+  long long ns;                 /* CPU time of the thread */
+} fs_sample;
+
+void fs_perf_open (fs_perf *p);
+void fs_perf_start(fs_perf *p);
+void fs_perf_stop (fs_perf *p, fs_sample *s);
+void fs_perf_close(fs_perf *p);
+
+/*
+ * What the counters of this thread came from: "perf" (cache misses and
+ * task clock), "perf-sw" (task clock only) or "timing" (no perf)
+ */
+const char *fs_perf_source(const fs_perf *p);
+
+#endif /* FSHARE_H_ */
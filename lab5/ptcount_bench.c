@@ -0,0 +1,209 @@
+/*
+ * Contention benchmark for the ways ptcount_* can keep a shared count.
+ *
+ * Every variant has nthreads threads add INCREMENT to the count LOOP
+ * times each, for nthreads from 1 up to -t (the number of online CPUs
+ * by default), doubling, plus -t itself. Each run is one CSV line:
+ *
+ *   variant,threads,increments,seconds,incs_per_sec,ok
+ *
+ * where ok says the final count came out right. The variants:
+ *
+ *   mutex        count_mutex around every add, as ptcount_mutex
+ *   relaxed      __atomic_add_fetch(__ATOMIC_RELAXED), as ptcount_atomic
+ *   seq_cst      __atomic_add_fetch(__ATOMIC_SEQ_CST)
+ *   per_thread   ptcounter, a padded slot per thread
+ *   per_cpu      ptcounter, a padded slot per CPU
+ *   local        count in a local, one atomic add per thread at the end
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ptcounter.h"
+
+typedef enum variant {
+  V_MUTEX, V_RELAXED, V_SEQ_CST, V_PER_THREAD, V_PER_CPU, V_LOCAL, NUM_VARIANTS
+} variant;
+
+static const char *variant_names[NUM_VARIANTS] = {
+  "mutex", "relaxed", "seq_cst", "per_thread", "per_cpu", "local"
+};
+
+typedef struct thread_args {
+  int tid;
+  int inc;
+  long loop;
+} thread_args;
+
+/* the count, alone on its line so only the threads fight over it */
+static _Alignas(PTC_LINE) long long count;
+static pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ptcounter counter;
+static pthread_barrier_t start;
+static variant running;
+
+void *inc_count(void *arg)
+{
+  thread_args *my_args = (thread_args *) arg;
+  long long loc = 0;
+  long i;
+
+  pthread_barrier_wait(&start);
+  switch (running) {
+  case V_MUTEX:
+    for (i = 0; i < my_args->loop; i++) {
+      pthread_mutex_lock(&count_mutex);
+      count = count + my_args->inc;
+      pthread_mutex_unlock(&count_mutex);
+    }
+    break;
+  case V_RELAXED:
+    for (i = 0; i < my_args->loop; i++)
+      __atomic_add_fetch(&count, my_args->inc, __ATOMIC_RELAXED);
+    break;
+  case V_SEQ_CST:
+    for (i = 0; i < my_args->loop; i++)
+      __atomic_add_fetch(&count, my_args->inc, __ATOMIC_SEQ_CST);
+    break;
+  case V_PER_THREAD:
+  case V_PER_CPU:
+    for (i = 0; i < my_args->loop; i++)
+      ptcounter_add(&counter, my_args->tid, my_args->inc);
+    break;
+  case V_LOCAL:
+    /*
+     * The loop is opaque to the compiler only if loc is; without this
+     * it would just multiply
+     */
+    for (i = 0; i < my_args->loop; i++) {
+      loc = loc + my_args->inc;
+      __asm__ volatile ("" : "+r" (loc));
+    }
+    __atomic_add_fetch(&count, loc, __ATOMIC_RELAXED);
+    break;
+  default:
+    break;
+  }
+  return NULL;
+}
+
+static void run(variant v, int nthreads, long loop, int inc)
+{
+  pthread_t *threads;
+  thread_args *targs;
+  struct timespec t0, t1;
+  long long total, want;
+  double secs;
+  int i;
+
+  threads = malloc(nthreads * sizeof(pthread_t));
+  targs = malloc(nthreads * sizeof(thread_args));
+  if (threads == NULL || targs == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  running = v;
+  count = 0;
+  if (v == V_PER_THREAD || v == V_PER_CPU)
+    if (ptcounter_init(&counter, v == V_PER_THREAD ? PTC_PER_THREAD : PTC_PER_CPU,
+                       nthreads) == -1) {
+      perror("ptcounter_init");
+      exit(1);
+    }
+
+  /* the main thread starts the clock once everybody is created */
+  pthread_barrier_init(&start, NULL, nthreads + 1);
+  for (i = 0; i < nthreads; i++) {
+    targs[i].tid = i;
+    targs[i].loop = loop;
+    targs[i].inc = inc;
+    pthread_create(&threads[i], NULL, inc_count, &targs[i]);
+  }
+  pthread_barrier_wait(&start);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  pthread_barrier_destroy(&start);
+
+  if (v == V_PER_THREAD || v == V_PER_CPU) {
+    total = ptcounter_read(&counter);
+    ptcounter_destroy(&counter);
+  } else {
+    total = count;
+  }
+  want = (long long) nthreads * loop * inc;
+  secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  printf("%s,%d,%lld,%.6f,%.0f,%s\n", variant_names[v], nthreads,
+         (long long) nthreads * loop, secs,
+         secs > 0 ? nthreads * loop / secs : 0.0, total == want ? "yes" : "no");
+  fflush(stdout);
+
+  free(threads);
+  free(targs);
+}
+
+#define USAGE "Usage: ./ptcount_bench [-t max_threads] [-m variant,...] " \
+              "LOOP_BOUND INCREMENT"
+
+int main(int argc, char *argv[])
+{
+  int max_threads, nthreads, inc, opt, i, chosen[NUM_VARIANTS], any = 0;
+  long loop;
+  char *name;
+
+  max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  memset(chosen, 0, sizeof(chosen));
+  while ((opt = getopt(argc, argv, "t:m:")) != -1) {
+    switch (opt) {
+    case 't':
+      max_threads = atoi(optarg);
+      break;
+    case 'm':
+      for (name = strtok(optarg, ","); name; name = strtok(NULL, ",")) {
+        for (i = 0; i < NUM_VARIANTS; i++)
+          if (strcmp(name, variant_names[i]) == 0)
+            break;
+        if (i == NUM_VARIANTS) {
+          printf("%s\n", USAGE);
+          exit(1);
+        }
+        chosen[i] = any = 1;
+      }
+      break;
+    default:
+      printf("%s\n", USAGE);
+      exit(1);
+    }
+  }
+  if (argc - optind != 2 || max_threads < 1) {
+    printf("%s\n", USAGE);
+    exit(1);
+  }
+
+  /*
+   * First argument is how many times each thread loops. The second is
+   * how much to increment each time.
+   */
+  loop = atol(argv[optind]);
+  inc = atoi(argv[optind + 1]);
+
+  printf("variant,threads,increments,seconds,incs_per_sec,ok\n");
+  for (i = 0; i < NUM_VARIANTS; i++) {
+    if (any && !chosen[i])
+      continue;
+    for (nthreads = 1; nthreads < max_threads; nthreads *= 2)
+      run(i, nthreads, loop, inc);
+    run(i, max_threads, loop, inc);
+  }
+  return 0;
+}
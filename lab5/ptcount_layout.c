@@ -0,0 +1,288 @@
+/*
+ * False-sharing check of the per-thread fields in the thread labs.
+ *
+ * Each structure is laid out as the labs have it and padded to one
+ * cache line per thread, and for both layouts:
+ *
+ *   - fshare's layout map lists the cache lines more than one thread
+ *     writes (-v prints them);
+ *   - nthreads threads each write their own fields LOOP times, timed
+ *     and, where perf allows, cache misses counted per thread.
+ *
+ * One CSV line per layout:
+ *
+ *   structure,layout,threads,shared_lines,writes,ns_per_write,
+ *   misses_per_kwrite,source
+ *
+ * and a verdict per structure on stderr: the unpadded layout shares
+ * lines and is measurably slower than the padded one, or not. With
+ * fewer CPUs than threads the threads rarely run at the same time, so
+ * the lines don't bounce and only the map can tell.
+ *
+ * The structures:
+ *
+ *   lab5_counts   per-thread counts in a plain int array, the obvious
+ *                 next step from ptcount's one shared count; padded is
+ *                 ptcounter's slots
+ *   lab6_diners   lab6 dp_waiter's philosopher in the Diners array:
+ *                 prog and prog_total written by its own thread, and
+ *                 can_eat, whose sequence counter changes with every
+ *                 wait on it. can_eat is the dpl_cond_t of the lock
+ *                 lab6 is built with (LOCK=, as in lab6's Makefile):
+ *                 with pthread's 48-byte condvar a diner is 72 bytes
+ *                 and its counters share a line with the next one's
+ *                 condvar; with futex, ticket or mcs it is a 4-byte
+ *                 sequence number and a diner is 24 bytes, under half
+ *                 a line
+ *   dine_progress lab11 dine's per-philosopher unsigned long array
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dp_lock.h"
+#include "fshare.h"
+#include "ptcounter.h"
+
+/* lab6 dp_waiter's philosopher, field for field */
+typedef struct {
+  int            id;
+  dpl_cond_t     can_eat;
+  int            prog;
+  int            prog_total;
+  pthread_t      thread;
+} philosopher;
+
+typedef struct {
+  philosopher p;
+} __attribute__((aligned(FS_LINE))) padded_philosopher;
+
+typedef struct {
+  _Alignas(FS_LINE) unsigned long v;
+} padded_ulong;
+
+typedef struct layout {
+  const char *structure;
+  int         padded;
+  size_t      stride;           /* bytes from one thread's element to the next */
+  /* the fields thread i writes, in its element at elem */
+  void      (*claim)(fs_map *m, int i, void *elem);
+  void      (*write)(void *elem, long loop);
+} layout;
+
+static void claim_int(fs_map *m, int i, void *elem)
+{
+  fs_claim(m, i, elem, sizeof(int), "count");
+}
+
+static void write_int(void *elem, long loop)
+{
+  volatile int *c = elem;
+  long i;
+
+  for (i = 0; i < loop; i++)
+    *c = *c + 1;
+}
+
+static void claim_slot(fs_map *m, int i, void *elem)
+{
+  fs_claim(m, i, &((ptc_slot *) elem)->value, sizeof(long long), "slot");
+}
+
+static void write_slot(void *elem, long loop)
+{
+  volatile long long *c = &((ptc_slot *) elem)->value;
+  long i;
+
+  for (i = 0; i < loop; i++)
+    *c = *c + 1;
+}
+
+static void claim_phil(fs_map *m, int i, void *elem)
+{
+  philosopher *p = elem;
+
+  fs_claim(m, i, &p->can_eat, sizeof(dpl_cond_t), "can_eat");
+  fs_claim(m, i, &p->prog, sizeof(int), "prog");
+  fs_claim(m, i, &p->prog_total, sizeof(int), "prog_total");
+}
+
+static void write_phil(void *elem, long loop)
+{
+  volatile philosopher *p = elem;
+#ifdef DPL_PTHREAD
+  /* stands in for the condvar's wait sequence, the glibc layout's first word */
+  volatile unsigned long long *wseq = (volatile unsigned long long *) &p->can_eat;
+#else
+  /* the sequence number dpl_cond_signal() bumps */
+  volatile int *wseq = &p->can_eat.seq;
+#endif
+  long i;
+
+  for (i = 0; i < loop; i++) {
+    *wseq = *wseq + 1;
+    p->prog = p->prog + 1;
+    p->prog_total = p->prog_total + 1;
+  }
+}
+
+static void claim_ulong(fs_map *m, int i, void *elem)
+{
+  fs_claim(m, i, elem, sizeof(unsigned long), "progress");
+}
+
+static void write_ulong(void *elem, long loop)
+{
+  volatile unsigned long *c = elem;
+  long i;
+
+  for (i = 0; i < loop; i++)
+    *c = *c + 1;
+}
+
+static const layout layouts[] = {
+  { "lab5_counts",   0, sizeof(int),                claim_int,   write_int },
+  { "lab5_counts",   1, sizeof(ptc_slot),           claim_slot,  write_slot },
+  { "lab6_diners",   0, sizeof(philosopher),        claim_phil,  write_phil },
+  { "lab6_diners",   1, sizeof(padded_philosopher), claim_phil,  write_phil },
+  { "dine_progress", 0, sizeof(unsigned long),      claim_ulong, write_ulong },
+  { "dine_progress", 1, sizeof(padded_ulong),       claim_ulong, write_ulong },
+};
+
+#define NUM_LAYOUTS (int) (sizeof(layouts) / sizeof(layouts[0]))
+
+typedef struct thread_args {
+  const layout *l;
+  void         *elem;
+  long          loop;
+  fs_sample     s;
+  const char   *source;
+} thread_args;
+
+static pthread_barrier_t start;
+
+void *write_fields(void *arg)
+{
+  thread_args *my_args = (thread_args *) arg;
+  fs_perf p;
+
+  fs_perf_open(&p);
+  my_args->source = fs_perf_source(&p);
+  pthread_barrier_wait(&start);
+  fs_perf_start(&p);
+  my_args->l->write(my_args->elem, my_args->loop);
+  fs_perf_stop(&p, &my_args->s);
+  fs_perf_close(&p);
+  return NULL;
+}
+
+/*
+ * Run one layout; returns its nanoseconds per write.
+ */
+static double run(const layout *l, int nthreads, long loop, int verbose)
+{
+  pthread_t threads[nthreads];
+  thread_args targs[nthreads];
+  long long ns = 0, misses = 0;
+  int i, shared, writes_per_loop;
+  fs_map m;
+  char *base;
+  double ns_per_write;
+
+  if (posix_memalign((void **) &base, FS_LINE, nthreads * l->stride) != 0) {
+    perror("posix_memalign");
+    exit(1);
+  }
+  memset(base, 0, nthreads * l->stride);
+
+  fs_map_init(&m);
+  for (i = 0; i < nthreads; i++)
+    l->claim(&m, i, base + i * l->stride);
+  if (verbose)
+    fprintf(stderr, "%s %s:\n", l->structure, l->padded ? "padded" : "unpadded");
+  shared = fs_report(&m, verbose ? stderr : NULL);
+  fs_map_free(&m);
+
+  pthread_barrier_init(&start, NULL, nthreads);
+  for (i = 0; i < nthreads; i++) {
+    targs[i].l = l;
+    targs[i].elem = base + i * l->stride;
+    targs[i].loop = loop;
+    pthread_create(&threads[i], NULL, write_fields, &targs[i]);
+  }
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+    ns += targs[i].s.ns;
+    if (misses >= 0)
+      misses = targs[i].s.misses >= 0 ? misses + targs[i].s.misses : -1;
+  }
+  pthread_barrier_destroy(&start);
+  free(base);
+
+  writes_per_loop = l->write == write_phil ? 3 : 1;
+  ns_per_write = (double) ns / ((double) nthreads * loop * writes_per_loop);
+  printf("%s,%s,%d,%d,%lld,%.3f,", l->structure,
+         l->padded ? "padded" : "unpadded", nthreads, shared,
+         (long long) nthreads * loop * writes_per_loop, ns_per_write);
+  if (misses >= 0)
+    printf("%.3f", misses * 1000.0 / ((double) nthreads * loop * writes_per_loop));
+  printf(",%s\n", targs[0].source);
+  fflush(stdout);
+  return shared ? ns_per_write : -ns_per_write;
+}
+
+#define USAGE "Usage: ./ptcount_layout [-t threads] [-v] LOOP_BOUND"
+
+int main(int argc, char *argv[])
+{
+  int nthreads = 5, verbose = 0, opt, i, ncpu;
+  double unpadded, padded, slowdown;
+  long loop;
+
+  while ((opt = getopt(argc, argv, "t:v")) != -1) {
+    switch (opt) {
+    case 't':
+      nthreads = atoi(optarg);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      printf("%s\n", USAGE);
+      exit(1);
+    }
+  }
+  if (argc - optind != 1 || nthreads < 2) {
+    printf("%s\n", USAGE);
+    exit(1);
+  }
+  loop = atol(argv[optind]);
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+  printf("structure,layout,threads,shared_lines,writes,ns_per_write,"
+         "misses_per_kwrite,source\n");
+  for (i = 0; i + 1 < NUM_LAYOUTS; i += 2) {
+    /* negative: the layout shares no line */
+    unpadded = run(&layouts[i], nthreads, loop, verbose);
+    padded = run(&layouts[i + 1], nthreads, loop, verbose);
+    if (unpadded < 0) {
+      fprintf(stderr, "%s: no line written by two threads\n",
+              layouts[i].structure);
+      continue;
+    }
+    slowdown = unpadded / (padded < 0 ? -padded : padded);
+    if (slowdown > 1.5)
+      fprintf(stderr, "%s: FALSE SHARING, %.1fx slower than padded\n",
+              layouts[i].structure, slowdown);
+    else
+      fprintf(stderr, "%s: shares lines, %.1fx padded's time%s\n",
+              layouts[i].structure, slowdown,
+              ncpu < nthreads ? " (too few CPUs for them to bounce)" : "");
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ptcounter.h"
+
+int ptcounter_init(ptcounter *c, ptc_mode mode, int nthreads)
+{
+  c->mode = mode;
+  if (mode == PTC_PER_THREAD)
+    c->nslots = nthreads;
+  else
+    c->nslots = sysconf(_SC_NPROCESSORS_CONF);
+  if (c->nslots < 1)
+    c->nslots = 1;
+
+  /* aligned so no two slots, and nothing else, share a line */
+  if (posix_memalign((void **) &c->slot, PTC_LINE,
+                     c->nslots * sizeof(ptc_slot)) != 0)
+    return -1;
+  memset(c->slot, 0, c->nslots * sizeof(ptc_slot));
+  return 0;
+}
+
+long long ptcounter_read(const ptcounter *c)
+{
+  long long sum = 0;
+  int i;
+
+  for (i = 0; i < c->nslots; i++)
+    sum += __atomic_load_n(&c->slot[i].value, __ATOMIC_RELAXED);
+  return sum;
+}
+
+void ptcounter_destroy(ptcounter *c)
+{
+  free(c->slot);
+  c->slot = NULL;
+}
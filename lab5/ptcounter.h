@@ -0,0 +1,69 @@
+/*
+ * Scalable counter for many threads incrementing at once.
+ *
+ * A single shared count, even one updated with __atomic_add_fetch, is
+ * one cache line that every incrementing core has to own in turn, so
+ * adding threads makes each increment slower. Here the count is split
+ * into slots, each on a cache line of its own:
+ *
+ *   PTC_PER_THREAD  one slot per thread id; only its thread writes it,
+ *                   with a plain (relaxed) store, no locked instruction
+ *   PTC_PER_CPU     one slot per CPU, picked with sched_getcpu(); a
+ *                   relaxed atomic add, since two threads can share a
+ *                   CPU or migrate mid-increment, but the line mostly
+ *                   stays in that CPU's cache
+ *
+ * A read sums all the slots. It is exact once the writers are done, and
+ * while they run it is some value the count passed through recently.
+ */
+
+#ifndef PTCOUNTER_H_
+#define PTCOUNTER_H_
+
+#include <sched.h>         /* sched_getcpu(), needs _GNU_SOURCE */
+
+#define PTC_LINE 64
+
+typedef enum ptc_mode {
+  PTC_PER_THREAD,
+  PTC_PER_CPU
+} ptc_mode;
+
+typedef struct ptc_slot {
+  _Alignas(PTC_LINE) long long value;
+} ptc_slot;
+
+typedef struct ptcounter {
+  ptc_mode  mode;
+  int       nslots;
+  ptc_slot *slot;
+} ptcounter;
+
+/*
+ * nthreads is the number of thread ids (0 .. nthreads-1) that will add
+ * to a PTC_PER_THREAD counter; PTC_PER_CPU ignores it. Returns 0, or -1
+ * if out of memory.
+ */
+int  ptcounter_init   (ptcounter *c, ptc_mode mode, int nthreads);
+long long ptcounter_read(const ptcounter *c);
+void ptcounter_destroy(ptcounter *c);
+
+/*
+ * Add n on behalf of thread id.
+ */
+static inline void ptcounter_add(ptcounter *c, int id, long long n)
+{
+  ptc_slot *s;
+  int cpu;
+
+  if (c->mode == PTC_PER_THREAD) {
+    s = &c->slot[id];
+    __atomic_store_n(&s->value, s->value + n, __ATOMIC_RELAXED);
+  } else {
+    cpu = sched_getcpu();
+    s = &c->slot[cpu >= 0 ? cpu % c->nslots : 0];
+    __atomic_add_fetch(&s->value, n, __ATOMIC_RELAXED);
+  }
+}
+
+#endif /* PTCOUNTER_H_ */
@@ -4,23 +4,36 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include "dp_bench.h"
+
 /*
  * Some handy constants. Number of philosophers and chopsticks lets us
  * parameterize the number of concurrent threads and shared
  * resources. The maximum thinking and eating periods let us tune
  * relative periods of holding or not holding a resource. The MAX_BUF
  * and column_width constants help with creating output that makes
- * sense..
+ * sense.. The table size and periods can be set with -D, as
+ * dp_bench.sh does.
  */
+#ifndef NUM_PHILS
 #define NUM_PHILS                     5
+#endif
 #define NUM_CHOPS             NUM_PHILS
+#ifndef MAX_PHIL_THINK_PERIOD
 #define MAX_PHIL_THINK_PERIOD      1000
+#endif
+#ifndef MAX_PHIL_EAT_PERIOD
 #define MAX_PHIL_EAT_PERIOD         100
+#endif
 #define MAX_BUF                     256
 #define STATS_WIDTH                  16
 #define COLUMN_WIDTH                 18
+#ifndef ACCOUNTING_PERIOD
 #define ACCOUNTING_PERIOD             5
+#endif
+#ifndef ITERATION_LIMIT
 #define ITERATION_LIMIT              10
+#endif
 
 /*
  * Structure defining a philosopher and any state we need to know
@@ -42,12 +55,13 @@ typedef struct {
 /* GLOBALS */
 philosopher Diners[NUM_PHILS];
 int         Stop = 0;
+int         Left = 0;        /* philosophers that have left the table */
 
 /* Each chopstick is shared between two philosophers */
-static pthread_mutex_t chopstick[NUM_CHOPS];
+static dpl_mutex_t chopstick[NUM_CHOPS];
 
 /* WAITER SOLUTION uses these data structures */
-static pthread_mutex_t waiter;
+static dpl_mutex_t waiter;
 static int available_chopsticks[NUM_CHOPS];
 
 /*
@@ -70,12 +84,12 @@ philosopher *right_phil (philosopher *p)
   return &Diners[(p->id == 0 ? (NUM_PHILS-1) : (p->id)-1)];
 }
 
-pthread_mutex_t *left_chop (philosopher *p)
+dpl_mutex_t *left_chop (philosopher *p)
 {
   return &chopstick[p->id];
 }
 
-pthread_mutex_t *right_chop (philosopher *p)
+dpl_mutex_t *right_chop (philosopher *p)
 {
   return &chopstick[(p->id == 0 ? NUM_CHOPS-1 : (p->id)-1)];
 }
@@ -153,12 +167,12 @@ static void *dp_thread(void *arg)
      * Grab both chopsticks: ASYMMETRIC 
      */
     if((me->id) % 2 == 0){
-      pthread_mutex_lock( left_chop( me ) );
-      pthread_mutex_lock( right_chop( me ) );
+      dp_lock( left_chop( me ) );
+      dp_lock( right_chop( me ) );
     }
     else{
-      pthread_mutex_lock( right_chop( me ) );
-      pthread_mutex_lock( left_chop( me ) );
+      dp_lock( right_chop( me ) );
+      dp_lock( left_chop( me ) );
     }
 
     /*
@@ -175,12 +189,12 @@ static void *dp_thread(void *arg)
      */
        
     if((me->id) % 2 == 0) {
-          pthread_mutex_unlock(left_chop(me));
-          pthread_mutex_unlock(right_chop(me));
+          dp_unlock(left_chop(me));
+          dp_unlock(right_chop(me));
     }
     else {
-          pthread_mutex_unlock(right_chop(me));
-          pthread_mutex_unlock(left_chop(me));
+          dp_unlock(right_chop(me));
+          dp_unlock(left_chop(me));
     }
 
     /* 
@@ -188,11 +202,13 @@ static void *dp_thread(void *arg)
      */
     me->prog++;
     me->prog_total++;
+    dp_meal(me->id);
   }
 
   /*
    * Philosopher thread finished, so rejoin parent
    */
+  __atomic_fetch_add(&Left, 1, __ATOMIC_RELEASE);
   return NULL;
 }
 
@@ -208,14 +224,14 @@ void set_table()
    * Initialize mutex used in the WAITER SOLUTION to represent the
    * waiter
    */
-  pthread_mutex_init(&waiter, NULL);
+  dpl_mutex_init(&waiter);
 
   /*
    * Initialize all the Mutexes that represent the chopsticks. The
    * available flags are used in the WAITER SOLUTION.
    */
   for (i = 0; i < NUM_CHOPS; i++) {
-    pthread_mutex_init(&chopstick[i], NULL);
+    dpl_mutex_init(&chopstick[i]);
     available_chopsticks[i] = 1;
   }
 
@@ -317,10 +333,13 @@ int main(int argc, char **argv)
    * Set the table means create the chopsticks and the philosophers.
    * Print out a header for the periodic updates on Philosopher state.
    */
+  dp_bench_start(NUM_PHILS);
   set_table();
+#ifndef DP_BENCH
   printf("\n");
   printf("Dining Philosophers Update every %d seconds\n", ACCOUNTING_PERIOD);
   printf("-------------------------------------------\n");
+#endif
 
   do {
     /*
@@ -352,7 +371,9 @@ int main(int argc, char **argv)
     /*
      * Print out the philosophers progress
      */
+#ifndef DP_BENCH
     print_progress();
+#endif
     iter++;
   } while (!deadlock && iter < ITERATION_LIMIT);
 
@@ -360,24 +381,44 @@ int main(int argc, char **argv)
    * Set the "Stop flag to tell all diners to stop
    */
   Stop = 1;
-  if (deadlock) {
-    printf ("Deadlock Detected\n");
-  } else {
-    printf ("Finished without Deadlock\n");
-  }
+  dp_bench_stop();
 
   /*
    * Release all locks so philosophers can exit even if they are
-   * deadlocked.
+   * deadlocked. Only a pthread mutex can be released by a thread that
+   * doesn't hold it; with the other locks (dp_lock.h) a deadlocked
+   * table is left as it is, and returning from main() ends it.
    */
-  for (i = 0; i < NUM_CHOPS; i++)
-    pthread_mutex_unlock(&chopstick[i]);
+  if (DPL_FORCE_UNLOCK)
+    for (i = 0; i < NUM_CHOPS; i++)
+      dpl_unlock(&chopstick[i]);
 
   /*
-   * Wait for philosophers to finish
+   * Wait for philosophers to finish. The table can also deadlock after
+   * the last check saw a meal; if they haven't all left an accounting
+   * period after Stop, and can't be released, it has.
    */
-  for (i = 0; i < NUM_PHILS; i++)
-    pthread_join(Diners[i].thread, NULL);
+  if (!DPL_FORCE_UNLOCK) {
+    for (i = 0; i < ACCOUNTING_PERIOD * 100 &&
+                __atomic_load_n(&Left, __ATOMIC_ACQUIRE) < NUM_PHILS; i++)
+      usleep(10000);
+    if (__atomic_load_n(&Left, __ATOMIC_ACQUIRE) < NUM_PHILS)
+      deadlock = 1;
+  }
+  if (DPL_FORCE_UNLOCK || !deadlock)
+    for (i = 0; i < NUM_PHILS; i++)
+      pthread_join(Diners[i].thread, NULL);
+
+#ifndef DP_BENCH
+  if (deadlock) {
+    printf ("Deadlock Detected\n");
+  } else {
+    printf ("Finished without Deadlock\n");
+  }
+#endif
+
+  dp_bench_report("dp_asymmetric", MAX_PHIL_THINK_PERIOD, MAX_PHIL_EAT_PERIOD,
+                  deadlock);
 
   return 0;
 }
@@ -0,0 +1,257 @@
+/*
+ * Instrumentation for comparing the dining philosopher solutions.
+ *
+ * Each solution takes and drops its locks through dp_lock(),
+ * dp_unlock() and dp_cond_wait(), and calls dp_meal() after every
+ * meal. Normally these are just the calls of the lock dp_lock.h was
+ * built with (a pthread mutex unless told otherwise) and nothing. Built
+ * with -DDP_BENCH they also record, per thread, how long each lock
+ * took to get (wait) and was held (hold), and per philosopher when it
+ * last ate, for the longest stretch any philosopher went hungry; main()
+ * then prints one CSV line (see DP_BENCH_HEADER) instead of the
+ * periodic progress table. dp_bench.sh builds and runs every solution
+ * that way across table sizes, think/eat periods and CPU counts.
+ *
+ * The timing costs two clock reads per lock operation, tens of
+ * nanoseconds, which is not small next to a 100-mouthful meal: compare
+ * the solutions with each other, not with an uninstrumented build.
+ */
+
+#ifndef DP_BENCH_H_
+#define DP_BENCH_H_
+
+#include "dp_lock.h"
+
+#ifdef DP_BENCH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define DP_BENCH_HEADER "variant,lock,phils,think,eat,cpus,seconds,meals," \
+                        "meals_per_sec,jain,max_gap_ms,acquires," \
+                        "avg_wait_ns,max_wait_ns,avg_hold_ns,deadlock"
+
+#define DP_BENCH_HELD 4         /* locks one thread holds at once, at most */
+
+typedef struct {
+  long long   acquires;
+  long long   wait_ns;
+  long long   max_wait_ns;
+  long long   hold_ns;
+  const void *held[DP_BENCH_HELD];
+  long long   since[DP_BENCH_HELD];
+} __attribute__((aligned(64))) dp_bench_thread;
+
+typedef struct {
+  long long meals;
+  long long last_ns;
+  long long max_gap_ns;
+} __attribute__((aligned(64))) dp_bench_phil;
+
+static dp_bench_thread  *dp_bench_threads;
+static int               dp_bench_nthreads, dp_bench_used;
+static dp_bench_phil    *dp_bench_phils;
+static int               dp_bench_nphils;
+static long long         dp_bench_t0, dp_bench_t1;
+static int               dp_bench_stopped;
+static __thread dp_bench_thread *dp_bench_self;
+
+static inline long long dp_bench_now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* This thread's stats, handed out on its first lock operation */
+static inline dp_bench_thread *dp_bench_me(void)
+{
+  int i;
+
+  if (dp_bench_self == NULL) {
+    i = __atomic_fetch_add(&dp_bench_used, 1, __ATOMIC_RELAXED);
+    if (i >= dp_bench_nthreads) {
+      fprintf(stderr, "dp_bench: more threads than philosophers\n");
+      exit(1);
+    }
+    dp_bench_self = &dp_bench_threads[i];
+  }
+  return dp_bench_self;
+}
+
+static inline void dp_bench_hold(dp_bench_thread *me, const void *m, long long t)
+{
+  int i;
+
+  for (i = 0; i < DP_BENCH_HELD; i++)
+    if (me->held[i] == NULL) {
+      me->held[i] = m;
+      me->since[i] = t;
+      return;
+    }
+}
+
+static inline void dp_bench_release(dp_bench_thread *me, const void *m, long long t)
+{
+  int i;
+
+  for (i = 0; i < DP_BENCH_HELD; i++)
+    if (me->held[i] == m) {
+      me->hold_ns += t - me->since[i];
+      me->held[i] = NULL;
+      return;
+    }
+}
+
+static inline void dp_bench_waited(dp_bench_thread *me, long long t0, long long t1)
+{
+  me->acquires++;
+  me->wait_ns += t1 - t0;
+  if (t1 - t0 > me->max_wait_ns)
+    me->max_wait_ns = t1 - t0;
+}
+
+static inline void dp_lock(dpl_mutex_t *m)
+{
+  dp_bench_thread *me = dp_bench_me();
+  long long t0 = dp_bench_now(), t1;
+
+  dpl_lock(m);
+  t1 = dp_bench_now();
+  dp_bench_waited(me, t0, t1);
+  dp_bench_hold(me, m, t1);
+}
+
+static inline void dp_unlock(dpl_mutex_t *m)
+{
+  dp_bench_release(dp_bench_me(), m, dp_bench_now());
+  dpl_unlock(m);
+}
+
+/* The time asleep counts as waiting for m again, not as holding it */
+static inline void dp_cond_wait(dpl_cond_t *c, dpl_mutex_t *m)
+{
+  dp_bench_thread *me = dp_bench_me();
+  long long t0 = dp_bench_now(), t1;
+
+  dp_bench_release(me, m, t0);
+  dpl_cond_wait(c, m);
+  t1 = dp_bench_now();
+  dp_bench_waited(me, t0, t1);
+  dp_bench_hold(me, m, t1);
+}
+
+static inline void dp_meal(int id)
+{
+  dp_bench_phil *p = &dp_bench_phils[id];
+  long long t = dp_bench_now();
+
+  if (__atomic_load_n(&dp_bench_stopped, __ATOMIC_RELAXED))
+    return;
+  if (t - p->last_ns > p->max_gap_ns)
+    p->max_gap_ns = t - p->last_ns;
+  p->last_ns = t;
+  p->meals++;
+}
+
+/* Before the philosophers are created */
+static inline void dp_bench_start(int nphils)
+{
+  int i;
+
+  dp_bench_nphils = nphils;
+  dp_bench_nthreads = nphils;
+  dp_bench_phils = aligned_alloc(64, nphils * sizeof(dp_bench_phil));
+  dp_bench_threads = aligned_alloc(64, nphils * sizeof(dp_bench_thread));
+  if (dp_bench_phils == NULL || dp_bench_threads == NULL) {
+    perror("dp_bench");
+    exit(1);
+  }
+  memset(dp_bench_phils, 0, nphils * sizeof(dp_bench_phil));
+  memset(dp_bench_threads, 0, nphils * sizeof(dp_bench_thread));
+  dp_bench_t0 = dp_bench_now();
+  for (i = 0; i < nphils; i++)
+    dp_bench_phils[i].last_ns = dp_bench_t0;
+}
+
+/* When Stop is set: meals after this don't count */
+static inline void dp_bench_stop(void)
+{
+  dp_bench_t1 = dp_bench_now();
+  __atomic_store_n(&dp_bench_stopped, 1, __ATOMIC_RELAXED);
+}
+
+/* CPUs this process may run on, as taskset left them */
+static inline int dp_bench_cpus(void)
+{
+  unsigned long mask[64];
+  long n, i;
+  int cpus = 0;
+
+  n = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+  for (i = 0; i < n / (long) sizeof(long); i++)
+    cpus += __builtin_popcountl(mask[i]);
+  return cpus;
+}
+
+/*
+ * One CSV line. Jain's fairness index of the meal counts x is
+ * (sum x)^2 / (n * sum x^2): 1 when everybody ate the same, 1/n when
+ * one philosopher ate everything. The gap is the longest any
+ * philosopher went between meals, counting from the start and to the
+ * stop. Call it once the philosophers are joined.
+ */
+static inline void dp_bench_report(const char *variant, int think, int eat,
+                                   int deadlock)
+{
+  long long meals = 0, gap = 0, acquires = 0, wait = 0, max_wait = 0, hold = 0;
+  double sum2 = 0, secs, jain;
+  dp_bench_phil *p;
+  int i;
+
+  for (i = 0; i < dp_bench_nphils; i++) {
+    p = &dp_bench_phils[i];
+    meals += p->meals;
+    sum2 += (double) p->meals * p->meals;
+    if (p->max_gap_ns > gap)
+      gap = p->max_gap_ns;
+    if (dp_bench_t1 - p->last_ns > gap)
+      gap = dp_bench_t1 - p->last_ns;
+  }
+  for (i = 0; i < dp_bench_used && i < dp_bench_nthreads; i++) {
+    acquires += dp_bench_threads[i].acquires;
+    wait += dp_bench_threads[i].wait_ns;
+    hold += dp_bench_threads[i].hold_ns;
+    if (dp_bench_threads[i].max_wait_ns > max_wait)
+      max_wait = dp_bench_threads[i].max_wait_ns;
+  }
+  secs = (dp_bench_t1 - dp_bench_t0) / 1e9;
+  jain = sum2 > 0 ? (double) meals * meals / (dp_bench_nphils * sum2) : 0;
+
+  printf("%s,%s,%d,%d,%d,%d,%.3f,%lld,%.0f,%.4f,%.3f,%lld,%.0f,%lld,%.0f,%d\n",
+         variant, DPL_NAME, dp_bench_nphils, think, eat, dp_bench_cpus(), secs,
+         meals,
+         secs > 0 ? meals / secs : 0.0, jain, gap / 1e6, acquires,
+         acquires ? (double) wait / acquires : 0.0, max_wait,
+         acquires ? (double) hold / acquires : 0.0, deadlock);
+  fflush(stdout);
+}
+
+#else /* !DP_BENCH */
+
+#define dp_lock(m)            dpl_lock(m)
+#define dp_unlock(m)          dpl_unlock(m)
+#define dp_cond_wait(c, m)    dpl_cond_wait(c, m)
+#define dp_meal(id)           ((void) 0)
+#define dp_bench_start(n)     ((void) 0)
+#define dp_bench_stop()       ((void) 0)
+#define dp_bench_report(v, think, eat, deadlock) ((void) 0)
+
+#endif /* DP_BENCH */
+
+#endif /* DP_BENCH_H_ */
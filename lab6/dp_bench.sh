@@ -0,0 +1,104 @@
+#!/bin/sh
+#
+# Throughput and fairness of every dining philosophers solution.
+#
+# Each solution is built with -DDP_BENCH (see dp_bench.h) for every
+# lock (dp_lock.h), table size and think:eat period pair, and run for
+# SECS seconds on 1, 2, 4, ... of the CPUs (taskset), printing one CSV
+# line per run:
+#
+#   variant,lock,phils,think,eat,cpus,seconds,meals,meals_per_sec,jain,
+#   max_gap_ms,acquires,avg_wait_ns,max_wait_ns,avg_hold_ns,deadlock
+#
+# Usage: ./dp_bench.sh [-s secs] [-p "phils ..."] [-r "think:eat ..."]
+#                      [-c "cpus ..."] [-v "variant ..."] [-f "cflags"]
+#                      [-l "pthread futex ticket mcs"] [-k "segments ..."]
+#
+# -k runs dp_waiter with its table split among each number of waiters
+# (WAITER_SEGMENTS); the variant shows up as dp_waiter_k<segments>.
+#
+# dp deadlocks sooner or later; its runs end at the first second
+# without a meal, or with philosophers that never leave the table once
+# told to stop, with deadlock=1.
+
+SECS=3
+PHILS="5 50 500"
+RATIOS="1000:100 100:100 100:1000"
+VARIANTS="dp dp_asymmetric dp_waiter dp_chandy"
+LOCKS="pthread"
+SEGMENTS="1"
+NCPU=$(nproc)
+CPUS=""
+EXTRA=""
+
+while getopts s:p:r:c:v:f:l:k: opt; do
+  case $opt in
+    s) SECS=$OPTARG ;;
+    p) PHILS=$OPTARG ;;
+    r) RATIOS=$OPTARG ;;
+    c) CPUS=$OPTARG ;;
+    v) VARIANTS=$OPTARG ;;
+    f) EXTRA=$OPTARG ;;
+    l) LOCKS=$OPTARG ;;
+    k) SEGMENTS=$OPTARG ;;
+    *) echo 'usage: dp_bench.sh [-s secs] [-p "phils ..."] [-r "think:eat ..."] [-c "cpus ..."] [-v "variant ..."] [-f "cflags"] [-l "lock ..."] [-k "segments ..."]' >&2
+       exit 1 ;;
+  esac
+done
+
+if [ -z "$CPUS" ]; then
+  c=1
+  while [ $c -lt $NCPU ]; do
+    CPUS="$CPUS $c"
+    c=$((c * 2))
+  done
+  CPUS="$CPUS $NCPU"
+fi
+
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT INT TERM
+
+source_of() {
+  case $1 in
+    dp) echo dining_philosophers.c ;;
+    *)  echo $1.c ;;
+  esac
+}
+
+# waiters to split the table among, for the variants that have them
+segments_of() {
+  case $1 in
+    dp_waiter) echo $SEGMENTS ;;
+    *)         echo 1 ;;
+  esac
+}
+
+echo "variant,lock,phils,think,eat,cpus,seconds,meals,meals_per_sec,jain,max_gap_ms,acquires,avg_wait_ns,max_wait_ns,avg_hold_ns,deadlock"
+for v in $VARIANTS; do
+  for l in $LOCKS; do
+    lockflag=-DDPL_$(echo $l | tr a-z A-Z)
+    for n in $PHILS; do
+      for k in $(segments_of $v); do
+        [ $k -gt $n ] && continue
+        for r in $RATIOS; do
+          think=${r%:*}
+          eat=${r#*:}
+          bin=$BUILD/$v-$l-$n-$k-$think-$eat
+          if ! gcc -O2 -DDP_BENCH $lockflag -DNUM_PHILS=$n -DWAITER_SEGMENTS=$k \
+                 -DMAX_PHIL_THINK_PERIOD=$think -DMAX_PHIL_EAT_PERIOD=$eat \
+                 -DACCOUNTING_PERIOD=1 -DITERATION_LIMIT=$SECS $EXTRA -o $bin \
+                 $(source_of $v) -lpthread -lm; then
+            echo "dp_bench: can't build $v with $l" >&2
+            exit 1
+          fi
+          for c in $CPUS; do
+            [ $c -gt $NCPU ] && continue
+            # a deadlocked run that won't exit is cut off
+            timeout $((SECS * 2 + 60)) taskset -c 0-$((c - 1)) $bin ||
+              echo "dp_bench: $v lock=$l phils=$n segments=$k think=$think eat=$eat cpus=$c failed" >&2
+          done
+        done
+      done
+    done
+  done
+done
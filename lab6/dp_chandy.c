@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "dp_bench.h"
+
+/*
+ * Chandy/Misra dining philosophers, for any number of philosophers.
+ *
+ * There is no waiter and no global lock. Each fork (chopstick) has an
+ * owner, is clean or dirty, and carries its own mutex and condition
+ * variable, which only the two philosophers sharing it ever touch:
+ *
+ *   - forks start dirty, each held by the lower numbered of its two
+ *     philosophers, which makes the "who defers to whom" graph acyclic;
+ *   - a hungry philosopher asks for a fork it lacks by leaving its
+ *     request token on it (waiter) and sleeping on the fork's condvar;
+ *   - a fork is handed over, and cleaned, when asked for while dirty
+ *     and not being eaten with; a clean fork is kept until eaten with;
+ *   - after eating both forks are dirty, and any pending request is
+ *     granted right away.
+ *
+ * So a philosopher that just ate defers to its neighbors, no one
+ * starves, and the only contention is between neighbors. Think and eat
+ * periods come from a PRNG per philosopher rather than rand(), whose
+ * hidden lock would serialize everybody again.
+ *
+ * Usage: ./dp_chandy [NUM_PHILS]
+ *
+ * The default table size and the periods can also be set with -D, as
+ * dp_bench.sh does.
+ */
+#ifndef NUM_PHILS
+#define NUM_PHILS                     5
+#endif
+#ifndef MAX_PHIL_THINK_PERIOD
+#define MAX_PHIL_THINK_PERIOD      1000
+#endif
+#ifndef MAX_PHIL_EAT_PERIOD
+#define MAX_PHIL_EAT_PERIOD         100
+#endif
+#define MAX_BUF                     256
+#define STATS_WIDTH                  16
+#define COLUMN_WIDTH                 18
+#ifndef ACCOUNTING_PERIOD
+#define ACCOUNTING_PERIOD             5
+#endif
+#ifndef ITERATION_LIMIT
+#define ITERATION_LIMIT              10
+#endif
+#define MAX_TABLE_PRINT              20   /* beyond this, print a summary */
+#define CACHE_LINE                   64
+
+/*
+ * Structure defining a philosopher. Padded to a cache line, so one
+ * philosopher counting a meal doesn't slow down its neighbor.
+ */
+typedef struct {
+  int            id;           /* Int ID number assigned by
+                                  set_table() */
+  int            prog;         /* Progress during current main()
+                                  accounting period */
+  int            prog_total;   /* Total progress across all
+                                  sessions  */
+  uint64_t       rng;          /* This philosopher's PRNG state */
+  pthread_t      thread;       /* Thread structure for this
+                                  philosopher */
+} __attribute__((aligned(CACHE_LINE))) philosopher;
+
+/*
+ * A fork. Fork i lies between philosopher i (whose left fork it is)
+ * and philosopher i+1 (whose right fork it is).
+ */
+typedef struct {
+  dpl_mutex_t     lock;
+  dpl_cond_t      cond;        /* signaled when the fork changes hands */
+  int             owner;       /* philosopher holding it */
+  int             dirty;
+  int             in_use;      /* owner is eating with it */
+  int             waiter;      /* holder of the request token, or -1 */
+} __attribute__((aligned(CACHE_LINE))) fork_t;
+
+/* GLOBALS */
+int          Num_phils;
+philosopher *Diners;
+int          Stop = 0;
+
+/* Each fork is shared between two philosophers */
+static fork_t *forks;
+
+/*
+ * Helper functions for referencing forks, numbered as the other
+ * solutions number chopsticks:
+ *   - Left fork has same number as philosopher
+ *   - Right fork is (philosopher number - 1) modulo Num_phils
+ */
+fork_t *left_fork (philosopher *p)
+{
+  return &forks[p->id];
+}
+
+fork_t *right_fork (philosopher *p)
+{
+  return &forks[(p->id == 0 ? Num_phils-1 : (p->id)-1)];
+}
+
+/*
+ * xorshift64*: a few instructions, and no shared state
+ */
+static int phil_rand (philosopher *p)
+{
+  p->rng ^= p->rng >> 12;
+  p->rng ^= p->rng << 25;
+  p->rng ^= p->rng >> 27;
+  return (int) ((p->rng * 0x2545F4914F6CDD1DULL) >> 33);
+}
+
+/*
+ * Do a small amount of work that we can use to represent a
+ * philosopher thinking one thought
+ */
+void think_one_thought()
+{
+  int i;
+  i = 0;
+  i++;
+}
+
+/*
+ * Do a small amount of work that we can use to represent a
+ * philosopher eating one mouthful of food
+ */
+void eat_one_mouthful()
+{
+  int i;
+  i = 0;
+  i++;
+}
+
+/*
+ * Get fork f for philosopher me, who is hungry. Returns with me as its
+ * owner, though unless it is clean a neighbor may still ask for it
+ * (and get it) before me starts eating.
+ */
+static void get_fork (fork_t *f, int me)
+{
+  dp_lock(&f->lock);
+  for (;;) {
+    if (f->owner == me) {
+      if (!f->dirty || f->waiter < 0)
+        break;
+      /*
+       * Mine but dirty, and my neighbor asked first: its turn
+       */
+      f->owner = f->waiter;
+      f->dirty = 0;
+      f->waiter = -1;
+      dpl_cond_signal(&f->cond);
+    } else if (f->dirty && !f->in_use) {
+      /*
+       * The neighbor is done with it: take it, cleaning it as it
+       * changes hands
+       */
+      f->owner = me;
+      f->dirty = 0;
+      f->waiter = -1;
+      break;
+    } else {
+      f->waiter = me;
+      dp_cond_wait(&f->cond, &f->lock);
+    }
+  }
+  dp_unlock(&f->lock);
+}
+
+/*
+ * Claim both forks for eating if me still owns both, locking the lower
+ * numbered first so two neighbors never wait on each other here.
+ * Returns 1 on success.
+ */
+static int start_eating (fork_t *a, fork_t *b, int me)
+{
+  fork_t *first = a < b ? a : b, *second = a < b ? b : a;
+  int ok;
+
+  dp_lock(&first->lock);
+  dp_lock(&second->lock);
+  ok = first->owner == me && second->owner == me;
+  if (ok)
+    first->in_use = second->in_use = 1;
+  dp_unlock(&second->lock);
+  dp_unlock(&first->lock);
+  return ok;
+}
+
+/*
+ * Done eating with fork f: it is dirty now, and goes straight to a
+ * neighbor that asked for it meanwhile.
+ */
+static void put_fork (fork_t *f)
+{
+  dp_lock(&f->lock);
+  f->in_use = 0;
+  f->dirty = 1;
+  if (f->waiter >= 0) {
+    f->owner = f->waiter;
+    f->dirty = 0;
+    f->waiter = -1;
+    dpl_cond_signal(&f->cond);
+  }
+  dp_unlock(&f->lock);
+}
+
+/*
+ * Philosopher code which makes each philosopher eat and think for a
+ * random period of time.
+ */
+static void *dp_thread(void *arg)
+{
+  int          eat_rnd;
+  int          i;
+  philosopher *me;
+  int          think_rnd;
+
+  me = (philosopher *) arg;
+
+  /*
+   * While the gobal Stop flag is not set, keep thinking and eating
+   * like a good Philosopher.
+   */
+  while (!Stop) {
+    /*
+     * Determine how long to think and eat in this cycle. Limit the
+     * values to defined maximum values.
+     */
+    think_rnd = (phil_rand(me) % MAX_PHIL_THINK_PERIOD);
+    eat_rnd   = (phil_rand(me) % MAX_PHIL_EAT_PERIOD);
+
+    /*
+     * Think a random number of thoughts before getting hungry.
+     */
+    for (i = 0; i < think_rnd; i++){
+      think_one_thought();
+    }
+
+    /*
+     * Grab both forks: CHANDY/MISRA. A dirty fork held while waiting
+     * for the other may be taken meanwhile; then ask again.
+     */
+    do {
+      get_fork(left_fork(me), me->id);
+      get_fork(right_fork(me), me->id);
+    } while (!start_eating(left_fork(me), right_fork(me), me->id));
+
+    /*
+     * Eat some random amount of food.
+     */
+    for (i = 0; i < eat_rnd; i++){
+      eat_one_mouthful();
+    }
+
+    /*
+     * Release both forks: CHANDY/MISRA
+     */
+    put_fork(left_fork(me));
+    put_fork(right_fork(me));
+
+    /* 
+     * Update my progress in current session and for all time.
+     */
+    me->prog++;
+    me->prog_total++;
+    dp_meal(me->id);
+  }
+
+  /*
+   * Philosopher thread finished, so rejoin parent
+   */
+  return NULL;
+}
+
+/*
+ * Set up the table with Num_phils forks and philosophers and
+ * initialize everything.
+ */
+void set_table()
+{
+  pthread_attr_t attr;
+  int i;
+
+  Diners = aligned_alloc(CACHE_LINE, Num_phils * sizeof(philosopher));
+  forks = aligned_alloc(CACHE_LINE, Num_phils * sizeof(fork_t));
+  if (Diners == NULL || forks == NULL) {
+    perror("aligned_alloc");
+    exit(1);
+  }
+
+  /*
+   * Fork i starts dirty with the lower numbered of philosophers i and
+   * i+1; for the last fork that is philosopher 0.
+   */
+  for (i = 0; i < Num_phils; i++) {
+    dpl_mutex_init(&forks[i].lock);
+    dpl_cond_init(&forks[i].cond);
+    forks[i].owner  = (i == Num_phils-1) ? 0 : i;
+    forks[i].dirty  = 1;
+    forks[i].in_use = 0;
+    forks[i].waiter = -1;
+  }
+
+  for (i = 0; i < Num_phils; i++) {
+    Diners[i].prog = 0;
+    Diners[i].prog_total = 0;
+    Diners[i].id = i;
+    Diners[i].rng = (uint64_t) time(NULL) * 0x9E3779B97F4A7C15ULL + 2 * i + 1;
+  }
+
+  /*
+   * The philosophers need little stack; with thousands of them the
+   * default 8MB each would be a lot of address space.
+   */
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 64 * 1024);
+  for (i = 0; i < Num_phils; i++) {
+    if (pthread_create(&(Diners[i].thread), &attr, dp_thread, &Diners[i]) != 0) {
+      fprintf(stderr, "can't create philosopher %d\n", i);
+      exit(1);
+    }
+  }
+  pthread_attr_destroy(&attr);
+}
+
+/*
+ * Print the progress of all the philosphers: a table of them for a
+ * small table, a summary for a large one.
+ */
+void print_progress()
+{
+  long total = 0;
+  int  i;
+  int  j;
+  int  min, max, starved;
+
+  char buf[MAX_BUF];
+
+  if (Num_phils > MAX_TABLE_PRINT) {
+    min = max = Diners[0].prog;
+    starved = 0;
+    for (i = 0; i < Num_phils; i++) {
+      total += Diners[i].prog;
+      if (Diners[i].prog < min)
+        min = Diners[i].prog;
+      if (Diners[i].prog > max)
+        max = Diners[i].prog;
+      if (Diners[i].prog == 0)
+        starved++;
+    }
+    printf("%d philosophers: %ld meals (%.0f/s), per philosopher min %d "
+           "max %d, %d without a meal\n\n", Num_phils, total,
+           (double) total / ACCOUNTING_PERIOD, min, max, starved);
+    return;
+  }
+
+  for (i = 0; i < Num_phils;) {
+    /*
+     * Print them in groups of 5 across a line
+     */
+    for (j = 0; j < 4; j++) {
+      if (i == Num_phils) {
+        printf("\n");
+        goto out;
+      }
+      sprintf(buf, "%d/%d", Diners[i].prog, Diners[i].prog_total);
+      printf("p%d=%*s   ", i, STATS_WIDTH, buf);
+      i++;
+    }
+
+    if (i == Num_phils) {
+      printf("\n");
+      break;
+    }
+
+    sprintf(buf, "%d/%d", Diners[i].prog, Diners[i].prog_total);
+    printf("p%d=%*s\n", i, STATS_WIDTH, buf);
+    i++;
+  }
+
+out:
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+  int deadlock;
+  int iter;
+
+  iter = 0;
+  Num_phils = argc > 1 ? atoi(argv[1]) : NUM_PHILS;
+  if (Num_phils < 2) {
+    printf("Usage: ./dp_chandy [NUM_PHILS]  (at least 2)\n");
+    exit(1);
+  }
+
+  dp_bench_start(Num_phils);
+  set_table();
+#ifndef DP_BENCH
+  printf("\n");
+  printf("Dining Philosophers Update every %d seconds\n", ACCOUNTING_PERIOD);
+  printf("-------------------------------------------\n");
+#endif
+
+  do {
+    /*
+     * Reset the philosophers eating progress to 0. If the
+     * philosopher is making progress, the philosopher will
+     * increment it.
+     */
+    for (i = 0; i < Num_phils; i++)
+      Diners[i].prog = 0;
+
+    sleep(ACCOUNTING_PERIOD);
+
+    /*
+     * Check for deadlock (i.e. none of the philosophers have
+     * made progress in 5 seconds)
+     */
+    deadlock = 1;
+    for (i = 0; i < Num_phils; i++)
+      if (Diners[i].prog)
+        deadlock = 0;
+
+#ifndef DP_BENCH
+    print_progress();
+#endif
+    iter++;
+  } while (!deadlock && iter < ITERATION_LIMIT);
+
+  /*
+   * Set the "Stop flag to tell all diners to stop. Chandy/Misra can't
+   * deadlock, so every hungry philosopher gets to eat and leave.
+   */
+  Stop = 1;
+  dp_bench_stop();
+#ifndef DP_BENCH
+  if (deadlock) {
+    printf ("Deadlock Detected\n");
+  } else {
+    printf ("Finished without Deadlock\n");
+  }
+#endif
+
+  for (i = 0; i < Num_phils; i++)
+    pthread_join(Diners[i].thread, NULL);
+
+  dp_bench_report("dp_chandy", MAX_PHIL_THINK_PERIOD, MAX_PHIL_EAT_PERIOD,
+                  deadlock);
+
+  return 0;
+}
@@ -0,0 +1,408 @@
+/*
+ * The locks the dining philosophers take, chosen at compile time:
+ *
+ *   (default)   pthread_mutex_t and pthread_cond_t
+ *   -DDPL_FUTEX  futex lock that spins a while before going to sleep
+ *   -DDPL_TICKET ticket lock: FIFO, spins then sleeps on its counter
+ *   -DDPL_MCS    MCS queue lock: FIFO, each waiter spins then sleeps
+ *                on a word of its own
+ *
+ * A meal is a hundred function calls, so an uncontended chopstick is
+ * the common case and a contended one is usually free again a few
+ * hundred nanoseconds later. A pthread mutex puts the loser to sleep
+ * in the kernel right away and the winner has to wake it, which costs
+ * more than the meal. The locks here first spin, with a pause
+ * instruction and exponential backoff, for a bounded number of rounds
+ * that adapts to how long the lock has recently been held; only then
+ * do they park with FUTEX_WAIT. With only one CPU to run on there is
+ * nobody to spin for, and they park at once.
+ *
+ * Every lock has the same interface, so the solutions use it through
+ * dp_lock()/dp_unlock()/dp_cond_wait() (dp_bench.h) without knowing
+ * which one they got:
+ *
+ *   dpl_mutex_t, dpl_mutex_init(m), dpl_lock(m), dpl_unlock(m)
+ *   dpl_cond_t,  dpl_cond_init(c), dpl_cond_wait(c, m),
+ *                dpl_cond_signal(c), dpl_cond_broadcast(c)
+ *
+ * and DPL_NAME is its name. The non-pthread condition variable is a
+ * sequence number that waiters sleep on; like pthread_cond_wait() it
+ * may wake up spuriously, so wait in a loop.
+ *
+ * Only a pthread mutex may be unlocked by a thread that doesn't hold
+ * it (DPL_FORCE_UNLOCK), as main() does to free a deadlocked table.
+ */
+
+#ifndef DP_LOCK_H_
+#define DP_LOCK_H_
+
+#include <pthread.h>
+
+#if defined(DPL_FUTEX) || defined(DPL_TICKET) || defined(DPL_MCS)
+
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define DPL_FORCE_UNLOCK  0
+
+#ifndef DPL_SPIN_MAX
+#define DPL_SPIN_MAX      100   /* spin rounds before parking, at most */
+#endif
+#define DPL_BACKOFF_MAX   64    /* pauses between two looks, at most */
+
+/* CPUs we may run on; 1 means never spin */
+static int dpl_ncpu;
+
+static inline void dpl_pause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static inline long dpl_futex(int *addr, int op, int val)
+{
+  return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+static inline void dpl_wait(int *addr, int val)
+{
+  dpl_futex(addr, FUTEX_WAIT_PRIVATE, val);
+}
+
+static inline void dpl_wake(int *addr, int n)
+{
+  dpl_futex(addr, FUTEX_WAKE_PRIVATE, n);
+}
+
+static inline void dpl_setup(void)
+{
+  unsigned long mask[64];
+  long n, i;
+
+  if (dpl_ncpu)
+    return;
+  n = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+  for (i = 0; i < n / (long) sizeof(long); i++)
+    dpl_ncpu += __builtin_popcountl(mask[i]);
+  if (dpl_ncpu == 0)
+    dpl_ncpu = 1;
+}
+
+/*
+ * How long to spin on a lock: twice the rounds it took to get lately,
+ * plus a little, as glibc's PTHREAD_MUTEX_ADAPTIVE_NP does. The
+ * estimate is updated racily, which only makes it a little off.
+ */
+static inline int dpl_spin_limit(const int *spins)
+{
+  int max;
+
+  if (dpl_ncpu < 2)
+    return 0;
+  max = __atomic_load_n(spins, __ATOMIC_RELAXED) * 2 + 10;
+  return max < DPL_SPIN_MAX ? max : DPL_SPIN_MAX;
+}
+
+static inline void dpl_spin_learn(int *spins, int rounds)
+{
+  int s = __atomic_load_n(spins, __ATOMIC_RELAXED);
+
+  __atomic_store_n(spins, s + (rounds - s) / 8, __ATOMIC_RELAXED);
+}
+
+static inline void dpl_backoff(int *delay)
+{
+  int i;
+
+  for (i = 0; i < *delay; i++)
+    dpl_pause();
+  if (*delay < DPL_BACKOFF_MAX)
+    *delay <<= 1;
+}
+
+/*
+ * Condition variable for all three: a waiter notes the sequence
+ * number, drops the lock and sleeps until the number changes. A signal
+ * between the two makes FUTEX_WAIT return at once, so none is lost.
+ */
+typedef struct {
+  int seq;
+} dpl_cond_t;
+
+#define dpl_cond_init(c)  ((c)->seq = 0)
+
+static inline void dpl_cond_signal(dpl_cond_t *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_SEQ_CST);
+  dpl_wake(&c->seq, 1);
+}
+
+static inline void dpl_cond_broadcast(dpl_cond_t *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_SEQ_CST);
+  dpl_wake(&c->seq, INT_MAX);
+}
+
+#endif /* DPL_FUTEX || DPL_TICKET || DPL_MCS */
+
+#if defined(DPL_FUTEX)
+
+/*
+ * state is 0 when free, 1 when held, and 2 when held and somebody may
+ * be asleep on it (Drepper, "Futexes Are Tricky", mutex3). Only an
+ * unlock from 2 costs a system call.
+ */
+#define DPL_NAME "futex"
+
+typedef struct {
+  int state;
+  int spins;
+} dpl_mutex_t;
+
+static inline void dpl_mutex_init(dpl_mutex_t *m)
+{
+  dpl_setup();
+  m->state = 0;
+  m->spins = 0;
+}
+
+static inline int dpl_try(dpl_mutex_t *m)
+{
+  int free = 0;
+
+  return __atomic_compare_exchange_n(&m->state, &free, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void dpl_lock(dpl_mutex_t *m)
+{
+  int rounds, max, delay = 1;
+
+  if (dpl_try(m))
+    return;
+
+  max = dpl_spin_limit(&m->spins);
+  for (rounds = 0; rounds < max; rounds++) {
+    dpl_backoff(&delay);
+    if (__atomic_load_n(&m->state, __ATOMIC_RELAXED) == 0 && dpl_try(m)) {
+      dpl_spin_learn(&m->spins, rounds);
+      return;
+    }
+  }
+  if (max)
+    dpl_spin_learn(&m->spins, max);
+
+  while (__atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE) != 0)
+    dpl_wait(&m->state, 2);
+}
+
+static inline void dpl_unlock(dpl_mutex_t *m)
+{
+  if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2)
+    dpl_wake(&m->state, 1);
+}
+
+#elif defined(DPL_TICKET)
+
+/*
+ * Take a ticket and wait for it to be served: strictly first come,
+ * first served. A waiter n tickets back pauses about n times as long
+ * between looks, since it has n meals to wait for. Sleepers sleep on
+ * the serving counter, so an unlock must wake them all for the one
+ * whose turn it is; a chopstick has only one other user, the waiter's
+ * mutex has everybody.
+ */
+#define DPL_NAME "ticket"
+
+typedef struct {
+  unsigned int next;
+  unsigned int serving;
+  int          parked;
+  int          spins;
+} dpl_mutex_t;
+
+static inline void dpl_mutex_init(dpl_mutex_t *m)
+{
+  dpl_setup();
+  m->next = 0;
+  m->serving = 0;
+  m->parked = 0;
+  m->spins = 0;
+}
+
+static inline void dpl_lock(dpl_mutex_t *m)
+{
+  unsigned int me, s;
+  int rounds, max, delay;
+
+  me = __atomic_fetch_add(&m->next, 1, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&m->serving, __ATOMIC_ACQUIRE) == me)
+    return;
+
+  max = dpl_spin_limit(&m->spins);
+  for (rounds = 0; rounds < max; rounds++) {
+    s = __atomic_load_n(&m->serving, __ATOMIC_ACQUIRE);
+    if (s == me) {
+      dpl_spin_learn(&m->spins, rounds);
+      return;
+    }
+    delay = (me - s) < DPL_BACKOFF_MAX ? (int) (me - s) : DPL_BACKOFF_MAX;
+    while (delay--)
+      dpl_pause();
+  }
+  if (max)
+    dpl_spin_learn(&m->spins, max);
+
+  __atomic_fetch_add(&m->parked, 1, __ATOMIC_SEQ_CST);
+  while ((s = __atomic_load_n(&m->serving, __ATOMIC_SEQ_CST)) != me)
+    dpl_wait((int *) &m->serving, (int) s);
+  __atomic_fetch_sub(&m->parked, 1, __ATOMIC_RELAXED);
+}
+
+static inline void dpl_unlock(dpl_mutex_t *m)
+{
+  __atomic_store_n(&m->serving, m->serving + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&m->parked, __ATOMIC_SEQ_CST))
+    dpl_wake((int *) &m->serving, INT_MAX);
+}
+
+#elif defined(DPL_MCS)
+
+/*
+ * Mellor-Crummey and Scott: waiters queue up behind the tail, each
+ * watching the state of its own queue node, and the unlocker hands the
+ * lock straight to the next node. Nobody else's cache line is touched
+ * while waiting, and a sleeper is woken only when it is its turn.
+ *
+ * The interface has no node argument, so each thread keeps a few nodes
+ * of its own (one per lock it can hold at once) and the lock remembers
+ * its holder's.
+ */
+#define DPL_NAME "mcs"
+
+#define DPL_MCS_NODES 4
+
+typedef struct dpl_mcs_node {
+  struct dpl_mcs_node *next;
+  int                  state;   /* 1 waiting, 2 asleep, 0 your turn */
+  int                  busy;
+} __attribute__((aligned(64))) dpl_mcs_node;
+
+typedef struct {
+  dpl_mcs_node *tail;
+  dpl_mcs_node *owner;          /* only the holder reads or writes it */
+  int           spins;
+} dpl_mutex_t;
+
+static __thread dpl_mcs_node dpl_mcs_nodes[DPL_MCS_NODES];
+
+static inline void dpl_mutex_init(dpl_mutex_t *m)
+{
+  dpl_setup();
+  m->tail = NULL;
+  m->owner = NULL;
+  m->spins = 0;
+}
+
+static inline void dpl_lock(dpl_mutex_t *m)
+{
+  dpl_mcs_node *node = dpl_mcs_nodes, *prev;
+  int rounds, max, delay = 1, waiting = 1;
+
+  while (node->busy)
+    node++;             /* DPL_MCS_NODES is more than any thread holds */
+  node->busy = 1;
+  node->next = NULL;
+  node->state = 1;
+
+  prev = __atomic_exchange_n(&m->tail, node, __ATOMIC_ACQ_REL);
+  if (prev != NULL) {
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+
+    max = dpl_spin_limit(&m->spins);
+    for (rounds = 0; rounds < max; rounds++) {
+      if (__atomic_load_n(&node->state, __ATOMIC_ACQUIRE) == 0)
+        break;
+      dpl_backoff(&delay);
+    }
+    if (max)
+      dpl_spin_learn(&m->spins, rounds);
+
+    if (rounds == max &&
+        __atomic_compare_exchange_n(&node->state, &waiting, 2, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+      while (__atomic_load_n(&node->state, __ATOMIC_ACQUIRE) != 0)
+        dpl_wait(&node->state, 2);
+  }
+  m->owner = node;
+}
+
+static inline void dpl_unlock(dpl_mutex_t *m)
+{
+  dpl_mcs_node *node = m->owner, *next, *self;
+
+  next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+  if (next == NULL) {
+    self = node;
+    if (__atomic_compare_exchange_n(&m->tail, &self, NULL, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      node->busy = 0;
+      return;
+    }
+    /* Somebody is between joining the queue and linking in: let it */
+    while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL)
+      if (dpl_ncpu < 2)
+        sched_yield();
+      else
+        dpl_pause();
+  }
+  node->busy = 0;
+  /*
+   * The next thread may wake, eat and reuse its node before the wake:
+   * at worst that is a spurious wakeup for whoever waits on it then.
+   */
+  if (__atomic_exchange_n(&next->state, 0, __ATOMIC_RELEASE) == 2)
+    dpl_wake(&next->state, 1);
+}
+
+#endif
+
+#if defined(DPL_FUTEX) || defined(DPL_TICKET) || defined(DPL_MCS)
+
+static inline void dpl_cond_wait(dpl_cond_t *c, dpl_mutex_t *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_SEQ_CST);
+
+  dpl_unlock(m);
+  dpl_wait(&c->seq, seq);
+  dpl_lock(m);
+}
+
+#else /* pthread */
+
+#ifndef DPL_PTHREAD
+#define DPL_PTHREAD
+#endif
+#define DPL_NAME          "pthread"
+#define DPL_FORCE_UNLOCK  1
+
+typedef pthread_mutex_t dpl_mutex_t;
+typedef pthread_cond_t  dpl_cond_t;
+
+#define dpl_mutex_init(m)      pthread_mutex_init(m, NULL)
+#define dpl_lock(m)            pthread_mutex_lock(m)
+#define dpl_unlock(m)          pthread_mutex_unlock(m)
+#define dpl_cond_init(c)       pthread_cond_init(c, NULL)
+#define dpl_cond_wait(c, m)    pthread_cond_wait(c, m)
+#define dpl_cond_signal(c)     pthread_cond_signal(c)
+#define dpl_cond_broadcast(c)  pthread_cond_broadcast(c)
+
+#endif
+
+#endif /* DP_LOCK_H_ */
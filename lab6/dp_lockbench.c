@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dp_lock.h"
+
+/*
+ * Lock handoff benchmark for the locks in dp_lock.h, one of which is
+ * chosen when this is compiled (-DDPL_FUTEX, -DDPL_TICKET, -DDPL_MCS,
+ * or a pthread mutex by default).
+ *
+ * THREADS threads share one lock for SECS seconds. Each takes it,
+ * makes CS calls inside it (a meal), drops it, and makes THINK calls
+ * outside it. Printed as CSV (-H prints the header first):
+ *
+ *   lock,threads,cpus,cs,think,seconds,acquires,acquires_per_sec,jain,
+ *   handoffs,handoff_avg_ns,handoff_p50_ns,handoff_p99_ns
+ *
+ * A handoff is an acquire that had to wait for the previous holder:
+ * its latency is the time from that holder's unlock to the new
+ * holder's return from lock, i.e. what a waiter pays on top of the
+ * critical section it waited for. Spinning locks pay a cache line
+ * transfer, parked ones a futex wake and a trip through the
+ * scheduler. The percentiles are powers of two, the upper end of the
+ * histogram bucket they fall in.
+ *
+ * The count of critical sections is kept in a plain counter under the
+ * lock, so a lock that lets two threads in at once shows up as a
+ * mismatch with the per-thread counts, and an exit status of 1.
+ */
+
+#define MAX_THREADS                 256
+#define HIST_BUCKETS                 48   /* 2^47 ns is over a day */
+
+#define HEADER "lock,threads,cpus,cs,think,seconds,acquires,acquires_per_sec," \
+               "jain,handoffs,handoff_avg_ns,handoff_p50_ns,handoff_p99_ns"
+
+#define USAGE "usage: dp_lockbench [-t threads] [-s secs] [-c cs_calls] " \
+              "[-w think_calls] [-H]"
+
+typedef struct {
+  pthread_t thread;
+  long long acquires;
+  long long handoffs;
+  long long handoff_ns;
+  long long hist[HIST_BUCKETS];
+} __attribute__((aligned(64))) worker;
+
+static dpl_mutex_t Lock;
+static worker      Workers[MAX_THREADS];
+static int         Stop = 0;
+static int         Cs_calls = 100, Think_calls = 1000;
+
+/* Both written only under Lock */
+static long long   Released_ns;
+static long long   Inside;
+
+static long long now_ns (void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* A call per unit of work, as the philosophers think and eat */
+void __attribute__((noinline)) work_one (void)
+{
+  __asm__ __volatile__("" ::: "memory");
+}
+
+static int bucket (long long ns)
+{
+  int b = 0;
+
+  while (ns > 1 && b < HIST_BUCKETS - 1) {
+    ns >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void *lock_thread (void *arg)
+{
+  worker *me = arg;
+  long long t0, t1;
+  int i;
+
+  while (!__atomic_load_n(&Stop, __ATOMIC_RELAXED)) {
+    t0 = now_ns();
+    dpl_lock(&Lock);
+    t1 = now_ns();
+
+    /*
+     * If the last unlock came after we started waiting, we waited for
+     * it: the gap between the two is the handoff
+     */
+    if (Released_ns > t0) {
+      me->handoffs++;
+      me->handoff_ns += t1 - Released_ns;
+      me->hist[bucket(t1 - Released_ns)]++;
+    }
+    me->acquires++;
+    Inside++;
+
+    for (i = 0; i < Cs_calls; i++)
+      work_one();
+
+    Released_ns = now_ns();
+    dpl_unlock(&Lock);
+
+    for (i = 0; i < Think_calls; i++)
+      work_one();
+  }
+  return NULL;
+}
+
+/* The histogram bucket the pct'th percentile falls in, as 2^(b+1) */
+static long long percentile (const long long *hist, long long n, double pct)
+{
+  long long seen = 0;
+  int b;
+
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    seen += hist[b];
+    if (seen > 0 && seen >= n * pct)
+      return 1LL << (b + 1);
+  }
+  return 0;
+}
+
+static int cpus (void)
+{
+  cpu_set_t set;
+
+  if (sched_getaffinity(0, sizeof(set), &set) == -1)
+    return 1;
+  return CPU_COUNT(&set);
+}
+
+int main (int argc, char **argv)
+{
+  int threads = 4, secs = 3, opt, i, b;
+  long long acquires = 0, handoffs = 0, handoff_ns = 0, t0, t1;
+  long long hist[HIST_BUCKETS];
+  double sum2 = 0, elapsed, jain;
+
+  while ((opt = getopt(argc, argv, "t:s:c:w:H")) != -1) {
+    switch (opt) {
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 's':
+      secs = atoi(optarg);
+      break;
+    case 'c':
+      Cs_calls = atoi(optarg);
+      break;
+    case 'w':
+      Think_calls = atoi(optarg);
+      break;
+    case 'H':
+      printf("%s\n", HEADER);
+      break;
+    default:
+      fprintf(stderr, "%s\n", USAGE);
+      exit(1);
+    }
+  }
+  if (threads < 1 || threads > MAX_THREADS || secs < 1) {
+    fprintf(stderr, "%s\n", USAGE);
+    exit(1);
+  }
+
+  dpl_mutex_init(&Lock);
+
+  t0 = now_ns();
+  for (i = 0; i < threads; i++)
+    if (pthread_create(&Workers[i].thread, NULL, lock_thread, &Workers[i]) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+
+  sleep(secs);
+  __atomic_store_n(&Stop, 1, __ATOMIC_RELAXED);
+
+  for (i = 0; i < threads; i++)
+    pthread_join(Workers[i].thread, NULL);
+  t1 = now_ns();
+
+  memset(hist, 0, sizeof(hist));
+  for (i = 0; i < threads; i++) {
+    acquires += Workers[i].acquires;
+    sum2 += (double) Workers[i].acquires * Workers[i].acquires;
+    handoffs += Workers[i].handoffs;
+    handoff_ns += Workers[i].handoff_ns;
+    for (b = 0; b < HIST_BUCKETS; b++)
+      hist[b] += Workers[i].hist[b];
+  }
+  elapsed = (t1 - t0) / 1e9;
+  jain = sum2 > 0 ? (double) acquires * acquires / (threads * sum2) : 0;
+
+  printf("%s,%d,%d,%d,%d,%.3f,%lld,%.0f,%.4f,%lld,%.0f,%lld,%lld\n",
+         DPL_NAME, threads, cpus(), Cs_calls, Think_calls, elapsed, acquires,
+         acquires / elapsed, jain, handoffs,
+         handoffs ? (double) handoff_ns / handoffs : 0.0,
+         percentile(hist, handoffs, 0.50), percentile(hist, handoffs, 0.99));
+
+  if (Inside != acquires) {
+    fprintf(stderr, "dp_lockbench: %s let %lld critical sections overlap\n",
+            DPL_NAME, acquires - Inside);
+    exit(1);
+  }
+  return 0;
+}
@@ -4,23 +4,46 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include "dp_bench.h"
+
 /*
  * Some handy constants. Number of philosophers and chopsticks lets us
  * parameterize the number of concurrent threads and shared
  * resources. The maximum thinking and eating periods let us tune
  * relative periods of holding or not holding a resource. The MAX_BUF
  * and column_width constants help with creating output that makes
- * sense..
+ * sense.. The table size and periods can be set with -D, as
+ * dp_bench.sh does.
  */
+#ifndef NUM_PHILS
 #define NUM_PHILS                     5
+#endif
 #define NUM_CHOPS             NUM_PHILS
+#ifndef MAX_PHIL_THINK_PERIOD
 #define MAX_PHIL_THINK_PERIOD      1000
+#endif
+#ifndef MAX_PHIL_EAT_PERIOD
 #define MAX_PHIL_EAT_PERIOD         100
+#endif
 #define MAX_BUF                     256
 #define STATS_WIDTH                  16
 #define COLUMN_WIDTH                 18
+#ifndef ACCOUNTING_PERIOD
 #define ACCOUNTING_PERIOD             5
+#endif
+#ifndef ITERATION_LIMIT
 #define ITERATION_LIMIT              10
+#endif
+#ifndef WAITER_SEGMENTS
+#define WAITER_SEGMENTS               1
+#endif
+
+#if WAITER_SEGMENTS < 1 || WAITER_SEGMENTS > NUM_PHILS
+#error "WAITER_SEGMENTS must be between 1 and NUM_PHILS"
+#endif
+
+#define STR_(x)                     #x
+#define STR(x)                      STR_(x)
 
 /*
  * Structure defining a philosopher and any state we need to know
@@ -30,7 +53,7 @@
 typedef struct {
   int            id;           /* Int ID number assigned by
                                   set_table() */
-  pthread_cond_t can_eat;      /* Condition var used in a WAITER SOLUTION */
+  dpl_cond_t     can_eat;      /* Condition var used in a WAITER SOLUTION */
   int            prog;         /* Progress during current main()
                                   accounting period */
   int            prog_total;   /* Total progress across all
@@ -42,12 +65,28 @@ typedef struct {
 /* GLOBALS */
 philosopher Diners[NUM_PHILS];
 int         Stop = 0;
+int         Left = 0;        /* philosophers that have left the table */
 
 /* Each chopstick is shared between two philosophers */
-static pthread_mutex_t chopstick[NUM_CHOPS];
+static dpl_mutex_t chopstick[NUM_CHOPS];
 
-/* WAITER SOLUTION uses these data structures */
-static pthread_mutex_t waiter;
+/*
+ * WAITER SOLUTION uses these data structures. With one waiter for the
+ * whole table every philosopher takes its lock twice a meal, and it
+ * caps how fast the table can eat. So the table is split into
+ * WAITER_SEGMENTS runs of neighboring philosophers, each with a waiter
+ * of its own that looks after them and their left chopsticks (the
+ * availability flags below) and whose lock they wait under on their
+ * can_eat. A philosopher at the start of a run needs its right
+ * chopstick from the waiter of the run before; one at either end has a
+ * neighbor in another run to signal. Those take both waiters, lower
+ * numbered first.
+ */
+typedef struct {
+  dpl_mutex_t waiter;
+} __attribute__((aligned(64))) segment;
+
+static segment Segments[WAITER_SEGMENTS];
 static int available_chopsticks[NUM_CHOPS];
 
 /*
@@ -70,12 +109,12 @@ philosopher *right_phil (philosopher *p)
   return &Diners[(p->id == 0 ? (NUM_PHILS-1) : (p->id)-1)];
 }
 
-pthread_mutex_t *left_chop (philosopher *p)
+dpl_mutex_t *left_chop (philosopher *p)
 {
   return &chopstick[p->id];
 }
 
-pthread_mutex_t *right_chop (philosopher *p)
+dpl_mutex_t *right_chop (philosopher *p)
 {
   return &chopstick[(p->id == 0 ? NUM_CHOPS-1 : (p->id)-1)];
 }
@@ -90,6 +129,58 @@ int *right_chop_available (philosopher *p)
   return &available_chopsticks[(p->id == 0 ? NUM_CHOPS-1 : (p->id)-1)];
 }
 
+/*
+ * The segment whose waiter looks after philosopher number id and its
+ * left chopstick
+ */
+int segment_of (int id)
+{
+  return id * WAITER_SEGMENTS / NUM_PHILS;
+}
+
+/*
+ * The waiters p deals with, in the order to lock them in, into segs;
+ * returns how many. Getting chopsticks needs the waiters of both of
+ * them; putting them back also the waiters the two neighbors wait
+ * under, to signal them.
+ */
+int waiters_for (philosopher *p, int releasing, int *segs)
+{
+  int want[3], n = 0, i, j, k;
+
+  want[0] = segment_of(right_phil(p)->id);
+  want[1] = segment_of(p->id);
+  want[2] = segment_of(left_phil(p)->id);
+
+  for (i = 0; i < (releasing ? 3 : 2); i++) {
+    for (j = 0; j < n && segs[j] < want[i]; j++)
+      ;
+    if (j < n && segs[j] == want[i])
+      continue;
+    for (k = n; k > j; k--)
+      segs[k] = segs[k-1];
+    segs[j] = want[i];
+    n++;
+  }
+  return n;
+}
+
+void lock_waiters (int *segs, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    dp_lock( &Segments[segs[i]].waiter );
+}
+
+void unlock_waiters (int *segs, int n)
+{
+  int i;
+
+  for (i = n - 1; i >= 0; i--)
+    dp_unlock( &Segments[segs[i]].waiter );
+}
+
 /*
  * Do a small amount of work that we can use to represent a
  * philosopher thinking one thought
@@ -123,9 +214,13 @@ static void *dp_thread(void *arg)
   int          id;
   philosopher *me;
   int          think_rnd;
+  int          home;
+  int          segs[3];
+  int          n;
 
   me = (philosopher *) arg;
   id = me->id;
+  home = segment_of(id);
 
   /*
    * While the gobal Stop flag is not set, keep thinking and eating
@@ -150,18 +245,28 @@ static void *dp_thread(void *arg)
     }
 
     /*
-     * Grab both chopsticks: WAITER SOLUTION
+     * Grab both chopsticks: WAITER SOLUTION. Wait until both are on
+     * the table. The wait is under my own waiter, so any other one is
+     * let go of first and the lot taken again in order after.
      */
-    pthread_mutex_lock( &waiter );
-
-    while(! (right_chop_available( me ) || left_chop_available( me ) ) ){
-      pthread_cond_wait( &(me->can_eat), &waiter );
+    n = waiters_for( me, 0, segs );
+    lock_waiters( segs, n );
+
+    while(! ( *right_chop_available( me ) && *left_chop_available( me ) ) ){
+      for (i = n - 1; i >= 0; i--)
+        if (segs[i] != home)
+          dp_unlock( &Segments[segs[i]].waiter );
+      dp_cond_wait( &(me->can_eat), &Segments[home].waiter );
+      if (n > 1) {
+        dp_unlock( &Segments[home].waiter );
+        lock_waiters( segs, n );
+      }
     }
 
     *left_chop_available( me ) = 0;
     *right_chop_available( me ) = 0;
 
-    pthread_mutex_unlock( &waiter );
+    unlock_waiters( segs, n );
 
     /*
      * Eat some random amount of food. Again, this involves a
@@ -173,28 +278,32 @@ static void *dp_thread(void *arg)
     }
 
     /*
-     * Release both chopsticks: WAITER SOLUTION
+     * Release both chopsticks: WAITER SOLUTION. Each one may be what
+     * the neighbor on that side is waiting for.
      */
-    pthread_mutex_lock( &waiter );
+    n = waiters_for( me, 1, segs );
+    lock_waiters( segs, n );
 
     *left_chop_available( me ) = 1; 
     *right_chop_available( me ) = 1;
 
-    pthread_cond_signal( &( right_phil( me )->can_eat ) );
-    pthread_cond_signal( &( right_phil( me )->can_eat) );
+    dpl_cond_signal( &( left_phil( me )->can_eat ) );
+    dpl_cond_signal( &( right_phil( me )->can_eat) );
 
-    pthread_mutex_unlock( &waiter );
+    unlock_waiters( segs, n );
 
     /* 
      * Update my progress in current session and for all time.
      */
     me->prog++;
     me->prog_total++;
+    dp_meal(me->id);
   }
 
   /*
    * Philosopher thread finished, so rejoin parent
    */
+  __atomic_fetch_add(&Left, 1, __ATOMIC_RELEASE);
   return NULL;
 }
 
@@ -207,17 +316,18 @@ void set_table()
   int i;
 
   /*
-   * Initialize mutex used in the WAITER SOLUTION to represent the
-   * waiter
+   * Initialize the mutexes used in the WAITER SOLUTION to represent
+   * the waiters
    */
-  pthread_mutex_init(&waiter, NULL);
+  for (i = 0; i < WAITER_SEGMENTS; i++)
+    dpl_mutex_init(&Segments[i].waiter);
 
   /*
    * Initialize all the Mutexes that represent the chopsticks. The
    * available flags are used in the WAITER SOLUTION.
    */
   for (i = 0; i < NUM_CHOPS; i++) {
-    pthread_mutex_init(&chopstick[i], NULL);
+    dpl_mutex_init(&chopstick[i]);
     available_chopsticks[i] = 1;
   }
 
@@ -319,10 +429,15 @@ int main(int argc, char **argv)
    * Set the table means create the chopsticks and the philosophers.
    * Print out a header for the periodic updates on Philosopher state.
    */
+  dp_bench_start(NUM_PHILS);
   set_table();
+#ifndef DP_BENCH
   printf("\n");
   printf("Dining Philosophers Update every %d seconds\n", ACCOUNTING_PERIOD);
   printf("-------------------------------------------\n");
+  if (WAITER_SEGMENTS > 1)
+    printf("%d waiters\n", WAITER_SEGMENTS);
+#endif
 
   do {
     /*
@@ -354,7 +469,9 @@ int main(int argc, char **argv)
     /*
      * Print out the philosophers progress
      */
+#ifndef DP_BENCH
     print_progress();
+#endif
     iter++;
   } while (!deadlock && iter < ITERATION_LIMIT);
 
@@ -362,24 +479,44 @@ int main(int argc, char **argv)
    * Set the "Stop flag to tell all diners to stop
    */
   Stop = 1;
-  if (deadlock) {
-    printf ("Deadlock Detected\n");
-  } else {
-    printf ("Finished without Deadlock\n");
-  }
+  dp_bench_stop();
 
   /*
    * Release all locks so philosophers can exit even if they are
-   * deadlocked.
+   * deadlocked. Only a pthread mutex can be released by a thread that
+   * doesn't hold it; with the other locks (dp_lock.h) a deadlocked
+   * table is left as it is, and returning from main() ends it.
    */
-  for (i = 0; i < NUM_CHOPS; i++)
-    pthread_mutex_unlock(&chopstick[i]);
+  if (DPL_FORCE_UNLOCK)
+    for (i = 0; i < NUM_CHOPS; i++)
+      dpl_unlock(&chopstick[i]);
 
   /*
-   * Wait for philosophers to finish
+   * Wait for philosophers to finish. The table can also deadlock after
+   * the last check saw a meal; if they haven't all left an accounting
+   * period after Stop, and can't be released, it has.
    */
-  for (i = 0; i < NUM_PHILS; i++)
-    pthread_join(Diners[i].thread, NULL);
+  if (!DPL_FORCE_UNLOCK) {
+    for (i = 0; i < ACCOUNTING_PERIOD * 100 &&
+                __atomic_load_n(&Left, __ATOMIC_ACQUIRE) < NUM_PHILS; i++)
+      usleep(10000);
+    if (__atomic_load_n(&Left, __ATOMIC_ACQUIRE) < NUM_PHILS)
+      deadlock = 1;
+  }
+  if (DPL_FORCE_UNLOCK || !deadlock)
+    for (i = 0; i < NUM_PHILS; i++)
+      pthread_join(Diners[i].thread, NULL);
+
+#ifndef DP_BENCH
+  if (deadlock) {
+    printf ("Deadlock Detected\n");
+  } else {
+    printf ("Finished without Deadlock\n");
+  }
+#endif
+
+  dp_bench_report("dp_waiter_k" STR(WAITER_SEGMENTS), MAX_PHIL_THINK_PERIOD,
+                  MAX_PHIL_EAT_PERIOD, deadlock);
 
   return 0;
 }
@@ -2,35 +2,119 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
 
+#include "vm_trace.h"
+#include "vm_simd.h"
 
-#define MAXSTR 1000
+/*
+ * Batch mode: load the whole trace, translate it with one of the
+ * vectorized kernels in vm_simd.c and then print the same report the
+ * streaming translator prints. With quiet set only a summary line with
+ * the translation time is printed, which is what is wanted when timing
+ * large traces.
+ */
+static int translate_batch(vm_trace *t, int *page_table, int *mem_map,
+                           unsigned int num_frames, const char *kernel,
+                           int quiet)
+{
+  vm_xlate x;
+  vm_kernel_fn fn;
+  const char *chosen;
+  uint32_t *addr, *page, *frame, *phys;
+  unsigned char *fault;
+  struct timespec t0, t1;
+  size_t i;
+
+  if ((fn = vm_kernel_select(kernel, &chosen)) == NULL) {
+    fprintf(stderr, "Kernel %s not supported on this CPU. Abort.\n", kernel);
+    return -1;
+  }
+  if (t->log_size > 32 || t->page_size == 0) {
+    fprintf(stderr, "Batch mode needs 0 < page size, address space <= 2^32. Abort.\n");
+    return -1;
+  }
+
+  addr  = (uint32_t *) malloc(t->n * sizeof(uint32_t));
+  page  = (uint32_t *) malloc(t->n * sizeof(uint32_t));
+  frame = (uint32_t *) malloc(t->n * sizeof(uint32_t));
+  phys  = (uint32_t *) malloc(t->n * sizeof(uint32_t));
+  fault = (unsigned char *) malloc(t->n);
+  if (t->n && (!addr || !page || !frame || !phys || !fault)) {
+    perror("malloc");
+    return -1;
+  }
+  for (i = 0; i < t->n; i++)
+    addr[i] = (uint32_t) t->addr[i];
+
+  vm_xlate_init(&x, t->log_size, t->page_size, page_table, mem_map, num_frames);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  fn(&x, addr, t->n, page, frame, phys, fault);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  if (quiet) {
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("Kernel: %s, Addresses: %zu, Page Faults: %zu, Time: %.6f s\n",
+           chosen, t->n, x.faults, secs);
+  } else {
+    for (i = 0; i < t->n; i++) {
+      printf("Logical Address: 0x%x\n", addr[i]);
+      printf("Page Number: %d\n", page[i]);
+      if (fault[i])
+        printf("Page Fault!\n");
+      printf("Frame Number: %d\n", frame[i]);
+      printf("Physical Address: 0x%x\n", phys[i]);
+      printf("\n");
+    }
+  }
+
+  free(addr);
+  free(page);
+  free(frame);
+  free(phys);
+  free(fault);
+  return 0;
+}
 
 int main(int argc, char *argv[])
 {
   char line[MAXSTR];
   int *page_table, *mem_map;
-  unsigned int log_size, phy_size, page_size, d;
+  unsigned int log_size, phy_size, page_size;
   unsigned int num_pages, num_frames;
   unsigned int offset, logical_addr, physical_addr, page_num, frame_num;
 
-  /* Get the memory characteristics from the input file */
-  fgets(line, MAXSTR, stdin);
-  if((sscanf(line, "Logical address space size: %d^%d", &d, &log_size)) != 2){
-    fprintf(stderr, "Unexpected line 1. Abort.\n");
-    exit(-1);
-  }
-  fgets(line, MAXSTR, stdin);
-  if((sscanf(line, "Physical address space size: %d^%d", &d, &phy_size)) != 2){
-    fprintf(stderr, "Unexpected line 2. Abort.\n");
-    exit(-1);
-  }
-  fgets(line, MAXSTR, stdin);
-  if((sscanf(line, "Page size: %d^%d", &d, &page_size)) != 2){
-    fprintf(stderr, "Unexpected line 3. Abort.\n");
-    exit(-1);
+  vm_trace trace;
+  char *kernel = NULL;
+  int batch = 0, quiet = 0, opt;
+
+  /*
+   * -b translates the trace in one batch with a vectorized kernel, -k
+   * forces a kernel (auto, avx2, sse4 or scalar) and -q prints only a
+   * timing summary. Without options the trace is streamed as before.
+   */
+  while ((opt = getopt(argc, argv, "bk:q")) != -1) {
+    switch (opt) {
+    case 'b': batch = 1; break;
+    case 'k': batch = 1; kernel = optarg; break;
+    case 'q': batch = 1; quiet = 1; break;
+    default:
+      fprintf(stderr, "usage: VM_addr_map [-b] [-k kernel] [-q] < trace\n");
+      exit(-1);
+    }
   }
 
+  /* Get the memory characteristics from the input file */
+  if (batch)
+    vm_trace_load(stdin, &trace);
+  else
+    vm_trace_read_header(stdin, &trace);
+  log_size  = trace.log_size;
+  phy_size  = trace.phy_size;
+  page_size = trace.page_size;
+
   /* Allocate arrays to hold the page table and memory frames map */
   num_frames = (int) pow( 2, phy_size - page_size );
   num_pages = (int) pow( 2, log_size - page_size );
@@ -42,12 +126,19 @@ int main(int argc, char *argv[])
   /* Initialize page table to indicate that no pages are currently mapped to
      physical memory */
 
-  memset( page_table, 0, sizeof(page_table));
-  memset( mem_map, 0, sizeof(mem_map));
+  memset( page_table, 0, num_pages * sizeof(int));
+  memset( mem_map, 0, num_frames * sizeof(int));
 
   int temp = 0;
   int frame = 0;
   printf("\n");
+
+  if (batch) {
+    int ret = translate_batch(&trace, page_table, mem_map, num_frames,
+                              kernel, quiet);
+    vm_trace_free(&trace);
+    return ret;
+  }
   
 
   /* Initialize memory map table to indicate no valid frames */
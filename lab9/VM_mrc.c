@@ -0,0 +1,335 @@
+/*
+ * One-pass LRU miss-ratio curve for VM_addr_map traces.
+ *
+ * Instead of rerunning the translator once per frame count, compute
+ * the LRU stack (reuse) distance of every page reference with
+ * Mattson's algorithm. A reference with stack distance d hits in any
+ * LRU memory of at least d frames, so one histogram of distances gives
+ * the miss count for every memory size at once.
+ *
+ * The distance is the number of distinct pages touched since the
+ * previous reference to the same page. Each page keeps only its most
+ * recent access time marked in a Fenwick tree indexed by time, so the
+ * distance is a range count over the tree: O(log n) per reference.
+ * Only the order of the times matters, so when the tree fills up with
+ * mostly stale slots the live times are renumbered 1..pages instead of
+ * growing it: memory is O(distinct pages), not O(trace length).
+ *
+ * Pages of different pids in a multi-process trace are different
+ * pages sharing one LRU memory.
+ *
+ * With -s RATE only pages whose hash falls under RATE are tracked
+ * (SHARDS fixed-rate spatial sampling); distances and counts are then
+ * scaled by 1/RATE to estimate the full curve.
+ *
+ * Usage: VM_mrc [-s rate] [trace]
+ * Prints "frames,misses,miss_ratio" CSV lines to stdout.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vm_trace.h"
+
+#define SHARDS_MODULUS (1 << 24)
+
+/* (pid, page) -> time of its last reference, open addressing */
+typedef struct last_use_map {
+  uint64_t     *page;
+  unsigned int *pid;
+  size_t       *time;       /* 0 marks an empty slot */
+  size_t    cap;            /* power of two */
+  size_t    used;
+} last_use_map;
+
+/* Fenwick tree over reference times, 1-based */
+typedef struct fenwick {
+  int           *tree;
+  unsigned char *mark;      /* plain copy of the marks, to rebuild on growth */
+  size_t         cap;
+} fenwick;
+
+static inline uint64_t hash64(uint64_t x)
+{
+  /* splitmix64 finalizer */
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+  void *p = calloc(n, size);
+
+  if (p == NULL) {
+    perror("calloc");
+    exit(-1);
+  }
+  return p;
+}
+
+static size_t *map_slot(last_use_map *m, unsigned int pid, uint64_t page)
+{
+  size_t i = hash64(page ^ hash64(pid)) & (m->cap - 1);
+
+  while (m->time[i] && (m->page[i] != page || m->pid[i] != pid))
+    i = (i + 1) & (m->cap - 1);
+  m->page[i] = page;
+  m->pid[i] = pid;
+  return &m->time[i];
+}
+
+static void map_grow(last_use_map *m)
+{
+  last_use_map old = *m;
+  size_t i;
+
+  m->cap  = old.cap ? 2 * old.cap : 1024;
+  m->page = (uint64_t *) xcalloc(m->cap, sizeof(uint64_t));
+  m->pid  = (unsigned int *) xcalloc(m->cap, sizeof(unsigned int));
+  m->time = (size_t *) xcalloc(m->cap, sizeof(size_t));
+  for (i = 0; i < old.cap; i++)
+    if (old.time[i])
+      *map_slot(m, old.pid[i], old.page[i]) = old.time[i];
+  free(old.page);
+  free(old.pid);
+  free(old.time);
+}
+
+/*
+ * Return the slot holding page's last reference time (0 if the page has
+ * never been seen), inserting the page if necessary.
+ */
+static size_t *map_lookup(last_use_map *m, unsigned int pid, uint64_t page)
+{
+  size_t *slot;
+
+  if (2 * (m->used + 1) > m->cap)
+    map_grow(m);
+  slot = map_slot(m, pid, page);
+  if (*slot == 0)
+    m->used++;
+  return slot;
+}
+
+static void fenwick_add(fenwick *f, size_t i, int v)
+{
+  f->mark[i] += v;
+  for (; i <= f->cap; i += i & -i)
+    f->tree[i] += v;
+}
+
+static long fenwick_sum(fenwick *f, size_t i)
+{
+  long s = 0;
+
+  for (; i > 0; i -= i & -i)
+    s += f->tree[i];
+  return s;
+}
+
+/* Rebuild the tree from the marks in O(n) */
+static void fenwick_rebuild(fenwick *f)
+{
+  size_t i, j;
+
+  for (i = 1; i <= f->cap; i++)
+    f->tree[i] = f->mark[i];
+  for (i = 1; i <= f->cap; i++) {
+    j = i + (i & -i);
+    if (j <= f->cap)
+      f->tree[j] += f->tree[i];
+  }
+}
+
+/*
+ * Double the time range the tree covers, so growth costs O(1)
+ * amortized per reference.
+ */
+static void fenwick_grow(fenwick *f)
+{
+  size_t cap = f->cap ? 2 * f->cap : 1024;
+
+  f->mark = (unsigned char *) realloc(f->mark, cap + 1);
+  f->tree = (int *) realloc(f->tree, (cap + 1) * sizeof(int));
+  if (f->mark == NULL || f->tree == NULL) {
+    perror("realloc");
+    exit(-1);
+  }
+  memset(f->mark + f->cap + 1, 0, cap - f->cap);
+  f->cap = cap;
+  fenwick_rebuild(f);
+}
+
+/*
+ * Renumber the live times 1..m->used, keeping their order, and return
+ * the last one. Done only when at most half the slots are live, so at
+ * least cap/2 references pass before the next time: O(1) amortized.
+ */
+static size_t fenwick_compact(fenwick *f, last_use_map *m)
+{
+  size_t *rank = (size_t *) xcalloc(f->cap + 1, sizeof(size_t));
+  size_t i, n = 0;
+
+  for (i = 1; i <= f->cap; i++)
+    if (f->mark[i])
+      rank[i] = ++n;
+  for (i = 0; i < m->cap; i++)
+    if (m->time[i])
+      m->time[i] = rank[m->time[i]];
+  free(rank);
+
+  memset(f->mark + 1, 0, f->cap);
+  memset(f->mark + 1, 1, n);
+  fenwick_rebuild(f);
+  return n;
+}
+
+int main(int argc, char *argv[])
+{
+  char line[MAXSTR];
+  vm_trace t;
+  last_use_map lru;
+  fenwick fw;
+  FILE *in = stdin;
+  double rate = 1.0, *hist, misses, total, adj, take;
+  size_t refs = 0, sampled = 0, now = 0, hist_len = 1024, max_dist = 0;
+  size_t *last, d, m;
+  unsigned int pid;
+  uint64_t a, page, threshold;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:")) != -1) {
+    switch (opt) {
+    case 's':
+      rate = atof(optarg);
+      if (rate > 0 && rate <= 1)
+        break;
+      /* fall through */
+    default:
+      fprintf(stderr, "usage: VM_mrc [-s rate] [trace]\n");
+      exit(-1);
+    }
+  }
+  if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+    perror(argv[optind]);
+    exit(-1);
+  }
+
+  vm_trace_read_header(in, &t);
+
+  memset(&lru, 0, sizeof(lru));
+  memset(&fw, 0, sizeof(fw));
+  fenwick_grow(&fw);
+  hist = (double *) xcalloc(hist_len + 1, sizeof(double));
+  threshold = (uint64_t) (rate * SHARDS_MODULUS);
+
+  /*
+   * Stream the trace; nothing but the distance histogram, one map entry
+   * and a few tree slots per sampled page is kept.
+   */
+  while (fgets(line, MAXSTR, in) != NULL) {
+    if (!vm_trace_parse(line, &pid, &a))
+      continue;
+    refs++;
+
+    page = a >> t.page_size;
+    if (rate < 1 &&
+        (hash64(page ^ hash64(pid)) & (SHARDS_MODULUS - 1)) >= threshold)
+      continue;
+    sampled++;
+
+    if (++now > fw.cap) {
+      if (2 * lru.used <= fw.cap)
+        now = fenwick_compact(&fw, &lru) + 1;
+      else
+        fenwick_grow(&fw);
+    }
+
+    last = map_lookup(&lru, pid, page);
+    if (*last) {
+      /* Distinct pages touched after the last use, plus this page */
+      d = fenwick_sum(&fw, now - 1) - fenwick_sum(&fw, *last) + 1;
+      fenwick_add(&fw, *last, -1);
+
+      if (d > hist_len) {
+        size_t len = hist_len;
+
+        while (len < d)
+          len *= 2;
+        hist = (double *) realloc(hist, (len + 1) * sizeof(double));
+        memset(hist + hist_len + 1, 0, (len - hist_len) * sizeof(double));
+        hist_len = len;
+      }
+      hist[d]++;
+      if (d > max_dist)
+        max_dist = d;
+    }
+    fenwick_add(&fw, now, 1);
+    *last = now;
+  }
+
+  /*
+   * SHARDS-adj: the sample rarely holds exactly rate * refs references.
+   * Credit the difference to the smallest distance so the estimated
+   * curve ends at the right total, then scale everything up. A sample
+   * that came out too big can have a surplus larger than that bucket;
+   * the rest comes out of the next distances up, never leaving one
+   * below zero, so the curve still only falls and stays within [0,1].
+   */
+  total = refs;
+  adj = refs * rate - sampled;
+  if (rate < 1 && max_dist > 0 && adj > 0)
+    hist[1] += adj;
+  for (d = 1; rate < 1 && d <= max_dist && adj < 0; d++) {
+    take = hist[d] < -adj ? hist[d] : -adj;
+    hist[d] -= take;
+    adj += take;
+  }
+
+  /*
+   * Fold the (scaled) distances into per-frame-count buckets, then
+   * misses(m) = cold misses + references with distance > m, which is a
+   * running sum walking down from the largest distance.
+   */
+  {
+    size_t max_frames = (size_t) ((max_dist > lru.used ? max_dist : lru.used)
+                                  / rate + 0.5);
+    double *bucket = (double *) xcalloc(max_frames + 1, sizeof(double));
+    double *curve  = (double *) xcalloc(max_frames + 1, sizeof(double));
+
+    for (d = 1; d <= max_dist; d++)
+      bucket[(size_t) (d / rate + 0.5)] += hist[d] / rate;
+
+    misses = lru.used / rate;
+    for (m = max_frames; m >= 1; m--) {
+      curve[m] = misses;
+      misses += bucket[m];
+    }
+
+    printf("frames,misses,miss_ratio\n");
+    for (m = 1; m <= max_frames; m++) {
+      if (curve[m] > total)
+        curve[m] = total;
+      printf("%zu,%.0f,%.6f\n", m, curve[m], total ? curve[m] / total : 0.0);
+    }
+
+    free(bucket);
+    free(curve);
+  }
+
+  fprintf(stderr, "References: %zu, Sampled: %zu, Distinct Pages: %zu\n",
+          refs, sampled, lru.used);
+
+  free(lru.page);
+  free(lru.pid);
+  free(lru.time);
+  free(fw.tree);
+  free(fw.mark);
+  free(hist);
+  return 0;
+}
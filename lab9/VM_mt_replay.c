@@ -0,0 +1,377 @@
+/*
+ * Multi-threaded trace replay.
+ *
+ * Each trace named on the command line is replayed by its own thread,
+ * as if the traces were the threads of one process sharing a single
+ * address space. Every thread has a private TLB (vm_tlb.c); all of
+ * them share one page table. Faults are resolved with a per-entry
+ * lock taken by compare-and-swap, and frames are handed out FIFO, so
+ * once physical memory is full a fault evicts the page that got the
+ * frame one lap earlier and sends a TLB shootdown to every other
+ * thread.
+ *
+ * Usage: VM_mt_replay [-e entries] [-w ways] [-r repeat] [-S] trace...
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "vm_trace.h"
+#include "vm_tlb.h"
+
+#define MAX_THREADS  256
+#define PTE_LOCKED   -1     /* page table entry is being faulted in */
+#define SPIN_YIELD   64     /* spins before a waiter gives up its CPU */
+
+typedef struct replay_thread {
+  int          id;
+  pthread_t    thread;
+  vm_trace    *trace;
+  vm_tlb       tlb;
+  int          flush_pending;     /* set by another thread's shootdown */
+  size_t       refs;
+  size_t       faults;            /* faults this thread resolved */
+  size_t       contention;        /* misses that waited on another fault */
+  long long    wait_ns;           /* ... and how long they waited */
+  size_t       evictions;
+  size_t       shootdowns_sent;
+  size_t       shootdowns_recv;
+  uint64_t     checksum;          /* keeps the translation loop honest */
+} __attribute__((aligned(64))) replay_thread;
+
+/* GLOBALS shared by all replay threads */
+static int          *page_table;   /* page -> frame + 1, 0 if not resident */
+static int          *frame_owner;  /* frame -> page + 1, 0 if free */
+static unsigned int  num_pages;
+static unsigned int  num_frames;
+static unsigned int  page_size;
+static unsigned long next_frame;   /* FIFO hand, taken with fetch-and-add */
+static unsigned long *frame_lap;   /* frame -> laps of the hand installed */
+static int           repeat = 1;
+static int           nthreads;
+static replay_thread threads[MAX_THREADS];
+static pthread_barrier_t start_line;
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static long long now_ns(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/*
+ * One more spin of a miss waiting on another thread's fault. The miss
+ * is counted as contended once however long it spins, and yields now
+ * and then in case the thread it waits on is not running.
+ */
+static void contended(replay_thread *me, long long *since, unsigned int *spins)
+{
+  if (*since == 0) {
+    me->contention++;
+    *since = now_ns();
+  }
+  if (++*spins % SPIN_YIELD == 0)
+    sched_yield();
+  else
+    cpu_relax();
+}
+
+/*
+ * Tell every other thread to drop its cached translations. A real
+ * kernel would IPI the other CPUs; here each thread notices the flag
+ * before its next access and flushes its whole TLB.
+ */
+static void shootdown(replay_thread *me, unsigned int pg)
+{
+  int i;
+
+  vm_tlb_invalidate(&me->tlb, pg);
+  for (i = 0; i < nthreads; i++) {
+    if (i == me->id)
+      continue;
+    __atomic_store_n(&threads[i].flush_pending, 1, __ATOMIC_RELEASE);
+    me->shootdowns_sent++;
+  }
+}
+
+/*
+ * Resolve a TLB miss for page pg. Only the thread that wins the CAS
+ * from 0 to PTE_LOCKED takes the fault; anybody else who misses on the
+ * same page waits for the entry to become valid, so every page is
+ * faulted in exactly once no matter how many threads race for it.
+ */
+static unsigned int handle_miss(replay_thread *me, unsigned int pg)
+{
+  unsigned long hand, lap;
+  unsigned int frame, spins = 0;
+  long long since = 0;
+  int v, old;
+
+  for (;;) {
+    v = __atomic_load_n(&page_table[pg], __ATOMIC_ACQUIRE);
+    if (v > 0) {
+      if (since)
+        me->wait_ns += now_ns() - since;
+      return v - 1;
+    }
+    if (v == 0 &&
+        __atomic_compare_exchange_n(&page_table[pg], &v, PTE_LOCKED, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+    contended(me, &since, &spins);
+  }
+
+  me->faults++;
+  hand = __atomic_fetch_add(&next_frame, 1, __ATOMIC_RELAXED);
+  frame = hand % num_frames;
+  lap = hand / num_frames;
+
+  /*
+   * Whoever got this frame on the previous lap may not have mapped it
+   * yet. Wait for it, so the page evicted below is really the one in
+   * the frame and no two pages ever end up sharing it.
+   */
+  while (__atomic_load_n(&frame_lap[frame], __ATOMIC_ACQUIRE) != lap)
+    contended(me, &since, &spins);
+  if (since)
+    me->wait_ns += now_ns() - since;
+
+  /*
+   * Take the frame over. If another page owned it, unmap that page and
+   * shoot its translation down everywhere else.
+   */
+  old = frame_owner[frame];
+  frame_owner[frame] = pg + 1;
+  if (old) {
+    __atomic_store_n(&page_table[old - 1], 0, __ATOMIC_RELEASE);
+    me->evictions++;
+    shootdown(me, old - 1);
+  }
+
+  __atomic_store_n(&page_table[pg], frame + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&frame_lap[frame], lap + 1, __ATOMIC_RELEASE);
+  return frame;
+}
+
+static void *replay_thread_main(void *arg)
+{
+  replay_thread *me = (replay_thread *) arg;
+  vm_trace *t = me->trace;
+  uint64_t off_mask = ((uint64_t) 1 << page_size) - 1;
+  uint64_t frame;
+  unsigned int pg;
+  size_t i;
+  int r;
+
+  pthread_barrier_wait(&start_line);
+
+  for (r = 0; r < repeat; r++) {
+    for (i = 0; i < t->n; i++) {
+      if (__atomic_load_n(&me->flush_pending, __ATOMIC_RELAXED) &&
+          __atomic_exchange_n(&me->flush_pending, 0, __ATOMIC_ACQUIRE)) {
+        vm_tlb_flush(&me->tlb);
+        me->shootdowns_recv++;
+      }
+
+      pg = (unsigned int) (t->addr[i] >> page_size) & (num_pages - 1);
+      if (!vm_tlb_lookup(&me->tlb, pg, &frame)) {
+        frame = handle_miss(me, pg);
+        vm_tlb_insert(&me->tlb, pg, frame);
+      }
+      me->checksum += (frame << page_size) | (t->addr[i] & off_mask);
+    }
+  }
+  me->refs = (size_t) repeat * t->n;
+
+  return NULL;
+}
+
+/*
+ * Replay the first n traces with one thread each and print the totals.
+ * Returns the wall clock time of the replay in seconds.
+ */
+static double run_replay(vm_trace *traces, int n, unsigned int entries,
+                         unsigned int ways)
+{
+  struct timespec t0, t1;
+  size_t refs = 0, hits = 0, misses = 0, faults = 0, contention = 0;
+  size_t evictions = 0, sent = 0, recv = 0;
+  long long wait_ns = 0;
+  double secs;
+  int i;
+
+  memset(page_table, 0, (size_t) num_pages * sizeof(int));
+  memset(frame_owner, 0, (size_t) num_frames * sizeof(int));
+  memset(frame_lap, 0, (size_t) num_frames * sizeof(unsigned long));
+  next_frame = 0;
+  nthreads = n;
+
+  pthread_barrier_init(&start_line, NULL, n + 1);
+  for (i = 0; i < n; i++) {
+    memset(&threads[i], 0, sizeof(threads[i]));
+    threads[i].id = i;
+    threads[i].trace = &traces[i];
+    if (vm_tlb_init(&threads[i].tlb, entries, ways) != 0) {
+      fprintf(stderr, "Bad TLB geometry: %u entries, %u ways. Abort.\n",
+              entries, ways);
+      exit(-1);
+    }
+    pthread_create(&threads[i].thread, NULL, replay_thread_main, &threads[i]);
+  }
+
+  /* Main's arrival at the barrier is what releases the threads */
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  pthread_barrier_wait(&start_line);
+  for (i = 0; i < n; i++)
+    pthread_join(threads[i].thread, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  pthread_barrier_destroy(&start_line);
+
+  secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  for (i = 0; i < n; i++) {
+    replay_thread *th = &threads[i];
+
+    printf("Thread %d: References: %zu, TLB Hits: %zu, TLB Misses: %zu, "
+           "Faults: %zu, Contention: %zu, Shootdowns Received: %zu\n",
+           i, th->refs, th->tlb.hits, th->tlb.misses, th->faults,
+           th->contention, th->shootdowns_recv);
+    refs       += th->refs;
+    hits       += th->tlb.hits;
+    misses     += th->tlb.misses;
+    faults     += th->faults;
+    contention += th->contention;
+    wait_ns    += th->wait_ns;
+    evictions  += th->evictions;
+    sent       += th->shootdowns_sent;
+    recv       += th->shootdowns_recv;
+    vm_tlb_free(&th->tlb);
+  }
+
+  printf("Threads: %d, References: %zu, TLB Miss Rate: %.4f, Faults: %zu, "
+         "Evictions: %zu\n", n, refs, refs ? (double) misses / refs : 0.0,
+         faults, evictions);
+  printf("Fault Contention: %zu, Contention Wait: %.3f ms, "
+         "Shootdowns Sent: %zu, Shootdowns Received: %zu\n",
+         contention, wait_ns / 1e6, sent, recv);
+  printf("Time: %.6f s, Throughput: %.0f refs/s\n\n", secs,
+         secs > 0 ? refs / secs : 0.0);
+
+  return secs;
+}
+
+int main(int argc, char *argv[])
+{
+  vm_trace *traces;
+  unsigned int entries = 64, ways = 4;
+  int sweep = 0, opt, i, n;
+  FILE *in;
+
+  while ((opt = getopt(argc, argv, "e:w:r:S")) != -1) {
+    switch (opt) {
+    case 'e': entries = atoi(optarg); break;
+    case 'w': ways = atoi(optarg); break;
+    case 'r': repeat = atoi(optarg); break;
+    case 'S': sweep = 1; break;
+    default:
+      goto usage;
+    }
+  }
+
+  n = argc - optind;
+  if (n < 1 || n > MAX_THREADS || repeat < 1) {
+usage:
+    fprintf(stderr, "usage: VM_mt_replay [-e entries] [-w ways] [-r repeat] "
+            "[-S] trace...\n");
+    exit(-1);
+  }
+
+  /*
+   * Load every trace up front so file parsing is not part of the
+   * measured replay. All threads share one address space, so all the
+   * traces must agree on its geometry.
+   */
+  traces = (vm_trace *) calloc(n, sizeof(vm_trace));
+  for (i = 0; i < n; i++) {
+    if ((in = fopen(argv[optind + i], "r")) == NULL) {
+      perror(argv[optind + i]);
+      exit(-1);
+    }
+    vm_trace_load(in, &traces[i]);
+    fclose(in);
+
+    if (traces[i].log_size != traces[0].log_size ||
+        traces[i].phy_size != traces[0].phy_size ||
+        traces[i].page_size != traces[0].page_size) {
+      fprintf(stderr, "%s: memory characteristics differ from %s. Abort.\n",
+              argv[optind + i], argv[optind]);
+      exit(-1);
+    }
+  }
+
+  if (traces[0].log_size > 32 || traces[0].phy_size > 32 ||
+      traces[0].page_size > traces[0].log_size ||
+      traces[0].page_size > traces[0].phy_size) {
+    fprintf(stderr, "Unsupported address space geometry. Abort.\n");
+    exit(-1);
+  }
+
+  page_size  = traces[0].page_size;
+  num_pages  = 1u << (traces[0].log_size - page_size);
+  num_frames = 1u << (traces[0].phy_size - page_size);
+  page_table  = (int *) malloc((size_t) num_pages * sizeof(int));
+  frame_owner = (int *) malloc((size_t) num_frames * sizeof(int));
+  frame_lap   = (unsigned long *) malloc((size_t) num_frames *
+                                         sizeof(unsigned long));
+  if (page_table == NULL || frame_owner == NULL || frame_lap == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  printf("Number of Pages: %u, Number of Frames: %u, TLB: %u entries, %u ways\n\n",
+         num_pages, num_frames, entries, ways);
+
+  /*
+   * In sweep mode the replay is run with 1, 2, ... n threads so the
+   * throughput scaling can be read off the last lines.
+   */
+  if (sweep) {
+    double *secs = (double *) calloc(n, sizeof(double));
+    size_t refs = 0;
+
+    for (i = 1; i <= n; i++)
+      secs[i - 1] = run_replay(traces, i, entries, ways);
+
+    printf("Scaling:\n");
+    for (i = 1; i <= n; i++) {
+      refs += (size_t) repeat * traces[i - 1].n;
+      printf("Threads: %3d, Throughput: %12.0f refs/s, Speedup: %.2f\n", i,
+             refs / secs[i - 1],
+             (refs / secs[i - 1]) / ((size_t) repeat * traces[0].n / secs[0]));
+    }
+    free(secs);
+  } else {
+    run_replay(traces, n, entries, ways);
+  }
+
+  for (i = 0; i < n; i++)
+    vm_trace_free(&traces[i]);
+  free(traces);
+  free(page_table);
+  free(frame_owner);
+  free(frame_lap);
+  return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * Mixed page size translation: radix page-table walk plus TLB model.
+ *
+ * The trace header gives the base page size. A region file can map
+ * address ranges with larger pages, each one a base page times a power
+ * of RADIX_FANOUT (4 KiB base pages give 2 MiB and 1 GiB huge pages):
+ *
+ *   # start      end          page size
+ *   0x00000000   0x3fffffff   2^30
+ *   0x40000000   0x403fffff   2^21
+ *
+ * Huge pages are only used where the whole aligned page fits inside
+ * the region and overlaps no smaller page mapped before; elsewhere the
+ * next smaller size that fits is used. There
+ * is one set-associative TLB per page size, probed together as on
+ * x86-64. The trace is replayed once with the regions and once with
+ * base pages only, and the TLB misses, page walk references and page
+ * table memory of the two runs are compared.
+ *
+ * Usage: VM_pagewalk [-r regions] [-T log2size,entries,ways]... [trace]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vm_trace.h"
+#include "vm_tlb.h"
+#include "vm_radix.h"
+
+#define MAX_REGIONS  64
+#define MAX_LEVELS   8
+
+typedef struct region {
+  uint64_t     start;
+  uint64_t     end;         /* inclusive */
+  unsigned int shift;       /* log2 of the page size used in the region */
+} region;
+
+typedef struct tlb_config {
+  unsigned int entries;
+  unsigned int ways;
+} tlb_config;
+
+typedef struct walk_stats {
+  size_t refs;
+  size_t tlb_misses;
+  size_t walk_steps;        /* page table entries read by walks */
+  size_t faults[MAX_LEVELS];
+  size_t tlb_hits[MAX_LEVELS];
+  size_t pt_bytes;
+} walk_stats;
+
+static region     regions[MAX_REGIONS];
+static int        num_regions;
+static tlb_config tlb_geometry[MAX_LEVELS] = {
+  { 64, 4 },                /* base pages, e.g. 4 KiB */
+  { 32, 4 },                /* e.g. 2 MiB */
+  {  4, 4 },                /* e.g. 1 GiB */
+  {  4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }
+};
+
+/*
+ * Read the region file. Every page size must be a size the radix
+ * table can map as a leaf, and start/end may be anywhere.
+ */
+static void read_regions(const char *path, unsigned int base_shift)
+{
+  char line[MAXSTR];
+  unsigned long long start, end;
+  unsigned int d, shift;
+  FILE *f;
+  int lineno = 0;
+
+  if ((f = fopen(path, "r")) == NULL) {
+    perror(path);
+    exit(-1);
+  }
+  while (fgets(line, MAXSTR, f) != NULL) {
+    lineno++;
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+      continue;
+    if (sscanf(line, "%llx %llx %u^%u", &start, &end, &d, &shift) != 4 ||
+        d != 2 || end < start || shift < base_shift ||
+        (shift - base_shift) % RADIX_BITS ||
+        (shift - base_shift) / RADIX_BITS >= MAX_LEVELS) {
+      fprintf(stderr, "%s: unexpected line %d. Abort.\n", path, lineno);
+      exit(-1);
+    }
+    if (num_regions == MAX_REGIONS) {
+      fprintf(stderr, "%s: more than %d regions. Abort.\n", path, MAX_REGIONS);
+      exit(-1);
+    }
+    regions[num_regions].start = start;
+    regions[num_regions].end   = end;
+    regions[num_regions].shift = shift;
+    num_regions++;
+  }
+  fclose(f);
+}
+
+/*
+ * Page size to fault va in with: the largest size allowed by the first
+ * region containing va whose aligned page lies wholly in that region.
+ */
+static unsigned int page_shift_for(uint64_t va, int use_regions,
+                                   unsigned int base_shift)
+{
+  unsigned int shift;
+  uint64_t lo;
+  int i;
+
+  if (!use_regions)
+    return base_shift;
+
+  for (i = 0; i < num_regions; i++) {
+    if (va < regions[i].start || va > regions[i].end)
+      continue;
+    for (shift = regions[i].shift; shift > base_shift; shift -= RADIX_BITS) {
+      lo = va & ~((1ULL << shift) - 1);
+      if (lo >= regions[i].start && lo + ((1ULL << shift) - 1) <= regions[i].end)
+        return shift;
+    }
+    break;
+  }
+  return base_shift;
+}
+
+static void replay(vm_trace *t, int use_regions, walk_stats *st)
+{
+  vm_tlb tlb[MAX_LEVELS];
+  vm_radix pt;
+  unsigned int levels, lvl, shift, steps;
+  uint64_t va, frame, next_frame = 0, pages;
+  size_t i;
+  int hit;
+
+  memset(st, 0, sizeof(*st));
+  vm_radix_init(&pt, t->log_size, t->page_size);
+  levels = pt.levels < MAX_LEVELS ? pt.levels : MAX_LEVELS;
+
+  for (lvl = 0; lvl < levels; lvl++) {
+    if (vm_tlb_init(&tlb[lvl], tlb_geometry[lvl].entries,
+                    tlb_geometry[lvl].ways) != 0) {
+      fprintf(stderr, "Bad TLB geometry for 2^%u pages. Abort.\n",
+              t->page_size + RADIX_BITS * lvl);
+      exit(-1);
+    }
+  }
+
+  for (i = 0; i < t->n; i++) {
+    va = t->addr[i];
+    st->refs++;
+
+    /*
+     * All TLBs are probed in parallel; a hit in any of them will do. An
+     * entry holds the first frame of its page, and the base page's
+     * offset inside it comes from va.
+     */
+    hit = 0;
+    for (lvl = 0; lvl < levels && !hit; lvl++) {
+      if (vm_tlb_lookup(&tlb[lvl], va >> (t->page_size + RADIX_BITS * lvl),
+                        &frame)) {
+        frame += (va >> t->page_size) & ((1ULL << (RADIX_BITS * lvl)) - 1);
+        st->tlb_hits[lvl]++;
+        hit = 1;
+      }
+    }
+    if (hit)
+      continue;
+
+    st->tlb_misses++;
+    steps = 0;
+    if (!vm_radix_walk(&pt, va, &frame, &shift, &steps)) {
+      /*
+       * Page fault: hand out an aligned run of base frames big enough
+       * for the page, then walk again as the faulting access would. A
+       * huge page that would cover smaller pages already mapped (from
+       * overlapping regions) can't be installed; the next smaller size
+       * is tried instead, down to a base page, which always fits. Only
+       * the size that gets mapped uses up frames.
+       */
+      for (shift = page_shift_for(va, use_regions, t->page_size); ;
+           shift -= RADIX_BITS) {
+        pages = 1ULL << (shift - t->page_size);
+        frame = (next_frame + pages - 1) & ~(pages - 1);
+        if (vm_radix_map(&pt, va, shift, frame) == 0)
+          break;
+        if (shift == t->page_size) {
+          fprintf(stderr, "Can't map 0x%llx. Abort.\n", (unsigned long long) va);
+          exit(-1);
+        }
+      }
+      next_frame = frame + pages;
+      st->faults[(shift - t->page_size) / RADIX_BITS]++;
+      vm_radix_walk(&pt, va, &frame, &shift, &steps);
+    }
+    st->walk_steps += steps;
+
+    /* cache the page's first frame, not that of the base page in it */
+    lvl = (shift - t->page_size) / RADIX_BITS;
+    vm_tlb_insert(&tlb[lvl], va >> shift,
+                  frame - ((va >> t->page_size) &
+                           ((1ULL << (RADIX_BITS * lvl)) - 1)));
+  }
+
+  st->pt_bytes = vm_radix_bytes(&pt);
+  for (lvl = 0; lvl < levels; lvl++)
+    vm_tlb_free(&tlb[lvl]);
+  vm_radix_free(&pt);
+}
+
+static void print_stats(const char *name, walk_stats *st, unsigned int base_shift)
+{
+  unsigned int lvl;
+
+  printf("%s:\n", name);
+  printf("  References: %zu, TLB Misses: %zu (%.4f), Walk References: %zu\n",
+         st->refs, st->tlb_misses,
+         st->refs ? (double) st->tlb_misses / st->refs : 0.0, st->walk_steps);
+  for (lvl = 0; lvl < MAX_LEVELS; lvl++) {
+    if (st->faults[lvl] || st->tlb_hits[lvl])
+      printf("  2^%u pages: Faults: %zu, TLB Hits: %zu\n",
+             base_shift + RADIX_BITS * lvl, st->faults[lvl], st->tlb_hits[lvl]);
+  }
+  printf("  Page Table Memory: %zu bytes\n", st->pt_bytes);
+}
+
+static double reduction(size_t before, size_t after)
+{
+  return before ? 100.0 * ((double) before - after) / before : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+  vm_trace t;
+  walk_stats base, mixed;
+  const char *region_file = NULL;
+  unsigned int tlb_spec[MAX_LEVELS][3];
+  int num_specs = 0, opt, i;
+  FILE *in = stdin;
+
+  while ((opt = getopt(argc, argv, "r:T:")) != -1) {
+    switch (opt) {
+    case 'r':
+      region_file = optarg;
+      break;
+    case 'T':
+      if (num_specs < MAX_LEVELS &&
+          sscanf(optarg, "%u,%u,%u", &tlb_spec[num_specs][0],
+                 &tlb_spec[num_specs][1], &tlb_spec[num_specs][2]) == 3) {
+        num_specs++;
+        break;
+      }
+      /* fall through */
+    default:
+      fprintf(stderr, "usage: VM_pagewalk [-r regions] "
+              "[-T log2size,entries,ways]... [trace]\n");
+      exit(-1);
+    }
+  }
+  if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+    perror(argv[optind]);
+    exit(-1);
+  }
+
+  vm_trace_load(in, &t);
+  if (t.log_size > 64 || t.page_size >= t.log_size) {
+    fprintf(stderr, "Unsupported address space geometry. Abort.\n");
+    exit(-1);
+  }
+
+  /* TLB sizes are given per page size, which depends on the base size */
+  for (i = 0; i < num_specs; i++) {
+    if (tlb_spec[i][0] < t.page_size ||
+        (tlb_spec[i][0] - t.page_size) % RADIX_BITS ||
+        (tlb_spec[i][0] - t.page_size) / RADIX_BITS >= MAX_LEVELS) {
+      fprintf(stderr, "No 2^%u pages with a 2^%u base page. Abort.\n",
+              tlb_spec[i][0], t.page_size);
+      exit(-1);
+    }
+    tlb_geometry[(tlb_spec[i][0] - t.page_size) / RADIX_BITS].entries =
+      tlb_spec[i][1];
+    tlb_geometry[(tlb_spec[i][0] - t.page_size) / RADIX_BITS].ways =
+      tlb_spec[i][2];
+  }
+
+  if (region_file)
+    read_regions(region_file, t.page_size);
+
+  replay(&t, 0, &base);
+  replay(&t, 1, &mixed);
+
+  print_stats("Base pages only", &base, t.page_size);
+  print_stats("Mixed page sizes", &mixed, t.page_size);
+  printf("TLB Miss Reduction: %.2f%%, Walk Reference Reduction: %.2f%%, "
+         "Page Table Memory Reduction: %.2f%%\n",
+         reduction(base.tlb_misses, mixed.tlb_misses),
+         reduction(base.walk_steps, mixed.walk_steps),
+         reduction(base.pt_bytes, mixed.pt_bytes));
+
+  vm_trace_free(&t);
+  return 0;
+}
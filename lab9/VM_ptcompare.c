@@ -0,0 +1,230 @@
+/*
+ * Compare page table organizations on a (multi-process) trace.
+ *
+ * The same trace is replayed against three page tables:
+ *
+ *   radix     one multi-level table per process (vm_radix.c)
+ *   inverted  one entry per physical frame, hash anchor table (vm_hashpt.c)
+ *   hashed    (pid, vpn) keyed, clustered, open addressing (vm_hashpt.c)
+ *
+ * Physical memory holds 2^(P - K) frames and is replaced FIFO, so all
+ * three see exactly the same faults and evictions. For each one the
+ * entries touched per lookup, the table memory at the end of the run
+ * and the host time per lookup are reported.
+ *
+ * Usage: VM_ptcompare [trace]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm_trace.h"
+#include "vm_radix.h"
+#include "vm_hashpt.h"
+
+#define MAX_PROCS    64
+#define MAX_FRAMES   (1u << 26)
+
+enum { PT_RADIX, PT_INVERTED, PT_HASHED, PT_COUNT };
+
+static const char *pt_names[PT_COUNT] = { "radix", "inverted", "hashed" };
+
+typedef struct pt_stats {
+  size_t lookups;
+  size_t probes;
+  size_t max_probes;
+  size_t faults;
+  size_t bytes;
+  double secs;
+} pt_stats;
+
+/* The page tables under test */
+static vm_radix  radix[MAX_PROCS];
+static uint32_t  radix_pid[MAX_PROCS];
+static int       num_procs;
+static vm_ipt    ipt;
+static vm_hpt    hpt;
+
+/* FIFO replacement state shared by every scheme */
+static uint32_t *owner_pid;
+static uint64_t *owner_vpn;
+static uint32_t  num_frames;
+
+static vm_radix *radix_for(uint32_t pid, unsigned int log_size,
+                           unsigned int page_size)
+{
+  int i;
+
+  for (i = 0; i < num_procs; i++)
+    if (radix_pid[i] == pid)
+      return &radix[i];
+  if (num_procs == MAX_PROCS) {
+    fprintf(stderr, "More than %d processes in the trace. Abort.\n", MAX_PROCS);
+    exit(-1);
+  }
+  radix_pid[num_procs] = pid;
+  vm_radix_init(&radix[num_procs], log_size, page_size);
+  return &radix[num_procs++];
+}
+
+static int pt_lookup(int kind, vm_trace *t, uint32_t pid, uint64_t va,
+                     unsigned int *probes)
+{
+  uint64_t frame64;
+  uint32_t frame;
+  unsigned int shift;
+
+  switch (kind) {
+  case PT_RADIX:
+    return vm_radix_walk(radix_for(pid, t->log_size, t->page_size), va,
+                         &frame64, &shift, probes);
+  case PT_INVERTED:
+    return vm_ipt_lookup(&ipt, pid, va >> t->page_size, &frame, probes);
+  default:
+    return vm_hpt_lookup(&hpt, pid, va >> t->page_size, &frame, probes);
+  }
+}
+
+static void pt_map(int kind, vm_trace *t, uint32_t pid, uint64_t vpn,
+                   uint32_t frame)
+{
+  switch (kind) {
+  case PT_RADIX:
+    vm_radix_map(radix_for(pid, t->log_size, t->page_size),
+                 vpn << t->page_size, t->page_size, frame);
+    break;
+  case PT_INVERTED:
+    vm_ipt_map(&ipt, pid, vpn, frame);
+    break;
+  default:
+    vm_hpt_map(&hpt, pid, vpn, frame);
+  }
+}
+
+static void pt_unmap(int kind, vm_trace *t, uint32_t frame)
+{
+  switch (kind) {
+  case PT_RADIX:
+    vm_radix_unmap(radix_for(owner_pid[frame], t->log_size, t->page_size),
+                   owner_vpn[frame] << t->page_size, t->page_size);
+    break;
+  case PT_INVERTED:
+    vm_ipt_unmap(&ipt, frame);
+    break;
+  default:
+    vm_hpt_unmap(&hpt, owner_pid[frame], owner_vpn[frame]);
+  }
+}
+
+static void replay(int kind, vm_trace *t, pt_stats *st)
+{
+  struct timespec t0, t1;
+  unsigned int probes;
+  uint64_t hand = 0, vpn;
+  uint32_t pid, frame;
+  size_t i;
+  int p;
+
+  memset(st, 0, sizeof(*st));
+  num_procs = 0;
+  if (vm_ipt_init(&ipt, num_frames) != 0 || vm_hpt_init(&hpt, 16) != 0) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < t->n; i++) {
+    pid = t->pid[i];
+    probes = 0;
+    st->lookups++;
+    if (!pt_lookup(kind, t, pid, t->addr[i], &probes)) {
+      /* Page fault: take the oldest frame, evicting its page if needed */
+      vpn = t->addr[i] >> t->page_size;
+      frame = hand % num_frames;
+      if (hand++ >= num_frames)
+        pt_unmap(kind, t, frame);
+      owner_pid[frame] = pid;
+      owner_vpn[frame] = vpn;
+      pt_map(kind, t, pid, vpn, frame);
+      st->faults++;
+    }
+    st->probes += probes;
+    if (probes > st->max_probes)
+      st->max_probes = probes;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  st->secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  switch (kind) {
+  case PT_RADIX:
+    for (p = 0; p < num_procs; p++)
+      st->bytes += vm_radix_bytes(&radix[p]);
+    break;
+  case PT_INVERTED:
+    st->bytes = vm_ipt_bytes(&ipt);
+    break;
+  default:
+    st->bytes = vm_hpt_bytes(&hpt);
+  }
+
+  for (p = 0; p < num_procs; p++)
+    vm_radix_free(&radix[p]);
+  vm_ipt_free(&ipt);
+  vm_hpt_free(&hpt);
+}
+
+int main(int argc, char *argv[])
+{
+  vm_trace t;
+  pt_stats st[PT_COUNT];
+  FILE *in = stdin;
+  int kind, procs = 1;
+
+  if (argc > 2) {
+    fprintf(stderr, "usage: VM_ptcompare [trace]\n");
+    exit(-1);
+  }
+  if (argc == 2 && (in = fopen(argv[1], "r")) == NULL) {
+    perror(argv[1]);
+    exit(-1);
+  }
+
+  vm_trace_load(in, &t);
+  if (t.log_size > 64 || t.page_size >= t.log_size ||
+      t.page_size > t.phy_size || t.phy_size - t.page_size > 26) {
+    fprintf(stderr, "Unsupported address space geometry (at most %u frames). "
+            "Abort.\n", MAX_FRAMES);
+    exit(-1);
+  }
+
+  num_frames = 1u << (t.phy_size - t.page_size);
+  owner_pid = (uint32_t *) calloc(num_frames, sizeof(uint32_t));
+  owner_vpn = (uint64_t *) calloc(num_frames, sizeof(uint64_t));
+  if (owner_pid == NULL || owner_vpn == NULL) {
+    perror("calloc");
+    exit(-1);
+  }
+
+  for (kind = 0; kind < PT_COUNT; kind++) {
+    replay(kind, &t, &st[kind]);
+    if (kind == PT_RADIX)
+      procs = num_procs;
+  }
+
+  printf("References: %zu, Page Faults: %zu, Processes: %d, Frames: %u\n\n",
+         t.n, st[0].faults, procs, num_frames);
+  printf("%-10s %12s %12s %14s %12s\n", "Table", "Avg Probes", "Max Probes",
+         "Table Bytes", "ns/Lookup");
+  for (kind = 0; kind < PT_COUNT; kind++)
+    printf("%-10s %12.3f %12zu %14zu %12.1f\n", pt_names[kind],
+           st[kind].lookups ? (double) st[kind].probes / st[kind].lookups : 0.0,
+           st[kind].max_probes, st[kind].bytes,
+           st[kind].lookups ? 1e9 * st[kind].secs / st[kind].lookups : 0.0);
+
+  vm_trace_free(&t);
+  free(owner_pid);
+  free(owner_vpn);
+  return 0;
+}
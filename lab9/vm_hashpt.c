@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm_hashpt.h"
+
+static inline uint64_t hash_key(uint32_t pid, uint64_t x)
+{
+  /* splitmix64 finalizer over the pid-salted key */
+  x ^= (uint64_t) pid * 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/*
+ * Inverted page table. The anchor table has a power of two number of
+ * slots, at least one per frame, so chains stay about one entry long.
+ */
+int vm_ipt_init(vm_ipt *t, uint32_t num_frames)
+{
+  uint32_t slots;
+
+  memset(t, 0, sizeof(*t));
+  for (slots = 1; slots < num_frames; slots *= 2)
+    ;
+
+  t->num_frames  = num_frames;
+  t->anchor_mask = slots - 1;
+  t->anchor = (uint32_t *) malloc(slots * sizeof(uint32_t));
+  t->frame  = (vm_ipt_entry *) calloc(num_frames, sizeof(vm_ipt_entry));
+  t->used   = (unsigned char *) calloc(num_frames, 1);
+  if (t->anchor == NULL || t->frame == NULL || t->used == NULL)
+    return -1;
+  memset(t->anchor, 0xff, slots * sizeof(uint32_t));
+  return 0;
+}
+
+int vm_ipt_lookup(vm_ipt *t, uint32_t pid, uint64_t vpn, uint32_t *frame,
+                  unsigned int *probes)
+{
+  uint32_t f;
+
+  (*probes)++;              /* the anchor table slot */
+  f = t->anchor[hash_key(pid, vpn) & t->anchor_mask];
+  while (f != HPT_NONE) {
+    (*probes)++;
+    if (t->frame[f].pid == pid && t->frame[f].vpn == vpn) {
+      *frame = f;
+      return 1;
+    }
+    f = t->frame[f].next;
+  }
+  return 0;
+}
+
+/* The frame must be free: unmap whatever it held first */
+void vm_ipt_map(vm_ipt *t, uint32_t pid, uint64_t vpn, uint32_t frame)
+{
+  uint32_t *head = &t->anchor[hash_key(pid, vpn) & t->anchor_mask];
+
+  t->frame[frame].pid  = pid;
+  t->frame[frame].vpn  = vpn;
+  t->frame[frame].next = *head;
+  t->used[frame] = 1;
+  *head = frame;
+}
+
+void vm_ipt_unmap(vm_ipt *t, uint32_t frame)
+{
+  vm_ipt_entry *e = &t->frame[frame];
+  uint32_t *link;
+
+  if (!t->used[frame])
+    return;
+
+  link = &t->anchor[hash_key(e->pid, e->vpn) & t->anchor_mask];
+  while (*link != frame)
+    link = &t->frame[*link].next;
+  *link = e->next;
+  t->used[frame] = 0;
+}
+
+/* Fixed by the size of physical memory, however sparse the mappings */
+size_t vm_ipt_bytes(vm_ipt *t)
+{
+  return (size_t) t->num_frames * sizeof(vm_ipt_entry) +
+         ((size_t) t->anchor_mask + 1) * sizeof(uint32_t);
+}
+
+void vm_ipt_free(vm_ipt *t)
+{
+  free(t->anchor);
+  free(t->frame);
+  free(t->used);
+  memset(t, 0, sizeof(*t));
+}
+
+/*
+ * Hashed page table. Entry slots are free when valid == 0. The table
+ * doubles when it is three quarters full to keep probe runs short.
+ */
+int vm_hpt_init(vm_hpt *t, size_t cap)
+{
+  size_t c;
+
+  for (c = 16; c < cap; c *= 2)
+    ;
+  t->cap  = c;
+  t->used = 0;
+  t->e = (vm_hpt_entry *) calloc(c, sizeof(vm_hpt_entry));
+  return t->e ? 0 : -1;
+}
+
+static vm_hpt_entry *hpt_find(vm_hpt *t, uint32_t pid, uint64_t block,
+                              unsigned int *probes)
+{
+  size_t i = hash_key(pid, block) & (t->cap - 1);
+
+  for (;;) {
+    (*probes)++;
+    if (t->e[i].valid == 0)
+      return &t->e[i];
+    if (t->e[i].pid == pid && t->e[i].block == block)
+      return &t->e[i];
+    i = (i + 1) & (t->cap - 1);
+  }
+}
+
+int vm_hpt_lookup(vm_hpt *t, uint32_t pid, uint64_t vpn, uint32_t *frame,
+                  unsigned int *probes)
+{
+  vm_hpt_entry *e = hpt_find(t, pid, vpn >> HPT_CLUSTER_BITS, probes);
+  unsigned int sub = vpn & (HPT_CLUSTER - 1);
+
+  if (e->valid & (1u << sub)) {
+    *frame = e->frame[sub];
+    return 1;
+  }
+  return 0;
+}
+
+static void hpt_grow(vm_hpt *t)
+{
+  vm_hpt old = *t;
+  vm_hpt_entry *e;
+  unsigned int probes = 0;
+  size_t i;
+
+  vm_hpt_init(t, old.cap * 2);
+  if (t->e == NULL) {
+    perror("calloc");
+    exit(-1);
+  }
+  for (i = 0; i < old.cap; i++) {
+    if (old.e[i].valid == 0)
+      continue;
+    e = hpt_find(t, old.e[i].pid, old.e[i].block, &probes);
+    *e = old.e[i];
+    t->used++;
+  }
+  free(old.e);
+}
+
+void vm_hpt_map(vm_hpt *t, uint32_t pid, uint64_t vpn, uint32_t frame)
+{
+  vm_hpt_entry *e;
+  unsigned int probes = 0, sub = vpn & (HPT_CLUSTER - 1);
+
+  if (4 * (t->used + 1) > 3 * t->cap)
+    hpt_grow(t);
+
+  e = hpt_find(t, pid, vpn >> HPT_CLUSTER_BITS, &probes);
+  if (e->valid == 0) {
+    e->pid = pid;
+    e->block = vpn >> HPT_CLUSTER_BITS;
+    t->used++;
+  }
+  e->valid |= 1u << sub;
+  e->frame[sub] = frame;
+}
+
+/*
+ * Clear one page of a cluster. When the cluster empties its slot is
+ * freed with backward-shift deletion, so linear probing needs no
+ * tombstones and lookups never get slower as pages come and go.
+ */
+void vm_hpt_unmap(vm_hpt *t, uint32_t pid, uint64_t vpn)
+{
+  unsigned int probes = 0;
+  vm_hpt_entry *e = hpt_find(t, pid, vpn >> HPT_CLUSTER_BITS, &probes);
+  size_t hole, i, home;
+
+  if (e->valid == 0)
+    return;
+  e->valid &= ~(1u << (vpn & (HPT_CLUSTER - 1)));
+  if (e->valid)
+    return;
+
+  t->used--;
+  hole = e - t->e;
+  for (i = (hole + 1) & (t->cap - 1); t->e[i].valid; i = (i + 1) & (t->cap - 1)) {
+    home = hash_key(t->e[i].pid, t->e[i].block) & (t->cap - 1);
+    /* move i into the hole unless its home lies cyclically in (hole, i] */
+    if (((i - home) & (t->cap - 1)) >= ((i - hole) & (t->cap - 1))) {
+      t->e[hole] = t->e[i];
+      t->e[i].valid = 0;
+      hole = i;
+    }
+  }
+}
+
+size_t vm_hpt_bytes(vm_hpt *t)
+{
+  return t->cap * sizeof(vm_hpt_entry);
+}
+
+void vm_hpt_free(vm_hpt *t)
+{
+  free(t->e);
+  memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,68 @@
+/*
+ * Page tables whose size follows physical memory or the number of
+ * mapped pages rather than the virtual address space:
+ *
+ *  - vm_ipt: inverted page table, one entry per physical frame, found
+ *    through a hash anchor table and chained by frame number.
+ *  - vm_hpt: hashed page table keyed by (pid, vpn) with clustered
+ *    entries; each entry maps HPT_CLUSTER consecutive pages and the
+ *    entries live in one open addressing array with linear probing.
+ *
+ * Lookups count the entries they touch in *probes, which is the memory
+ * reference count a hardware or software walker would pay.
+ */
+
+#ifndef VM_HASHPT_H_
+#define VM_HASHPT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HPT_CLUSTER_BITS 3
+#define HPT_CLUSTER      (1 << HPT_CLUSTER_BITS)
+#define HPT_NONE         UINT32_MAX
+
+typedef struct vm_ipt_entry {
+  uint64_t vpn;
+  uint32_t pid;
+  uint32_t next;            /* next frame on the hash chain, HPT_NONE ends it */
+} vm_ipt_entry;
+
+typedef struct vm_ipt {
+  uint32_t      num_frames;
+  uint32_t      anchor_mask;
+  uint32_t     *anchor;     /* hash -> first frame on the chain */
+  vm_ipt_entry *frame;      /* indexed by frame number */
+  unsigned char *used;
+} vm_ipt;
+
+typedef struct vm_hpt_entry {
+  uint64_t block;           /* vpn >> HPT_CLUSTER_BITS */
+  uint32_t pid;
+  uint32_t valid;           /* bitmap of mapped pages in the cluster */
+  uint32_t frame[HPT_CLUSTER];
+} vm_hpt_entry;
+
+typedef struct vm_hpt {
+  size_t        cap;        /* power of two */
+  size_t        used;       /* entries with any valid page */
+  vm_hpt_entry *e;
+} vm_hpt;
+
+int    vm_ipt_init  (vm_ipt *t, uint32_t num_frames);
+int    vm_ipt_lookup(vm_ipt *t, uint32_t pid, uint64_t vpn, uint32_t *frame,
+                     unsigned int *probes);
+void   vm_ipt_map   (vm_ipt *t, uint32_t pid, uint64_t vpn, uint32_t frame);
+void   vm_ipt_unmap (vm_ipt *t, uint32_t frame);
+size_t vm_ipt_bytes (vm_ipt *t);
+void   vm_ipt_free  (vm_ipt *t);
+
+int    vm_hpt_init  (vm_hpt *t, size_t cap);
+int    vm_hpt_lookup(vm_hpt *t, uint32_t pid, uint64_t vpn, uint32_t *frame,
+                     unsigned int *probes);
+void   vm_hpt_map   (vm_hpt *t, uint32_t pid, uint64_t vpn, uint32_t frame);
+void   vm_hpt_unmap (vm_hpt *t, uint32_t pid, uint64_t vpn);
+size_t vm_hpt_bytes (vm_hpt *t);
+void   vm_hpt_free  (vm_hpt *t);
+
+#endif /* VM_HASHPT_H_ */
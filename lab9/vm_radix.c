@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vm_radix.h"
+
+static vm_radix_node *node_alloc(vm_radix *r)
+{
+  vm_radix_node *n = (vm_radix_node *) calloc(1, sizeof(vm_radix_node));
+
+  if (n == NULL) {
+    perror("calloc");
+    exit(-1);
+  }
+  r->nodes++;
+  return n;
+}
+
+static inline unsigned int level_index(vm_radix *r, uint64_t va,
+                                       unsigned int level)
+{
+  return (va >> (r->base_shift + RADIX_BITS * level)) & (RADIX_FANOUT - 1);
+}
+
+void vm_radix_init(vm_radix *r, unsigned int va_bits, unsigned int base_shift)
+{
+  r->base_shift = base_shift;
+  r->levels = va_bits > base_shift ?
+              (va_bits - base_shift + RADIX_BITS - 1) / RADIX_BITS : 1;
+  r->nodes = 0;
+  r->root = node_alloc(r);
+}
+
+/*
+ * Walk the table for va. On success the frame number (in base pages)
+ * of the base page holding va, inside a huge page or not, and the log2
+ * size of the page that maps va are returned through frame and shift,
+ * and 1 is returned. The huge page itself starts at frame minus the
+ * low (shift - base_shift) bits of va's base page number. steps is incremented once per
+ * table entry read, i.e. per memory reference of a hardware walk.
+ */
+int vm_radix_walk(vm_radix *r, uint64_t va, uint64_t *frame,
+                  unsigned int *shift, unsigned int *steps)
+{
+  vm_radix_node *n = r->root;
+  unsigned int level = r->levels, i;
+
+  while (level-- > 0) {
+    i = level_index(r, va, level);
+    (*steps)++;
+    if (n->leaf[i]) {
+      *shift = r->base_shift + RADIX_BITS * level;
+      /* the frame of the base page inside the (possibly huge) page */
+      *frame = n->leaf[i] - 1 +
+               ((va >> r->base_shift) & ((1ULL << (RADIX_BITS * level)) - 1));
+      return 1;
+    }
+    if ((n = n->child[i]) == NULL)
+      return 0;
+  }
+  return 0;
+}
+
+/*
+ * Map the page of size 2^shift containing va to the run of base frames
+ * starting at frame. Returns -1 if shift is not a size the table can
+ * hold or if a mapping already covers part of the page.
+ */
+int vm_radix_map(vm_radix *r, uint64_t va, unsigned int shift, uint64_t frame)
+{
+  vm_radix_node *n = r->root;
+  unsigned int leaf_level, level, i;
+
+  if (shift < r->base_shift || (shift - r->base_shift) % RADIX_BITS)
+    return -1;
+  leaf_level = (shift - r->base_shift) / RADIX_BITS;
+  if (leaf_level >= r->levels)
+    return -1;
+
+  for (level = r->levels - 1; level > leaf_level; level--) {
+    i = level_index(r, va, level);
+    if (n->leaf[i])
+      return -1;
+    if (n->child[i] == NULL)
+      n->child[i] = node_alloc(r);
+    n = n->child[i];
+  }
+
+  i = level_index(r, va, leaf_level);
+  if (n->leaf[i] || n->child[i])
+    return -1;
+  n->leaf[i] = frame + 1;
+  return 0;
+}
+
+/*
+ * Remove the mapping of size 2^shift containing va. Emptied table pages
+ * are not freed, just as most kernels keep them around.
+ */
+void vm_radix_unmap(vm_radix *r, uint64_t va, unsigned int shift)
+{
+  vm_radix_node *n = r->root;
+  unsigned int leaf_level = (shift - r->base_shift) / RADIX_BITS;
+  unsigned int level;
+
+  for (level = r->levels - 1; level > leaf_level; level--)
+    if ((n = n->child[level_index(r, va, level)]) == NULL)
+      return;
+  n->leaf[level_index(r, va, leaf_level)] = 0;
+}
+
+/*
+ * Memory taken by the modeled table: one RADIX_FANOUT-entry page of
+ * RADIX_PTE_SIZE-byte entries per node.
+ */
+size_t vm_radix_bytes(vm_radix *r)
+{
+  return r->nodes * RADIX_FANOUT * RADIX_PTE_SIZE;
+}
+
+static void node_free(vm_radix_node *n)
+{
+  unsigned int i;
+
+  for (i = 0; i < RADIX_FANOUT; i++)
+    if (n->child[i])
+      node_free(n->child[i]);
+  free(n);
+}
+
+void vm_radix_free(vm_radix *r)
+{
+  if (r->root)
+    node_free(r->root);
+  r->root = NULL;
+  r->nodes = 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Multi-level (radix) page table in the style of x86-64: every level
+ * translates RADIX_BITS bits of the page number, and a mapping can be
+ * installed as a leaf at any level, giving pages of
+ * 2^(base + RADIX_BITS * level) bytes (4 KiB, 2 MiB, 1 GiB, ...).
+ */
+
+#ifndef VM_RADIX_H_
+#define VM_RADIX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RADIX_BITS    9
+#define RADIX_FANOUT  (1 << RADIX_BITS)
+#define RADIX_PTE_SIZE 8    /* bytes per entry in the modeled table */
+
+typedef struct vm_radix_node {
+  struct vm_radix_node *child[RADIX_FANOUT];
+  uint64_t              leaf[RADIX_FANOUT];  /* frame + 1, 0 if no leaf */
+} vm_radix_node;
+
+typedef struct vm_radix {
+  unsigned int   base_shift;  /* log2 of the base page size */
+  unsigned int   levels;      /* levels needed for the address space */
+  vm_radix_node *root;
+  size_t         nodes;       /* table pages allocated, root included */
+} vm_radix;
+
+void   vm_radix_init (vm_radix *r, unsigned int va_bits, unsigned int base_shift);
+int    vm_radix_walk (vm_radix *r, uint64_t va, uint64_t *frame,
+                      unsigned int *shift, unsigned int *steps);
+int    vm_radix_map  (vm_radix *r, uint64_t va, unsigned int shift,
+                      uint64_t frame);
+void   vm_radix_unmap(vm_radix *r, uint64_t va, unsigned int shift);
+size_t vm_radix_bytes(vm_radix *r);
+void   vm_radix_free (vm_radix *r);
+
+#endif /* VM_RADIX_H_ */
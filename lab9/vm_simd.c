@@ -0,0 +1,186 @@
+#include <string.h>
+#include <immintrin.h>
+
+#include "vm_simd.h"
+
+/*
+ * Set up the translation state. The masks are the ones VM_addr_map has
+ * always used, so batch output matches the streaming output bit for bit.
+ */
+void vm_xlate_init(vm_xlate *x, unsigned int log_size, unsigned int page_size,
+                   int *page_table, int *mem_map, unsigned int num_frames)
+{
+  memset(x, 0, sizeof(*x));
+  x->page_size  = page_size;
+  x->off_mask   = 0xFFFFFFFF >> (log_size - page_size);
+  x->page_mask  = 0xFFFFFFFF << page_size;
+  x->page_table = page_table;
+  x->mem_map    = mem_map;
+  x->num_frames = num_frames;
+}
+
+/*
+ * Translate a single address, faulting the page in if needed. This is
+ * the slow path every vector kernel falls back to.
+ */
+static inline void xlate_one(vm_xlate *x, uint32_t a, size_t i,
+                             uint32_t *page, uint32_t *frame, uint32_t *phys,
+                             unsigned char *fault)
+{
+  uint32_t off, pg;
+  int f;
+
+  off = a & x->off_mask;
+  pg  = (a & x->page_mask) >> x->page_size;
+
+  f = x->page_table[pg];
+  fault[i] = (f == 0);
+  if (f == 0) {
+    if (x->next_frame < x->num_frames)
+      x->mem_map[x->next_frame] = off;
+    f = ++x->next_frame;
+    x->page_table[pg] = f;
+    x->faults++;
+  }
+
+  page[i]  = pg;
+  frame[i] = f - 1;
+  phys[i]  = ((uint32_t)(f - 1) << x->page_size) | off;
+}
+
+void vm_translate_scalar(vm_xlate *x, const uint32_t *addr, size_t n,
+                         uint32_t *page, uint32_t *frame, uint32_t *phys,
+                         unsigned char *fault)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    xlate_one(x, addr[i], i, page, frame, phys, fault);
+}
+
+/*
+ * SSE4.1: split four addresses at a time and build the physical
+ * addresses in vector registers. There is no gather before AVX2, so
+ * the page table reads are scalar and get inserted lane by lane.
+ */
+__attribute__((target("sse4.1")))
+void vm_translate_sse4(vm_xlate *x, const uint32_t *addr, size_t n,
+                       uint32_t *page, uint32_t *frame, uint32_t *phys,
+                       unsigned char *fault)
+{
+  __m128i offm  = _mm_set1_epi32(x->off_mask);
+  __m128i pgm   = _mm_set1_epi32(x->page_mask);
+  __m128i one   = _mm_set1_epi32(1);
+  __m128i shift = _mm_cvtsi32_si128(x->page_size);
+  uint32_t pg[4];
+  size_t i, j;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128i a   = _mm_loadu_si128((const __m128i *) &addr[i]);
+    __m128i off = _mm_and_si128(a, offm);
+    __m128i p   = _mm_srl_epi32(_mm_and_si128(a, pgm), shift);
+    __m128i f, fr;
+
+    _mm_storeu_si128((__m128i *) pg, p);
+
+    /*
+     * Any non-resident page sends the block to the scalar path, which
+     * takes the faults in trace order.
+     */
+    if (x->page_table[pg[0]] == 0 || x->page_table[pg[1]] == 0 ||
+        x->page_table[pg[2]] == 0 || x->page_table[pg[3]] == 0) {
+      for (j = i; j < i + 4; j++)
+        xlate_one(x, addr[j], j, page, frame, phys, fault);
+      continue;
+    }
+
+    f = _mm_cvtsi32_si128(x->page_table[pg[0]]);
+    f = _mm_insert_epi32(f, x->page_table[pg[1]], 1);
+    f = _mm_insert_epi32(f, x->page_table[pg[2]], 2);
+    f = _mm_insert_epi32(f, x->page_table[pg[3]], 3);
+    fr = _mm_sub_epi32(f, one);
+
+    _mm_storeu_si128((__m128i *) &page[i], p);
+    _mm_storeu_si128((__m128i *) &frame[i], fr);
+    _mm_storeu_si128((__m128i *) &phys[i],
+                     _mm_or_si128(_mm_sll_epi32(fr, shift), off));
+    memset(&fault[i], 0, 4);
+  }
+
+  for (; i < n; i++)
+    xlate_one(x, addr[i], i, page, frame, phys, fault);
+}
+
+/*
+ * AVX2: split eight addresses per instruction and gather their page
+ * table entries. Lanes ahead of the first fault keep the vector result;
+ * from the first fault on the block is finished by the scalar path,
+ * since a later lane may hit the page an earlier lane just faulted in.
+ */
+__attribute__((target("avx2")))
+void vm_translate_avx2(vm_xlate *x, const uint32_t *addr, size_t n,
+                       uint32_t *page, uint32_t *frame, uint32_t *phys,
+                       unsigned char *fault)
+{
+  __m256i offm  = _mm256_set1_epi32(x->off_mask);
+  __m256i pgm   = _mm256_set1_epi32(x->page_mask);
+  __m256i one   = _mm256_set1_epi32(1);
+  __m256i zero  = _mm256_setzero_si256();
+  __m128i shift = _mm_cvtsi32_si128(x->page_size);
+  size_t i, j;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i a   = _mm256_loadu_si256((const __m256i *) &addr[i]);
+    __m256i off = _mm256_and_si256(a, offm);
+    __m256i p   = _mm256_srl_epi32(_mm256_and_si256(a, pgm), shift);
+    __m256i f   = _mm256_i32gather_epi32(x->page_table, p, 4);
+    __m256i fr  = _mm256_sub_epi32(f, one);
+    int miss    = _mm256_movemask_ps(_mm256_castsi256_ps(
+                                       _mm256_cmpeq_epi32(f, zero)));
+
+    _mm256_storeu_si256((__m256i *) &page[i], p);
+    _mm256_storeu_si256((__m256i *) &frame[i], fr);
+    _mm256_storeu_si256((__m256i *) &phys[i],
+                        _mm256_or_si256(_mm256_sll_epi32(fr, shift), off));
+    memset(&fault[i], 0, 8);
+
+    if (miss) {
+      for (j = i + __builtin_ctz(miss); j < i + 8; j++)
+        xlate_one(x, addr[j], j, page, frame, phys, fault);
+    }
+  }
+
+  for (; i < n; i++)
+    xlate_one(x, addr[i], i, page, frame, phys, fault);
+}
+
+/*
+ * Pick a kernel. With name == NULL (or "auto") the widest one the CPU
+ * supports is used; otherwise the named kernel is forced, provided the
+ * CPU can run it. The name of the kernel returned is stored in *chosen.
+ */
+vm_kernel_fn vm_kernel_select(const char *name, const char **chosen)
+{
+  int avx2, sse4;
+
+  __builtin_cpu_init();
+  avx2 = __builtin_cpu_supports("avx2");
+  sse4 = __builtin_cpu_supports("sse4.1");
+
+  if (name == NULL || strcmp(name, "auto") == 0)
+    name = avx2 ? "avx2" : sse4 ? "sse4" : "scalar";
+
+  if (strcmp(name, "avx2") == 0 && avx2) {
+    *chosen = "avx2";
+    return vm_translate_avx2;
+  }
+  if (strcmp(name, "sse4") == 0 && sse4) {
+    *chosen = "sse4";
+    return vm_translate_sse4;
+  }
+  if (strcmp(name, "scalar") == 0) {
+    *chosen = "scalar";
+    return vm_translate_scalar;
+  }
+  return NULL;
+}
@@ -0,0 +1,52 @@
+/*
+ * Batch address translation kernels for VM_addr_map.
+ *
+ * Every kernel produces exactly the same results as the scalar
+ * translator in VM_addr_map.c: pages are given frames in the order in
+ * which they first fault, and page_table[] holds frame + 1 (0 means
+ * the page is not resident).
+ */
+
+#ifndef VM_SIMD_H_
+#define VM_SIMD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct vm_xlate {
+  unsigned int page_size;   /* log2 of the page size */
+  uint32_t     off_mask;    /* selects the offset bits */
+  uint32_t     page_mask;   /* selects the page number bits */
+  int         *page_table;  /* page -> frame + 1, 0 if not resident */
+  int         *mem_map;     /* frame -> offset that faulted it in */
+  unsigned int num_frames;  /* length of mem_map[] */
+  unsigned int next_frame;  /* next frame handed out on a fault */
+  size_t       faults;      /* running page fault count */
+} vm_xlate;
+
+/*
+ * Translate n addresses. For address i the page number, frame number
+ * and physical address are stored in page[i], frame[i] and phys[i];
+ * fault[i] is set when the access faulted the page in.
+ */
+typedef void (*vm_kernel_fn)(vm_xlate *x, const uint32_t *addr, size_t n,
+                             uint32_t *page, uint32_t *frame, uint32_t *phys,
+                             unsigned char *fault);
+
+void         vm_xlate_init   (vm_xlate *x, unsigned int log_size,
+                              unsigned int page_size, int *page_table,
+                              int *mem_map, unsigned int num_frames);
+
+vm_kernel_fn vm_kernel_select(const char *name, const char **chosen);
+
+void vm_translate_scalar(vm_xlate *x, const uint32_t *addr, size_t n,
+                         uint32_t *page, uint32_t *frame, uint32_t *phys,
+                         unsigned char *fault);
+void vm_translate_sse4  (vm_xlate *x, const uint32_t *addr, size_t n,
+                         uint32_t *page, uint32_t *frame, uint32_t *phys,
+                         unsigned char *fault);
+void vm_translate_avx2  (vm_xlate *x, const uint32_t *addr, size_t n,
+                         uint32_t *page, uint32_t *frame, uint32_t *phys,
+                         unsigned char *fault);
+
+#endif /* VM_SIMD_H_ */
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm_tlb.h"
+
+/*
+ * Create a TLB with the given number of entries and associativity.
+ * entries / ways is rounded down to a power of two so the set index is
+ * just the low bits of the page number. Returns -1 on bad geometry.
+ */
+int vm_tlb_init(vm_tlb *t, unsigned int entries, unsigned int ways)
+{
+  unsigned int sets;
+
+  memset(t, 0, sizeof(*t));
+  if (ways == 0 || entries < ways)
+    return -1;
+
+  for (sets = 1; sets * 2 <= entries / ways; sets *= 2)
+    ;
+
+  t->sets = sets;
+  t->ways = ways;
+  t->e = (vm_tlb_entry *) calloc((size_t) sets * ways, sizeof(vm_tlb_entry));
+  return t->e ? 0 : -1;
+}
+
+static inline vm_tlb_entry *tlb_set(vm_tlb *t, uint64_t vpn)
+{
+  return &t->e[(vpn & (t->sets - 1)) * t->ways];
+}
+
+/*
+ * Look vpn up. On a hit the frame is stored in *frame and 1 is
+ * returned; a miss returns 0. Hit and miss counts are kept here.
+ */
+int vm_tlb_lookup(vm_tlb *t, uint64_t vpn, uint64_t *frame)
+{
+  vm_tlb_entry *s = tlb_set(t, vpn);
+  unsigned int i;
+
+  for (i = 0; i < t->ways; i++) {
+    if (s[i].last_use && s[i].vpn == vpn) {
+      s[i].last_use = ++t->clock;
+      *frame = s[i].frame;
+      t->hits++;
+      return 1;
+    }
+  }
+  t->misses++;
+  return 0;
+}
+
+/*
+ * Install a translation, replacing an invalid or the least recently
+ * used entry of the set.
+ */
+void vm_tlb_insert(vm_tlb *t, uint64_t vpn, uint64_t frame)
+{
+  vm_tlb_entry *s = tlb_set(t, vpn);
+  vm_tlb_entry *victim = &s[0];
+  unsigned int i;
+
+  for (i = 0; i < t->ways; i++) {
+    if (s[i].last_use == 0 || s[i].vpn == vpn) {
+      victim = &s[i];
+      break;
+    }
+    if (s[i].last_use < victim->last_use)
+      victim = &s[i];
+  }
+
+  victim->vpn = vpn;
+  victim->frame = frame;
+  victim->last_use = ++t->clock;
+}
+
+void vm_tlb_invalidate(vm_tlb *t, uint64_t vpn)
+{
+  vm_tlb_entry *s = tlb_set(t, vpn);
+  unsigned int i;
+
+  for (i = 0; i < t->ways; i++)
+    if (s[i].vpn == vpn)
+      s[i].last_use = 0;
+}
+
+void vm_tlb_flush(vm_tlb *t)
+{
+  memset(t->e, 0, (size_t) t->sets * t->ways * sizeof(vm_tlb_entry));
+  t->flushes++;
+}
+
+void vm_tlb_free(vm_tlb *t)
+{
+  free(t->e);
+  t->e = NULL;
+}
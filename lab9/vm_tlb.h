@@ -0,0 +1,34 @@
+/*
+ * Set-associative TLB model with LRU replacement within a set.
+ */
+
+#ifndef VM_TLB_H_
+#define VM_TLB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct vm_tlb_entry {
+  uint64_t vpn;             /* virtual page number (the tag) */
+  uint64_t frame;           /* physical frame it maps to */
+  uint64_t last_use;        /* LRU stamp, 0 means the entry is invalid */
+} vm_tlb_entry;
+
+typedef struct vm_tlb {
+  unsigned int  sets;       /* number of sets, a power of two */
+  unsigned int  ways;       /* entries per set */
+  uint64_t      clock;      /* source of LRU stamps */
+  vm_tlb_entry *e;          /* sets * ways entries, set-major */
+  size_t        hits;
+  size_t        misses;
+  size_t        flushes;
+} vm_tlb;
+
+int  vm_tlb_init      (vm_tlb *t, unsigned int entries, unsigned int ways);
+int  vm_tlb_lookup    (vm_tlb *t, uint64_t vpn, uint64_t *frame);
+void vm_tlb_insert    (vm_tlb *t, uint64_t vpn, uint64_t frame);
+void vm_tlb_invalidate(vm_tlb *t, uint64_t vpn);
+void vm_tlb_flush     (vm_tlb *t);
+void vm_tlb_free      (vm_tlb *t);
+
+#endif /* VM_TLB_H_ */
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm_trace.h"
+
+/*
+ * Parse the three header lines describing the memory characteristics.
+ * A malformed header is fatal, just like in the original translator.
+ */
+void vm_trace_read_header(FILE *in, vm_trace *t)
+{
+  char line[MAXSTR];
+  unsigned int d;
+
+  memset(t, 0, sizeof(*t));
+
+  if (fgets(line, MAXSTR, in) == NULL ||
+      sscanf(line, "Logical address space size: %u^%u", &d, &t->log_size) != 2) {
+    fprintf(stderr, "Unexpected line 1. Abort.\n");
+    exit(-1);
+  }
+  if (fgets(line, MAXSTR, in) == NULL ||
+      sscanf(line, "Physical address space size: %u^%u", &d, &t->phy_size) != 2) {
+    fprintf(stderr, "Unexpected line 2. Abort.\n");
+    exit(-1);
+  }
+  if (fgets(line, MAXSTR, in) == NULL ||
+      sscanf(line, "Page size: %u^%u", &d, &t->page_size) != 2) {
+    fprintf(stderr, "Unexpected line 3. Abort.\n");
+    exit(-1);
+  }
+}
+
+/*
+ * Parse one address line, with or without a pid in front (pid 0 if
+ * none). Returns 0 for anything else, which callers skip.
+ */
+int vm_trace_parse(const char *line, unsigned int *pid, uint64_t *addr)
+{
+  unsigned long long a;
+
+  if (sscanf(line, "0x%llx", &a) == 1)
+    *pid = 0;
+  else if (sscanf(line, "%u 0x%llx", pid, &a) != 2)
+    return 0;
+  *addr = a;
+  return 1;
+}
+
+/*
+ * Read the header and every address that follows it into memory, so
+ * the whole trace can be handed to a batch translation kernel.
+ */
+void vm_trace_load(FILE *in, vm_trace *t)
+{
+  char line[MAXSTR];
+  uint64_t a;
+  unsigned int pid;
+
+  vm_trace_read_header(in, t);
+
+  while (fgets(line, MAXSTR, in) != NULL) {
+    if (!vm_trace_parse(line, &pid, &a))
+      continue;
+
+    if (t->n == t->cap) {
+      t->cap = t->cap ? 2 * t->cap : 1024;
+      t->addr = (uint64_t *) realloc(t->addr, t->cap * sizeof(uint64_t));
+      t->pid = (unsigned int *) realloc(t->pid, t->cap * sizeof(unsigned int));
+      if (t->addr == NULL || t->pid == NULL) {
+        perror("realloc");
+        exit(-1);
+      }
+    }
+    t->pid[t->n] = pid;
+    t->addr[t->n++] = a;
+  }
+}
+
+void vm_trace_free(vm_trace *t)
+{
+  free(t->addr);
+  free(t->pid);
+  t->addr = NULL;
+  t->pid = NULL;
+  t->n = t->cap = 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Reading of the VM_addr_map trace format:
+ *
+ *   Logical address space size: 2^L
+ *   Physical address space size: 2^P
+ *   Page size: 2^K
+ *   0x<addr>
+ *   ...
+ *
+ * Traces of several processes prefix each address with a pid:
+ *
+ *   <pid> 0x<addr>
+ */
+
+#ifndef VM_TRACE_H_
+#define VM_TRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define MAXSTR 1000
+
+typedef struct vm_trace {
+  unsigned int log_size;    /* log2 of the logical address space */
+  unsigned int phy_size;    /* log2 of the physical address space */
+  unsigned int page_size;   /* log2 of the page size */
+  size_t       n;           /* number of addresses read */
+  size_t       cap;         /* allocated length of addr[] */
+  uint64_t    *addr;        /* logical addresses, in trace order */
+  unsigned int *pid;        /* pid of each address, 0 if none given */
+} vm_trace;
+
+void vm_trace_read_header (FILE *in, vm_trace *t);
+int  vm_trace_parse       (const char *line, unsigned int *pid, uint64_t *addr);
+void vm_trace_load        (FILE *in, vm_trace *t);
+void vm_trace_free        (vm_trace *t);
+
+#endif /* VM_TRACE_H_ */